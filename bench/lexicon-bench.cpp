@@ -0,0 +1,944 @@
+/*
+ * File: lexicon-bench.cpp
+ * -----------------------
+ * Non-interactive benchmark driver for the Lexicon classes.  Every workload
+ * runs against deterministic synthetic corpora (and optionally a word list
+ * from disk) and reports time per operation, throughput, peak resident memory,
+ * heap allocations per operation and, for the first lookup of each
+ * representation, the bytes the structure holds, as a table, JSON or CSV.
+ *
+ * Usage: lexicon-bench [--format=text|json|csv] [--words=N] [--seed=S]
+ *                      [--repeat=R] [--corpus=FILE] [--filter=TEXT]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <sys/resource.h>
+#include <DenseLexicon.h>
+#include <JournaledLexicon.h>
+#include <KeyNormalizer.h>
+#include <Lexicon.h>
+#include <LexiconScanner.h>
+#include <RadixLexicon.h>
+#include <SuccinctLexicon.h>
+#include "allocation-counter.h"
+using namespace std;
+
+/* Results of the timed loops end up here so the compiler cannot drop them. */
+static volatile size_t g_sink = 0;
+
+/* Command line settings. */
+typedef struct Options {
+  string format;
+  size_t words;
+  uint64_t seed;
+  unsigned repeat;
+  string corpus_file;
+  string filter;
+} Options;
+
+/* One line of the report. */
+typedef struct Result {
+  string corpus;
+  string workload;
+  size_t ops;
+  double seconds;
+  size_t allocations;
+  long peak_rss_kb;
+  /* bytes held by the structure under test, 0 if not recorded */
+  size_t bytes;
+} Result;
+
+/* A word list to run the workloads on.  words holds unique words in a
+ * shuffled order, queries a skewed stream of hits and misses words that are
+ * not in the list but share a prefix with one.
+ */
+typedef struct Corpus {
+  string name;
+  vector<string> words;
+  vector<string> sorted;
+  vector<string> queries;
+  vector<string> misses;
+} Corpus;
+
+/* splitmix64.  The standard distributions are not portable across library
+ * implementations, so corpora are derived from raw 64-bit draws only.
+ */
+typedef struct Random {
+  uint64_t state;
+  uint64_t next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  size_t below(size_t bound) { return static_cast<size_t>(next() % bound); }
+  double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+} Random;
+
+/* Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^s. */
+class Zipf {
+public:
+  Zipf(size_t n, double s) : cdf_(n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i)
+      cdf_[i] = sum += 1.0 / pow(static_cast<double>(i + 1), s);
+    for (double& c : cdf_)
+      c /= sum;
+  }
+  size_t draw(Random& random) const {
+    return min<size_t>(lower_bound(cdf_.begin(), cdf_.end(), random.unit()) - cdf_.begin(),
+        cdf_.size() - 1);
+  }
+private:
+  vector<double> cdf_;
+};
+
+/* Resets the peak resident set size of the process to its current size.
+ * Only Linux supports this; elsewhere peaks are process-wide.
+ */
+void resetPeakRss() {
+  if (FILE* f = fopen("/proc/self/clear_refs", "w")) {
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+/* Returns the peak resident set size in kilobytes. */
+long peakRssKb() {
+  if (FILE* f = fopen("/proc/self/status", "r")) {
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f))
+      if (strncmp(line, "VmHWM:", 6) == 0)
+        kb = strtol(line + 6, nullptr, 10);
+    fclose(f);
+    if (kb >= 0)
+      return kb;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/* Runs setup and then run options.repeat times and records the fastest run.
+ * Only run is timed; it returns the number of operations it performed.
+ */
+void measure(const Options& options, const Corpus& corpus, const string& workload,
+    const function<void ()>& setup, const function<size_t ()>& run,
+    vector<Result>& results) {
+  string name = corpus.name + "/" + workload;
+  if (!options.filter.empty() && name.find(options.filter) == string::npos)
+    return;
+  Result best{corpus.name, workload, 0, 0, 0, 0, 0};
+  for (unsigned r = 0; r < options.repeat; ++r) {
+    setup();
+    resetPeakRss();
+    size_t allocations = allocationCount();
+    auto start = chrono::steady_clock::now();
+    size_t ops = run();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (r == 0 || seconds < best.seconds) {
+      best.ops = ops;
+      best.seconds = seconds;
+      best.allocations = allocationCount() - allocations;
+      best.peak_rss_kb = peakRssKb();
+    }
+  }
+  results.push_back(best);
+  if (options.format == "text")
+    cerr << "  " << name << endl;
+}
+
+/* Runs setup, then times each of count operations on its own and records the
+ * median and the 99th percentile as results workload/p50 and workload/p99 of
+ * one operation each.
+ */
+void measureLatencies(const Options& options, const Corpus& corpus, const string& workload,
+    const function<void ()>& setup, size_t count, const function<void (size_t)>& run,
+    vector<Result>& results) {
+  string name = corpus.name + "/" + workload;
+  if (count == 0 || (!options.filter.empty() && name.find(options.filter) == string::npos))
+    return;
+  setup();
+  vector<double> seconds(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto start = chrono::steady_clock::now();
+    run(i);
+    seconds[i] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+  sort(seconds.begin(), seconds.end());
+  results.push_back(Result{corpus.name, workload + "/p50", 1, seconds[count / 2], 0, 0, 0});
+  results.push_back(Result{corpus.name, workload + "/p99", 1,
+      seconds[min(count - 1, count * 99 / 100)], 0, 0, 0});
+  if (options.format == "text")
+    cerr << "  " << name << endl;
+}
+
+/* Records the size of the structure under test on the result of workload, if
+ * it was just measured.
+ */
+void recordBytes(const Corpus& corpus, const string& workload, size_t bytes,
+    vector<Result>& results) {
+  if (!results.empty() && results.back().corpus == corpus.name &&
+      results.back().workload == workload)
+    results.back().bytes = bytes;
+}
+
+/* Shuffles words, sorts a copy, and derives the query streams. */
+void finishCorpus(Corpus& corpus, Random& random) {
+  for (size_t i = corpus.words.size(); i > 1; --i)
+    swap(corpus.words[i - 1], corpus.words[random.below(i)]);
+  corpus.sorted = corpus.words;
+  sort(corpus.sorted.begin(), corpus.sorted.end());
+  if (corpus.words.empty())
+    return;
+
+  /* a few words are asked for far more often than the rest */
+  Zipf popularity(corpus.words.size(), 1.0);
+  for (size_t i = 0; i < corpus.words.size(); ++i)
+    corpus.queries.push_back(corpus.words[popularity.draw(random)]);
+  /* a miss follows a real word halfway down and then leaves the tree */
+  for (size_t i = 0; i < corpus.words.size(); ++i) {
+    string miss = corpus.words[random.below(corpus.words.size())];
+    miss[miss.size() / 2] = '#';
+    corpus.misses.push_back(miss);
+  }
+}
+
+/* Adds word unless an equal word was added before. */
+void addUnique(Corpus& corpus, unordered_set<string>& seen, const string& word) {
+  if (seen.insert(word).second)
+    corpus.words.push_back(word);
+}
+
+/* Uniformly random lowercase strings of 4 to 16 letters. */
+Corpus randomCorpus(size_t count, uint64_t seed) {
+  Random random{seed};
+  Corpus corpus{"random", {}, {}, {}, {}};
+  unordered_set<string> seen;
+  while (corpus.words.size() < count) {
+    string word(4 + random.below(13), ' ');
+    for (char& c : word)
+      c = static_cast<char>('a' + random.below(26));
+    addUnique(corpus, seen, word);
+  }
+  finishCorpus(corpus, random);
+  return corpus;
+}
+
+/* Words of one to four syllables, the syllables drawn with Zipfian
+ * frequencies, which gives the skewed prefixes of natural language.
+ */
+class SyllableWords {
+public:
+  explicit SyllableWords(Random& random)
+      : syllables_(shuffledSyllables(random)), frequency_(syllables_.size(), 1.1) {}
+  string draw(Random& random) const {
+    string word;
+    for (size_t n = 1 + random.below(4); n > 0; --n)
+      word += syllables_[frequency_.draw(random)];
+    return word;
+  }
+private:
+  /* every onset, vowel and coda combination, in random order so that the
+   * frequent syllables are not all alike */
+  static vector<string> shuffledSyllables(Random& random) {
+    const char* onsets[] = {"", "b", "c", "d", "f", "g", "h", "k", "l", "m", "n", "p",
+      "r", "s", "t", "v", "w", "st", "tr", "pr", "ch", "sh", "th", "bl", "gr"};
+    const char* vowels[] = {"a", "e", "i", "o", "u", "ea", "ou", "ai", "y"};
+    const char* codas[] = {"", "", "", "n", "r", "s", "t", "l", "ng", "nd", "st", "ck"};
+    vector<string> syllables;
+    for (const char* onset : onsets)
+      for (const char* vowel : vowels)
+        for (const char* coda : codas)
+          syllables.push_back(string(onset) + vowel + coda);
+    for (size_t i = syllables.size(); i > 1; --i)
+      swap(syllables[i - 1], syllables[random.below(i)]);
+    return syllables;
+  }
+
+  vector<string> syllables_;
+  Zipf frequency_;
+};
+
+/* Syllable words as drawn by SyllableWords. */
+Corpus zipfCorpus(size_t count, uint64_t seed) {
+  Random random{seed};
+  Corpus corpus{"zipf", {}, {}, {}, {}};
+  SyllableWords syllables(random);
+  unordered_set<string> seen;
+  while (corpus.words.size() < count)
+    addUnique(corpus, seen, syllables.draw(random));
+  finishCorpus(corpus, random);
+  return corpus;
+}
+
+/* Paths below a handful of long directories, so words share 40 or more
+ * leading letters.
+ */
+Corpus longPrefixCorpus(size_t count, uint64_t seed) {
+  Random random{seed};
+  Corpus corpus{"long-prefix", {}, {}, {}, {}};
+  vector<string> stems;
+  for (int i = 0; i < 8; ++i)
+    stems.push_back("/var/lib/lexicon/service-" + to_string(i) + "/cache/objects/shard-");
+  unordered_set<string> seen;
+  while (corpus.words.size() < count) {
+    string word = stems[random.below(stems.size())] + to_string(random.below(100)) + "/";
+    for (size_t n = 6 + random.below(7); n > 0; --n)
+      word.push_back("0123456789abcdef"[random.below(16)]);
+    addUnique(corpus, seen, word);
+  }
+  finishCorpus(corpus, random);
+  return corpus;
+}
+
+/* URL paths of 100 to 200 letters: a few long directory levels, then a
+ * content hash, so most of every key is an unbranched run.
+ */
+Corpus urlCorpus(size_t count, uint64_t seed) {
+  Random random{seed};
+  Corpus corpus{"url", {}, {}, {}, {}};
+  const char* hosts[] = {"static.assets.example.com", "api.internal.example.net",
+    "downloads.mirror.example.org"};
+  const char* sections[] = {"javascript/vendor/bundles", "images/product-catalogue/thumbnails",
+    "v2/accounts/settings/notification-preferences", "releases/stable/linux-x86_64/packages",
+    "documentation/reference/configuration-options"};
+  unordered_set<string> seen;
+  while (corpus.words.size() < count) {
+    string word = string("https://") + hosts[random.below(3)] + "/" + sections[random.below(5)] +
+      "/" + to_string(random.below(1000)) + "/";
+    for (size_t n = 40 + random.below(60); n > 0; --n)
+      word.push_back("0123456789abcdef"[random.below(16)]);
+    addUnique(corpus, seen, word);
+  }
+  finishCorpus(corpus, random);
+  return corpus;
+}
+
+/* A word in one of three cases: mostly lower case, some capitalized and a
+ * few in upper case, so that the same word often occurs in several cases.
+ */
+string caseVariant(const vector<pair<string, string>>& letters, Random& random) {
+  size_t draw = random.below(10);
+  string word;
+  for (size_t i = 0; i < letters.size(); ++i)
+    word += draw >= 9 || (draw >= 6 && i == 0) ? letters[i].second : letters[i].first;
+  return word;
+}
+
+/* Syllable words as in zipfCorpus, in lower, capitalized and upper case. */
+Corpus mixedCaseCorpus(size_t count, uint64_t seed) {
+  Random random{seed};
+  Corpus corpus{"mixed-case", {}, {}, {}, {}};
+  SyllableWords syllables(random);
+  unordered_set<string> seen;
+  while (corpus.words.size() < count) {
+    vector<pair<string, string>> letters;
+    for (char c : syllables.draw(random))
+      letters.push_back(make_pair(string(1, c), string(1, static_cast<char>(c - 'a' + 'A'))));
+    addUnique(corpus, seen, caseVariant(letters, random));
+  }
+  finishCorpus(corpus, random);
+  return corpus;
+}
+
+/* Syllable words in UTF-8: Latin letters with diacritics, Greek and
+ * Cyrillic, one script per word, in lower, capitalized and upper case.
+ */
+Corpus nonAsciiCorpus(size_t count, uint64_t seed) {
+  Random random{seed};
+  Corpus corpus{"non-ascii", {}, {}, {}, {}};
+  /* per script the onsets, vowels and codas, each letter in lower and upper case */
+  typedef vector<pair<string, string>> Letters;
+  struct Script {
+    Letters onsets, vowels, codas;
+  };
+  vector<Script> scripts = {
+    {{{"", ""}, {"b", "B"}, {"d", "D"}, {"k", "K"}, {"l", "L"}, {"m", "M"}, {"n", "N"},
+      {"p", "P"}, {"r", "R"}, {"s", "S"}, {"t", "T"}, {"ž", "Ž"}, {"š", "Š"}, {"č", "Č"},
+      {"ł", "Ł"}},
+     {{"a", "A"}, {"e", "E"}, {"i", "I"}, {"o", "O"}, {"u", "U"}, {"é", "É"}, {"ü", "Ü"},
+      {"ö", "Ö"}, {"å", "Å"}, {"ø", "Ø"}},
+     {{"", ""}, {"", ""}, {"n", "N"}, {"r", "R"}, {"ñ", "Ñ"}, {"ç", "Ç"}}},
+    {{{"", ""}, {"κ", "Κ"}, {"λ", "Λ"}, {"μ", "Μ"}, {"ν", "Ν"}, {"π", "Π"}, {"ρ", "Ρ"},
+      {"σ", "Σ"}, {"τ", "Τ"}, {"δ", "Δ"}, {"γ", "Γ"}},
+     {{"α", "Α"}, {"ε", "Ε"}, {"ι", "Ι"}, {"ο", "Ο"}, {"υ", "Υ"}, {"ω", "Ω"}, {"η", "Η"}},
+     {{"", ""}, {"", ""}, {"ν", "Ν"}, {"σ", "Σ"}}},
+    {{{"", ""}, {"б", "Б"}, {"в", "В"}, {"д", "Д"}, {"к", "К"}, {"л", "Л"}, {"м", "М"},
+      {"н", "Н"}, {"п", "П"}, {"р", "Р"}, {"с", "С"}, {"т", "Т"}, {"ж", "Ж"}, {"ш", "Ш"}},
+     {{"а", "А"}, {"е", "Е"}, {"и", "И"}, {"о", "О"}, {"у", "У"}, {"я", "Я"}, {"ё", "Ё"},
+      {"ы", "Ы"}},
+     {{"", ""}, {"", ""}, {"н", "Н"}, {"р", "Р"}, {"й", "Й"}}},
+  };
+  vector<vector<Letters>> syllables(scripts.size());
+  for (size_t s = 0; s < scripts.size(); ++s) {
+    for (auto& onset : scripts[s].onsets)
+      for (auto& vowel : scripts[s].vowels)
+        for (auto& coda : scripts[s].codas) {
+          Letters syllable;
+          for (auto* letter : {&onset, &vowel, &coda})
+            if (!letter->first.empty())
+              syllable.push_back(*letter);
+          syllables[s].push_back(syllable);
+        }
+    for (size_t i = syllables[s].size(); i > 1; --i)
+      swap(syllables[s][i - 1], syllables[s][random.below(i)]);
+  }
+
+  vector<Zipf> frequencies;
+  for (auto& script : syllables)
+    frequencies.push_back(Zipf(script.size(), 1.1));
+  unordered_set<string> seen;
+  while (corpus.words.size() < count) {
+    size_t s = random.below(syllables.size());
+    Letters letters;
+    for (size_t n = 1 + random.below(4); n > 0; --n) {
+      const Letters& syllable = syllables[s][frequencies[s].draw(random)];
+      letters.insert(letters.end(), syllable.begin(), syllable.end());
+    }
+    addUnique(corpus, seen, caseVariant(letters, random));
+  }
+  finishCorpus(corpus, random);
+  return corpus;
+}
+
+/* The unique non-empty lines of a file, at most count of them. */
+Corpus fileCorpus(const string& filename, size_t count, uint64_t seed) {
+  Random random{seed};
+  Corpus corpus{"file", {}, {}, {}, {}};
+  ifstream file(filename);
+  if (!file)
+    throw runtime_error("cannot read corpus " + filename);
+  unordered_set<string> seen;
+  string word;
+  while (corpus.words.size() < count && getline(file, word))
+    if (!word.empty())
+      addUnique(corpus, seen, word);
+  finishCorpus(corpus, random);
+  return corpus;
+}
+
+/* Joins words into the one-word-per-line format of addWordsFromFile. */
+string joinLines(const vector<string>& words) {
+  string text;
+  for (const string& word : words)
+    text.append(word).push_back('\n');
+  return text;
+}
+
+/* Finds the words on a square board by extending a cursor one cell at a time. */
+size_t solveWithCursor(const string& board, size_t side, size_t cell,
+    Lexicon::Cursor& cursor, vector<char>& visited) {
+  if (visited[cell] || !cursor.advance(board[cell]))
+    return 0;
+  size_t found = cursor.isWord() ? 1 : 0;
+  visited[cell] = 1;
+  size_t row = cell / side, col = cell % side;
+  for (size_t r = row ? row - 1 : 0; r <= row + 1 && r < side; ++r)
+    for (size_t c = col ? col - 1 : 0; c <= col + 1 && c < side; ++c)
+      found += solveWithCursor(board, side, r * side + c, cursor, visited);
+  visited[cell] = 0;
+  cursor.back();
+  return found;
+}
+
+/* Finds the same words by asking containsPrefix for every extended path. */
+size_t solveWithPrefixes(const Lexicon& lex, const string& board, size_t side,
+    size_t cell, string& word, vector<char>& visited) {
+  if (visited[cell])
+    return 0;
+  size_t found = 0;
+  word.push_back(board[cell]);
+  if (lex.containsPrefix(word)) {
+    found = lex.contains(word) ? 1 : 0;
+    visited[cell] = 1;
+    size_t row = cell / side, col = cell % side;
+    for (size_t r = row ? row - 1 : 0; r <= row + 1 && r < side; ++r)
+      for (size_t c = col ? col - 1 : 0; c <= col + 1 && c < side; ++c)
+        found += solveWithPrefixes(lex, board, side, r * side + c, word, visited);
+    visited[cell] = 0;
+  }
+  word.pop_back();
+  return found;
+}
+
+/* Runs every workload on one corpus. */
+void runCorpus(const Options& options, const Corpus& corpus, vector<Result>& results) {
+  const vector<string>& words = corpus.words;
+  const vector<string>& sorted = corpus.sorted;
+  Random random{options.seed ^ 0x5eed};
+  auto nothing = [] {};
+  Lexicon lex;
+  string text;
+  size_t sink = 0;
+
+  /* building */
+  for (int order = 0; order < 2; ++order) {
+    const vector<string>& input = order ? sorted : words;
+    string suffix = order ? "/sorted" : "/shuffled";
+    measure(options, corpus, "add" + suffix, [&] { lex.clear(); }, [&] {
+      for (const string& word : input)
+        lex.add(word);
+      return input.size();
+    }, results);
+    measure(options, corpus, "addWordsFromFile" + suffix, [&] {
+      lex.clear();
+      text = joinLines(input);
+    }, [&] {
+      istringstream stream(text);
+      lex.addWordsFromFile(stream);
+      return input.size();
+    }, results);
+  }
+  unsigned threads = max(thread::hardware_concurrency(), 1u);
+  measure(options, corpus, "bulkLoad/sorted/threads=" + to_string(threads), [&] {
+    lex.clear();
+    text = joinLines(sorted);
+  }, [&] {
+    istringstream stream(text);
+    lex.bulkLoad(stream, threads);
+    return sorted.size();
+  }, results);
+
+  /* lookups, all on the same lexicon */
+  auto build = [&] {
+    lex.clear();
+    for (const string& word : words)
+      lex.add(word);
+  };
+  build();
+  measure(options, corpus, "contains/hit", nothing, [&] {
+    for (const string& word : corpus.queries)
+      sink += lex.contains(word);
+    return corpus.queries.size();
+  }, results);
+  recordBytes(corpus, "contains/hit", lex.stats().bytes.total(), results);
+  /* the same queries in batches of growing size, against contains/hit */
+  unique_ptr<bool[]> found(new bool[corpus.queries.size()]);
+  for (size_t batch : {1u, 4u, 16u, 64u, 256u, 4096u})
+    measure(options, corpus, "containsBatch/size=" + to_string(batch), nothing, [&] {
+      for (size_t i = 0; i < corpus.queries.size(); i += batch)
+        lex.containsBatch(corpus.queries.data() + i,
+            min(batch, corpus.queries.size() - i), found.get() + i);
+      return corpus.queries.size();
+    }, results);
+  measure(options, corpus, "contains/miss", nothing, [&] {
+    for (const string& word : corpus.misses)
+      sink += lex.contains(word);
+    return corpus.misses.size();
+  }, results);
+  vector<string> halves;
+  for (const string& word : corpus.queries)
+    halves.push_back(word.substr(0, (word.size() + 1) / 2));
+  measure(options, corpus, "containsPrefix/hit", nothing, [&] {
+    for (const string& prefix : halves)
+      sink += lex.containsPrefix(prefix);
+    return halves.size();
+  }, results);
+  measure(options, corpus, "containsBatch/hit", nothing, [&] {
+    lex.containsBatch(corpus.queries.data(), corpus.queries.size(), found.get());
+    return corpus.queries.size();
+  }, results);
+
+  /* letter-by-letter search on random 5x5 boards drawn from the corpus letters */
+  vector<string> boards(200);
+  for (string& board : boards)
+    for (size_t i = 0; i < 25; ++i) {
+      const string& word = words[random.below(words.size())];
+      board.push_back(word[random.below(word.size())]);
+    }
+  vector<char> visited(25, 0);
+  measure(options, corpus, "boggle/cursor", nothing, [&] {
+    Lexicon::Cursor cursor = lex.cursor();
+    for (const string& board : boards)
+      for (size_t cell = 0; cell < 25; ++cell)
+        sink += solveWithCursor(board, 5, cell, cursor, visited);
+    return boards.size();
+  }, results);
+  measure(options, corpus, "boggle/containsPrefix", nothing, [&] {
+    string word;
+    for (const string& board : boards)
+      for (size_t cell = 0; cell < 25; ++cell)
+        sink += solveWithPrefixes(lex, board, 5, cell, word, visited);
+    return boards.size();
+  }, results);
+
+  /* one fuzzy lookup per query, each a word with one letter replaced */
+  vector<string> typos(words.size() < 200 ? words.size() : 200);
+  for (size_t i = 0; i < typos.size(); ++i) {
+    typos[i] = corpus.queries[i];
+    typos[i][random.below(typos[i].size())] = 'e';
+  }
+  for (size_t distance = 1; distance <= 3; ++distance)
+    measure(options, corpus, "fuzzyMatches/d=" + to_string(distance), nothing, [&] {
+      for (const string& typo : typos)
+        sink += lex.fuzzyMatches(typo, distance).size();
+      return typos.size();
+    }, results);
+
+  /* patterns with two wildcard letters and with a trailing run */
+  vector<string> patterns;
+  for (size_t i = 0; i < typos.size(); ++i) {
+    string pattern = corpus.queries[i];
+    pattern[random.below(pattern.size())] = '?';
+    pattern[random.below(pattern.size())] = '?';
+    patterns.push_back(pattern);
+    patterns.push_back(corpus.queries[i].substr(0, (corpus.queries[i].size() + 1) / 2) + "*");
+  }
+  measure(options, corpus, "matchPattern", nothing, [&] {
+    for (const string& pattern : patterns)
+      lex.matchPattern(pattern, [&sink](const string&) { ++sink; });
+    return patterns.size();
+  }, results);
+
+  /* type-ahead: a top-10 query after every keystroke, popular words weigh more */
+  vector<string> keystrokes;
+  for (size_t i = 0; i < typos.size(); ++i)
+    for (size_t length = 1; length <= corpus.queries[i].size(); ++length)
+      keystrokes.push_back(corpus.queries[i].substr(0, length));
+  auto weigh = [&] {
+    lex.clear();
+    for (size_t i = 0; i < words.size(); ++i)
+      lex.add(words[i], static_cast<uint32_t>(words.size() - i));
+  };
+  measure(options, corpus, "topCompletions/keystroke", weigh, [&] {
+    for (const string& typed : keystrokes)
+      sink += lex.topCompletions(typed, 10).size();
+    return keystrokes.size();
+  }, results);
+  measureLatencies(options, corpus, "topCompletions/keystroke", weigh, keystrokes.size(),
+      [&](size_t i) { sink += lex.topCompletions(keystrokes[i], 10).size(); }, results);
+
+  /* journaled mutations, and restarting from a snapshot plus a journal that
+   * holds the last 1% of the words */
+  const string journal_path = "lexicon-bench-journal";
+  auto remove_journal = [&journal_path] {
+    remove((journal_path + ".snapshot").c_str());
+    for (int g = 0; g < 4; ++g)
+      remove((journal_path + ".journal." + to_string(g)).c_str());
+  };
+  measure(options, corpus, "journal/add/shuffled", remove_journal, [&] {
+    JournaledLexicon journaled(journal_path, 0);
+    for (const string& word : words)
+      journaled.add(word);
+    journaled.flush();
+    return words.size();
+  }, results);
+  size_t recent = max<size_t>(words.size() / 100, 1);
+  measure(options, corpus, "journal/reopen/recent=1%", [&] {
+    remove_journal();
+    JournaledLexicon journaled(journal_path, 0);
+    for (size_t i = 0; i + recent < words.size(); ++i)
+      journaled.add(words[i]);
+    journaled.compact();
+    journaled.waitForCompaction();
+    for (size_t i = words.size() - recent; i < words.size(); ++i)
+      journaled.add(words[i]);
+  }, [&] {
+    JournaledLexicon journaled(journal_path, 0);
+    sink += journaled.lexicon().size();
+    return words.size();
+  }, results);
+  remove_journal();
+
+  /* set algebra on two lists that share a third of their words, against
+   * going through std::set and adding the result to a fresh lexicon */
+  Lexicon left, right, combined;
+  for (size_t i = 0; i < words.size(); ++i) {
+    if (i % 3 != 2)
+      left.add(words[i]);
+    if (i % 3 != 0)
+      right.add(words[i]);
+  }
+  size_t operands = left.size() + right.size();
+  auto reset = [&] { combined.clear(); };
+  for (unsigned n : {1u, threads}) {
+    string suffix = "/threads=" + to_string(n);
+    measure(options, corpus, "set/unite" + suffix, reset, [&] {
+      combined = Lexicon::unite(left, right, n);
+      return operands;
+    }, results);
+    measure(options, corpus, "set/intersect" + suffix, reset, [&] {
+      combined = Lexicon::intersect(left, right, n);
+      return operands;
+    }, results);
+    measure(options, corpus, "set/subtract" + suffix, reset, [&] {
+      combined = Lexicon::subtract(left, right, n);
+      return operands;
+    }, results);
+    if (n == threads)
+      break;
+  }
+  measure(options, corpus, "set/unite/viaSTLSet", reset, [&] {
+    set<string> lhs = left.toSTLSet(), rhs = right.toSTLSet();
+    vector<string> merged;
+    set_union(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), back_inserter(merged));
+    for (const string& word : merged)
+      combined.add(word);
+    return operands;
+  }, results);
+  measure(options, corpus, "set/subtract/viaSTLSet", reset, [&] {
+    set<string> lhs = left.toSTLSet(), rhs = right.toSTLSet();
+    vector<string> difference;
+    set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), back_inserter(difference));
+    for (const string& word : difference)
+      combined.add(word);
+    return operands;
+  }, results);
+  left.clear();
+  right.clear();
+  combined.clear();
+
+  /* the same lookups on the path-compressed representation */
+  RadixLexicon radix;
+  auto build_radix = [&] {
+    radix.clear();
+    for (const string& word : words)
+      radix.add(word);
+  };
+  measure(options, corpus, "radix/add/shuffled", [&] { radix.clear(); }, [&] {
+    for (const string& word : words)
+      radix.add(word);
+    return words.size();
+  }, results);
+  build_radix();
+  measure(options, corpus, "radix/contains/hit", nothing, [&] {
+    for (const string& word : corpus.queries)
+      sink += radix.contains(word);
+    return corpus.queries.size();
+  }, results);
+  recordBytes(corpus, "radix/contains/hit", radix.memoryUsage(), results);
+  measure(options, corpus, "radix/contains/miss", nothing, [&] {
+    for (const string& word : corpus.misses)
+      sink += radix.contains(word);
+    return corpus.misses.size();
+  }, results);
+  measure(options, corpus, "radix/containsPrefix/hit", nothing, [&] {
+    for (const string& prefix : halves)
+      sink += radix.containsPrefix(prefix);
+    return halves.size();
+  }, results);
+  measure(options, corpus, "radix/remove/shuffled", build_radix, [&] {
+    for (const string& word : words)
+      radix.remove(word);
+    return words.size();
+  }, results);
+  radix.clear();
+
+  /* the same lookups on the read-only succinct copy */
+  build();
+  measure(options, corpus, "succinct/build", nothing, [&] {
+    SuccinctLexicon copy(lex);
+    sink += copy.nodeCount();
+    return words.size();
+  }, results);
+  SuccinctLexicon succinct(lex);
+  measure(options, corpus, "succinct/contains/hit", nothing, [&] {
+    for (const string& word : corpus.queries)
+      sink += succinct.contains(word);
+    return corpus.queries.size();
+  }, results);
+  recordBytes(corpus, "succinct/contains/hit", succinct.memoryUsage(), results);
+  measure(options, corpus, "succinct/contains/miss", nothing, [&] {
+    for (const string& word : corpus.misses)
+      sink += succinct.contains(word);
+    return corpus.misses.size();
+  }, results);
+  measure(options, corpus, "succinct/containsPrefix/hit", nothing, [&] {
+    for (const string& prefix : halves)
+      sink += succinct.containsPrefix(prefix);
+    return halves.size();
+  }, results);
+
+  /* the same lookups on the copy over the alphabet of the corpus */
+  measure(options, corpus, "dense/build", nothing, [&] {
+    DenseLexicon copy(lex);
+    sink += copy.nodeCount();
+    return words.size();
+  }, results);
+  DenseLexicon dense(lex);
+  measure(options, corpus, "dense/contains/hit", nothing, [&] {
+    for (const string& word : corpus.queries)
+      sink += dense.contains(word);
+    return corpus.queries.size();
+  }, results);
+  recordBytes(corpus, "dense/contains/hit", dense.memoryUsage(), results);
+  measure(options, corpus, "dense/contains/miss", nothing, [&] {
+    for (const string& word : corpus.misses)
+      sink += dense.contains(word);
+    return corpus.misses.size();
+  }, results);
+  measure(options, corpus, "dense/containsPrefix/hit", nothing, [&] {
+    for (const string& prefix : halves)
+      sink += dense.containsPrefix(prefix);
+    return halves.size();
+  }, results);
+
+  /* case-insensitive lookups of the queries as they are: lowering a copy of
+   * each query, folding while walking the tree, and the folded dense copy */
+  KeyNormalizer fold = KeyNormalizer::utf8CaseFold();
+  Lexicon folded;
+  for (const string& word : words)
+    folded.add(fold.normalize(word));
+  measure(options, corpus, "folded/contains/viaLoweredCopy", nothing, [&] {
+    for (const string& word : corpus.queries)
+      sink += folded.contains(fold.normalize(word));
+    return corpus.queries.size();
+  }, results);
+  measure(options, corpus, "folded/contains/normalizer", nothing, [&] {
+    for (const string& word : corpus.queries)
+      sink += folded.contains(word.data(), word.size(), fold);
+    return corpus.queries.size();
+  }, results);
+  recordBytes(corpus, "folded/contains/normalizer", folded.stats().bytes.total(), results);
+  folded.clear();
+  DenseLexicon dense_folded(lex, fold);
+  measure(options, corpus, "folded/dense/contains", nothing, [&] {
+    for (const string& word : corpus.queries)
+      sink += dense_folded.contains(word);
+    return corpus.queries.size();
+  }, results);
+  recordBytes(corpus, "folded/dense/contains", dense_folded.memoryUsage(), results);
+
+  /* scanning text made of the query stream; an operation is one byte */
+  string haystack;
+  for (size_t i = 0; i < corpus.queries.size() && haystack.size() < (4u << 20); ++i)
+    haystack.append(corpus.queries[i]).push_back(' ');
+  LexiconScanner scanner(lex);
+  measure(options, corpus, "scan/byte", nothing, [&] {
+    scanner.scan(haystack.data(), haystack.size(), [&sink](size_t, size_t) { ++sink; });
+    return haystack.size();
+  }, results);
+
+  /* removal, each run on a fresh copy */
+  measure(options, corpus, "remove/shuffled", build, [&] {
+    for (const string& word : words)
+      lex.remove(word);
+    return words.size();
+  }, results);
+  vector<string> prefixes;
+  for (const string& word : sorted) {
+    string prefix = word.substr(0, min<size_t>(word.size(), 2 + word.size() / 3));
+    if (prefixes.empty() || prefixes.back() != prefix)
+      prefixes.push_back(prefix);
+  }
+  measure(options, corpus, "removePrefix", build, [&] {
+    for (const string& prefix : prefixes)
+      lex.removePrefix(prefix);
+    return prefixes.size();
+  }, results);
+
+  g_sink = g_sink + sink;
+}
+
+/* Writes the results in the requested format. */
+void report(const Options& options, const vector<Result>& results) {
+  if (options.format == "json") {
+    cout << "{\n  \"benchmark\": \"lexicon-bench\",\n  \"words\": " << options.words
+         << ",\n  \"seed\": " << options.seed << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+      const Result& r = results[i];
+      cout << (i ? "," : "") << "\n    {\"corpus\": \"" << r.corpus
+           << "\", \"workload\": \"" << r.workload << "\", \"ops\": " << r.ops
+           << ", \"ns_per_op\": " << r.seconds * 1e9 / max<size_t>(r.ops, 1)
+           << ", \"ops_per_sec\": " << r.ops / max(r.seconds, 1e-12)
+           << ", \"peak_rss_kb\": " << r.peak_rss_kb << ", \"bytes\": " << r.bytes
+           << ", \"allocs_per_op\": "
+           << static_cast<double>(r.allocations) / max<size_t>(r.ops, 1) << "}";
+    }
+    cout << "\n  ]\n}" << endl;
+    return;
+  }
+  if (options.format == "csv") {
+    cout << "corpus,workload,ops,ns_per_op,ops_per_sec,peak_rss_kb,bytes,allocs_per_op\n";
+    for (const Result& r : results)
+      cout << r.corpus << "," << r.workload << "," << r.ops << ","
+           << r.seconds * 1e9 / max<size_t>(r.ops, 1) << ","
+           << r.ops / max(r.seconds, 1e-12) << "," << r.peak_rss_kb << "," << r.bytes << ","
+           << static_cast<double>(r.allocations) / max<size_t>(r.ops, 1) << "\n";
+    return;
+  }
+  printf("%-14s %-30s %10s %12s %14s %12s %12s %10s\n", "corpus", "workload", "ops",
+      "ns/op", "ops/sec", "peak RSS kB", "bytes", "allocs/op");
+  for (const Result& r : results)
+    printf("%-14s %-30s %10zu %12.1f %14.0f %12ld %12zu %10.2f\n", r.corpus.c_str(),
+        r.workload.c_str(), r.ops, r.seconds * 1e9 / max<size_t>(r.ops, 1),
+        r.ops / max(r.seconds, 1e-12), r.peak_rss_kb, r.bytes,
+        static_cast<double>(r.allocations) / max<size_t>(r.ops, 1));
+}
+
+/* Parses --name=value arguments into options. */
+bool parseOptions(int argc, char* argv[], Options& options) {
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    size_t equals = arg.find('=');
+    string name = arg.substr(0, equals);
+    string value = equals == string::npos ? "" : arg.substr(equals + 1);
+    if (name == "--format" && (value == "text" || value == "json" || value == "csv"))
+      options.format = value;
+    else if (name == "--words" && !value.empty())
+      options.words = strtoull(value.c_str(), nullptr, 10);
+    else if (name == "--seed" && !value.empty())
+      options.seed = strtoull(value.c_str(), nullptr, 10);
+    else if (name == "--repeat" && !value.empty())
+      options.repeat = max(1u, static_cast<unsigned>(strtoul(value.c_str(), nullptr, 10)));
+    else if (name == "--corpus" && !value.empty())
+      options.corpus_file = value;
+    else if (name == "--filter")
+      options.filter = value;
+    else
+      return false;
+  }
+  return options.words > 0;
+}
+
+int main(int argc, char* argv[]) try {
+  Options options{"text", 200000, 42, 1, "", ""};
+  if (!parseOptions(argc, argv, options)) {
+    cerr << "usage: " << argv[0] << " [--format=text|json|csv] [--words=N] [--seed=S]"
+         << " [--repeat=R] [--corpus=FILE] [--filter=TEXT]" << endl;
+    return 2;
+  }
+
+  vector<Result> results;
+  vector<function<Corpus ()>> corpora = {
+    [&] { return randomCorpus(options.words, options.seed); },
+    [&] { return zipfCorpus(options.words, options.seed); },
+    [&] { return longPrefixCorpus(options.words, options.seed); },
+    [&] { return urlCorpus(options.words, options.seed); },
+    [&] { return mixedCaseCorpus(options.words, options.seed); },
+    [&] { return nonAsciiCorpus(options.words, options.seed); },
+  };
+  if (!options.corpus_file.empty())
+    corpora.push_back([&] { return fileCorpus(options.corpus_file, options.words, options.seed); });
+  for (auto& make : corpora) {
+    Corpus corpus = make();
+    if (options.format == "text")
+      cerr << corpus.name << ": " << corpus.words.size() << " words" << endl;
+    if (!corpus.words.empty())
+      runCorpus(options, corpus, results);
+  }
+  report(options, results);
+  return 0;
+} catch (const exception& e) {
+  cerr << "lexicon-bench: " << e.what() << endl;
+  return 1;
+}
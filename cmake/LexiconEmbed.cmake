@@ -0,0 +1,29 @@
+# lexicon_embed(<target> <words-file> [NAME <identifier>])
+#
+# Compile the words of <words-file> into <target> as a constant
+# EmbeddedLexicon.  The lexicon-embed tool runs at build time, whenever the
+# file changes, and writes <identifier>.h and <identifier>.cpp; the source is
+# added to <target> and the header is found with #include <<identifier>.h>.
+# NAME defaults to the file name without extension, made an identifier.
+include(CMakeParseArguments)
+
+function(lexicon_embed target words_file)
+  cmake_parse_arguments(EMBED "" "NAME" "" ${ARGN})
+  get_filename_component(words_path ${words_file} ABSOLUTE)
+  if(NOT EMBED_NAME)
+    get_filename_component(EMBED_NAME ${words_file} NAME_WE)
+    string(MAKE_C_IDENTIFIER ${EMBED_NAME} EMBED_NAME)
+  endif()
+
+  set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/lexicon-embed)
+  set(header ${output_dir}/${EMBED_NAME}.h)
+  set(source ${output_dir}/${EMBED_NAME}.cpp)
+  add_custom_command(OUTPUT ${header} ${source}
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${output_dir}
+    COMMAND lexicon-embed ${words_path} ${EMBED_NAME} ${output_dir}
+    DEPENDS lexicon-embed ${words_path}
+    COMMENT "Embedding ${words_file} as ${EMBED_NAME}"
+    VERBATIM)
+  set_property(TARGET ${target} APPEND PROPERTY SOURCES ${header} ${source})
+  set_property(TARGET ${target} APPEND PROPERTY INCLUDE_DIRECTORIES ${output_dir})
+endfunction()
@@ -0,0 +1,266 @@
+#ifndef CONCURRENT_LEXICON_H_
+#define CONCURRENT_LEXICON_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Lexicon;
+
+/** \brief A Lexicon that can be queried by many threads while it is updated.
+ *
+ * Readers never block and never retry: a lookup announces the current epoch
+ * in the reader's own slot, loads the published version and walks its
+ * immutable nodes.  A writer collects mutations in a Batch and applies them
+ * by copying only the nodes on the modified paths, then publishes the new
+ * version with a single atomic store, so readers observe either all or none
+ * of a batch.  Nodes replaced by a version are retired with the epoch of that
+ * version and freed once no reader slot announces an older epoch.
+ *
+ * Typical use:
+ * \code
+ *   ConcurrentLexicon lex;
+ *   // on each query thread
+ *   ConcurrentLexicon::Reader reader = lex.reader();
+ *   reader.contains("word");
+ *   // on the update thread
+ *   ConcurrentLexicon::Batch batch;
+ *   batch.add("new");
+ *   batch.removePrefix("old");
+ *   lex.apply(batch);
+ * \endcode
+ */
+class ConcurrentLexicon {
+public:
+  class Batch;
+  class Reader;
+  class Snapshot;
+
+  /** \brief maximum number of Readers that can exist at the same time */
+  static const size_t kMaxReaders = 128;
+
+  /** \brief create an empty lexicon */
+  ConcurrentLexicon();
+
+  /** \brief create a lexicon holding the words of lex */
+  explicit ConcurrentLexicon(const Lexicon& lex);
+
+  /** \brief all Readers must have been destroyed */
+  ~ConcurrentLexicon();
+
+  ConcurrentLexicon(const ConcurrentLexicon&) = delete;
+  ConcurrentLexicon& operator=(const ConcurrentLexicon&) = delete;
+
+  /** \brief claim a reader slot for the calling thread
+   *  \throws std::runtime_error if kMaxReaders Readers already exist
+   */
+  Reader reader();
+
+  /** \brief apply the mutations of batch in order and publish the result as
+   *  one new version.  Concurrent calls are serialized
+   *  \param[in] batch the mutations to apply
+   */
+  void apply(const Batch& batch);
+
+  /** \brief add a single word.  Equivalent to applying a batch of one */
+  void add(const std::string& word);
+
+  /** \brief remove a single word.  Equivalent to applying a batch of one */
+  void remove(const std::string& word);
+
+  /** \brief remove all words with a prefix.  Equivalent to applying a batch
+   *  of one
+   */
+  void removePrefix(const std::string& prefix);
+
+  /** \brief free retired nodes that no reader can reach any more.  apply()
+   *  does this after every publication
+   */
+  void reclaim();
+
+  /** \brief returns the number of retired nodes that are not freed yet */
+  size_t pendingReclamation() const;
+
+private:
+  /** \brief an immutable node.  It is followed in memory by its child
+   * pointers and then by their labels, in ascending unsigned-byte order.
+   */
+  typedef struct Node {
+    bool is_word;
+    uint32_t num_children;
+    const Node* const* children() const {
+      return reinterpret_cast<const Node* const*>(this + 1);
+    }
+    const Node** children() { return reinterpret_cast<const Node**>(this + 1); }
+    const char* labels() const {
+      return reinterpret_cast<const char*>(children() + num_children);
+    }
+    char* labels() { return reinterpret_cast<char*>(children() + num_children); }
+  } Node;
+
+  /** \brief a published state of the lexicon */
+  typedef struct Version {
+    const Node* root;
+    size_t size;
+  } Version;
+
+  /** \brief the epoch a reader announced, or 0 while it is not reading */
+  struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch;
+    std::atomic<bool> claimed;
+  };
+
+  /** \brief the working state of apply() */
+  struct Update;
+
+  static Node* allocNode(bool is_word, size_t num_children);
+  static void freeNode(const Node* node);
+
+  /** \brief returns the child of node reached by label, or nullptr */
+  static const Node* child(const Node* node, char label);
+
+  /** \brief return the node reached by str from root, or nullptr */
+  static const Node* findNode(const Node* root, const std::string& str);
+
+  /** \brief apply a function to all words below root in sorted order */
+  static void walkWords(const Node* root,
+      const std::function<void (const std::string&)>& func);
+
+  void applyAdd(Update& update, const std::string& word);
+  void applyRemove(Update& update, const std::string& word);
+  void applyRemovePrefix(Update& update, const std::string& prefix);
+
+  /** \brief replace the nodes along path with copies ending in replacement */
+  void replacePath(Update& update, const std::string& key,
+      const std::vector<const Node*>& path, const Node* replacement, bool prune);
+
+  /** \brief return node with the edge for label pointing to child, removing
+   *  the edge if child is nullptr
+   */
+  const Node* setChild(Update& update, const Node* node, char label, const Node* child);
+
+  /** \brief return node with its word flag set to is_word */
+  const Node* setWord(Update& update, const Node* node, bool is_word);
+
+  /** \brief drop a node from the working tree: unpublished nodes are freed
+   *  at once, published ones are retired
+   */
+  void discard(Update& update, const Node* node);
+
+  /** \brief discard node and all nodes below it
+   *  \return the number of words below node
+   */
+  size_t discardSubtree(Update& update, const Node* node);
+
+  /** \brief free what reclaim() frees; writer_mutex_ must be held */
+  void reclaimLocked();
+
+  /** \brief pin the current version in slot and return it */
+  const Version* pin(ReaderSlot& slot) const;
+
+  std::atomic<const Version*> current_;
+  std::atomic<uint64_t> global_epoch_;
+  ReaderSlot slots_[kMaxReaders];
+
+  /* \brief serializes writers and guards the retired lists */
+  mutable std::mutex writer_mutex_;
+  std::vector<std::pair<uint64_t, const Node*>> retired_nodes_;
+  std::vector<std::pair<uint64_t, const Version*>> retired_versions_;
+};
+
+/** \brief a list of mutations to be published together by apply() */
+class ConcurrentLexicon::Batch {
+public:
+  /** \brief queue adding a word */
+  void add(const std::string& word);
+
+  /** \brief queue removing a word */
+  void remove(const std::string& word);
+
+  /** \brief queue removing all words with a prefix */
+  void removePrefix(const std::string& prefix);
+
+  /** \brief forget all queued mutations */
+  void clear();
+
+  /** \brief returns whether no mutation is queued */
+  bool empty() const;
+
+private:
+  friend class ConcurrentLexicon;
+  enum Operation { kAdd, kRemove, kRemovePrefix };
+  std::vector<std::pair<Operation, std::string>> operations_;
+};
+
+/** \brief a view of one published version.  Everything it returns is
+ * consistent with that version, no matter how many batches are applied while
+ * it is alive.  Holding a Snapshot delays the reclamation of newer garbage, so
+ * keep it short-lived.
+ */
+class ConcurrentLexicon::Snapshot {
+public:
+  ~Snapshot();
+  Snapshot(Snapshot&& other);
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+
+  /** \brief returns whether the version contains a word */
+  bool contains(const std::string& word) const;
+
+  /** \brief returns whether the version contains a prefix */
+  bool containsPrefix(const std::string& prefix) const;
+
+  /** \brief returns number of words in the version */
+  size_t size() const;
+
+  /** \brief apply a function to all words of the version in sorted order */
+  void mapAll(const std::function<void (const std::string&)>& func) const;
+
+private:
+  friend class ConcurrentLexicon::Reader;
+  Snapshot(Reader* reader, const Version* version);
+
+  Reader* reader_;
+  const Version* version_;
+};
+
+/** \brief a handle through which one thread queries the lexicon.  Every
+ * operation is wait-free.  A Reader must only be used by one thread at a time.
+ */
+class ConcurrentLexicon::Reader {
+public:
+  ~Reader();
+  Reader(Reader&& other);
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  /** \brief returns whether the latest version contains a word */
+  bool contains(const std::string& word);
+
+  /** \brief returns whether the latest version contains a prefix */
+  bool containsPrefix(const std::string& prefix);
+
+  /** \brief returns number of words in the latest version */
+  size_t size();
+
+  /** \brief pin the latest version for several consistent queries.  Snapshots
+   *  of the same Reader may nest
+   */
+  Snapshot snapshot();
+
+private:
+  friend class ConcurrentLexicon;
+  friend class ConcurrentLexicon::Snapshot;
+  Reader(const ConcurrentLexicon* lexicon, ReaderSlot* slot);
+
+  const ConcurrentLexicon* lexicon_;
+  ReaderSlot* slot_;
+  size_t pins_;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/** \brief returns the CRC-32 (IEEE 802.3) of a buffer, continuing from the
+ *  checksum of preceding data.  Used to validate lexicon images and journals
+ *  \param[in] data the first byte of the buffer
+ *  \param[in] length the number of bytes in the buffer
+ *  \param[in] crc the checksum of the data before the buffer, 0 for none
+ */
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+#endif
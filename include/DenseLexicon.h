@@ -0,0 +1,132 @@
+#ifndef DENSE_LEXICON_H_
+#define DENSE_LEXICON_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <KeyNormalizer.h>
+
+class Lexicon;
+
+/** \brief An immutable copy of a Lexicon over a remapped alphabet, with
+ * direct-indexed child tables, optionally normalizing its keys.
+ *
+ * The bytes that occur in the words are numbered densely in ascending order,
+ * so a list of lower case words has an alphabet of about 26 letters rather
+ * than 256 bytes.  Every node then holds a bitmap with one bit per letter of
+ * the alphabet, and its children are numbered consecutively: the child for a
+ * letter is the node's first child plus the number of bits set below the
+ * letter's bit.  Finding a child is a table lookup and a population count,
+ * however many children there are, instead of a search through the labels.
+ * A node costs 8 bytes for its first child and word flag plus 8 bytes of
+ * bitmap per 64 letters of the alphabet.  Nodes are numbered depth first,
+ * each giving its children the next free numbers, so a long unbranched run
+ * of letters is a run of neighbouring nodes in memory.
+ *
+ * With a KeyNormalizer the words are normalized while they are copied, so
+ * words with the same normal form become one, and every query is normalized
+ * byte by byte as it walks down, without a copy.  Bytes that are not in the
+ * alphabet leave the tree on the first table lookup.
+ *
+ * \code
+ *   DenseLexicon folded(lex, KeyNormalizer::utf8CaseFold());
+ *   folded.contains("APPLE");
+ * \endcode
+ */
+class DenseLexicon {
+public:
+  /** \brief copy the words of lex
+   *  \param[in] lex the words
+   *  \param[in] normalizer applied to the words and to every query
+   *  \throws std::length_error if the tree has 2^31 nodes or more
+   */
+  explicit DenseLexicon(const Lexicon& lex,
+      const KeyNormalizer& normalizer = KeyNormalizer());
+
+  /** \brief returns the number of letters in the alphabet */
+  size_t alphabetSize() const { return letters_.size(); }
+
+  /** \brief returns whether the lexicon contains a word */
+  bool contains(const std::string& word) const;
+
+  /** \brief returns whether the lexicon contains a word held in a buffer */
+  bool contains(const char* word, size_t length) const;
+
+  /** \brief returns whether the lexicon contains a prefix */
+  bool containsPrefix(const std::string& prefix) const;
+
+  /** \brief returns whether the lexicon contains a prefix held in a buffer */
+  bool containsPrefix(const char* prefix, size_t length) const;
+
+  /** \brief returns whether the lexicon contains any words */
+  bool isEmpty() const { return size_ == 0; }
+
+  /** \brief apply a function to all words in the lexicon, in their normal
+   *  form and in sorted order.  The word passed to func is only valid for
+   *  the duration of the call.
+   *  \param[in] the function to be applied
+   */
+  void mapAll(const std::function<void (const std::string&)>& func) const;
+
+  /** \brief returns the number of bytes used by the nodes and the alphabet */
+  size_t memoryUsage() const;
+
+  /** \brief returns the number of nodes, including the root */
+  size_t nodeCount() const { return nodes_.size() / stride_; }
+
+  /** \brief returns the normalizer applied to queries */
+  const KeyNormalizer& normalizer() const { return normalizer_; }
+
+  /** \brief returns number of words in lexicon, after normalization */
+  size_t size() const { return size_; }
+
+private:
+  /** \brief returned by findNode when a key leaves the tree */
+  static const uint32_t kNoNode = 0xffffffffu;
+
+  /** \brief the code of bytes that are not in the alphabet */
+  static const uint16_t kNoCode = 0xffff;
+
+  /** \brief the first word of a node holds its first child in the low half
+   *  and this bit when it ends a word
+   */
+  static const uint64_t kWordBit = uint64_t(1) << 32;
+
+  /** \brief returns the child of node for a letter code, or kNoNode */
+  uint32_t child(uint32_t node, size_t code) const;
+
+  /** \brief returns the first code from from on that node has a child for,
+   *  or kNoCode
+   */
+  size_t nextCode(uint32_t node, size_t from) const;
+
+  /** \brief returns the node reached by key from the root, or kNoNode */
+  uint32_t findNode(const char* key, size_t length) const;
+
+  /** \brief returns whether node ends a word */
+  bool isWord(uint32_t node) const { return nodes_[node * stride_] & kWordBit; }
+
+  /* \brief applied to every query */
+  KeyNormalizer normalizer_;
+
+  /* \brief the code of each byte of a normalized key */
+  uint16_t codes_[256];
+
+  /* \brief the byte of each code, in ascending order */
+  std::vector<char> letters_;
+
+  /* \brief the number of words per node: the first child and word flag,
+   * then the bitmap of the children
+   */
+  size_t stride_;
+
+  /* \brief the nodes in depth first order, stride_ words each */
+  std::vector<uint64_t> nodes_;
+
+  /* \brief number of words */
+  size_t size_;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef EMBEDDED_LEXICON_H_
+#define EMBEDDED_LEXICON_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <FrozenLexicon.h>
+
+/** \brief A word list compiled into the program.
+ *
+ * The lexicon-embed tool turns a word file into C++ source that defines the
+ * state, label and target arrays of its FrozenLexicon as constants, plus an
+ * EmbeddedLexicon over them.  The constructor is constexpr, so the object is
+ * initialized by the compiler and loader: nothing is parsed or allocated at
+ * startup, and the arrays sit in the read-only data of the binary, shared by
+ * every process running it.  With CMake, lexicon_embed() runs the tool at
+ * build time:
+ *
+ * \code
+ *   lexicon_embed(my-tool stopwords.txt)
+ *
+ *   #include <stopwords.h>
+ *   stopwords.contains("the");
+ * \endcode
+ *
+ * The words are exactly those Lexicon(filename) reads from the same file.
+ */
+class EmbeddedLexicon {
+public:
+  typedef FrozenLexicon::State State;
+  typedef FrozenLexicon::StateId StateId;
+
+  /** \brief wrap arrays in the layout of a FrozenLexicon.  Only meant for
+   *  the source written by generate()
+   */
+  constexpr EmbeddedLexicon(const State* states, const StateId* targets,
+      const char* labels, size_t num_states, size_t num_edges, StateId root,
+      size_t size) :
+    states_(states),
+    targets_(targets),
+    labels_(labels),
+    num_states_(num_states),
+    num_edges_(num_edges),
+    root_(root),
+    size_(size)
+  {}
+
+  /** \brief returns whether the lexicon contains a word */
+  bool contains(const std::string& word) const;
+
+  /** \brief returns whether the lexicon contains a word held in a buffer */
+  bool contains(const char* word, size_t length) const;
+
+  /** \brief returns whether the lexicon contains a prefix */
+  bool containsPrefix(const std::string& prefix) const;
+
+  /** \brief returns whether the lexicon contains a prefix held in a buffer */
+  bool containsPrefix(const char* prefix, size_t length) const;
+
+  /** \brief returns whether the lexicon contains any words */
+  bool isEmpty() const { return size_ == 0; }
+
+  /** \brief apply a function to all words in the lexicon in sorted order.
+   *  The word passed to func is only valid for the duration of the call.
+   *  \param[in] the function to be applied
+   */
+  void mapAll(const std::function<void (const std::string&)>& func) const;
+
+  /** \brief returns number of words in lexicon */
+  size_t size() const { return size_; }
+
+  /** \brief returns a FrozenLexicon over the embedded arrays, without
+   *  copying them, for the rest of its interface
+   */
+  FrozenLexicon frozen() const;
+
+  /** \brief write C++ source embedding words
+   *  \param[in] words the words to embed
+   *  \param[in] name the name of the EmbeddedLexicon, a C++ identifier
+   *  \param[out] header receives the header declaring it, meant to be saved
+   *  as name.h
+   *  \param[out] source receives the source defining it and its arrays
+   *  \throws std::invalid_argument if name is not an identifier
+   */
+  static void generate(const FrozenLexicon& words, const std::string& name,
+      std::ostream& header, std::ostream& source);
+
+private:
+  /** \brief returns the state reached by key from the root, or
+   *  FrozenLexicon::kNoState
+   */
+  StateId findState(const char* key, size_t length) const;
+
+  /* \brief the arrays, as in FrozenLexicon */
+  const State* states_;
+  const StateId* targets_;
+  const char* labels_;
+  size_t num_states_;
+  size_t num_edges_;
+  StateId root_;
+
+  /* \brief number of words */
+  size_t size_;
+};
+
+#endif
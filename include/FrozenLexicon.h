@@ -0,0 +1,188 @@
+#ifndef FROZEN_LEXICON_H_
+#define FROZEN_LEXICON_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <functional>
+#include <memory>
+
+/** \brief An immutable word list stored as a minimal acyclic automaton (also
+ * referred to as a DAWG).  Unlike the prefix tree used by Lexicon, words that
+ * end the same way share their suffix states, which shrinks natural-language
+ * word lists considerably.  All states live in flat arrays: a state owns the
+ * block [edges, edges + num_edges) of the parallel label and target arrays,
+ * with labels in ascending unsigned-byte order.
+ *
+ * A FrozenLexicon is built either with Lexicon::freeze() or straight from
+ * sorted input through FrozenLexicon::Builder, which never materializes the
+ * full prefix tree.  Because states refer to each other by index, the arrays
+ * can also be saved to a file and mapped back read-only with mapFile(); the
+ * mapped lexicon is queried in place and its pages are shared by every
+ * process mapping the same file.  Copies of a FrozenLexicon share the
+ * underlying arrays.
+ */
+class FrozenLexicon {
+public:
+  typedef uint32_t StateId;
+
+  /** \brief a state of the automaton */
+  typedef struct State {
+    uint32_t edges;
+    uint16_t num_edges;
+    uint8_t is_word;
+    uint8_t reserved;
+  } State;
+
+  class Builder;
+
+  /** \brief create an empty lexicon */
+  FrozenLexicon();
+
+  /** \brief map a file written by save() read-only into memory
+   *  \param[in] path the name of the file
+   *  \param[in] verify_checksum whether to checksum and bounds-check the
+   *  whole file before using it.  The header is always checked
+   *  \throws std::runtime_error if the file cannot be mapped or is not a
+   *  valid lexicon image
+   */
+  static FrozenLexicon mapFile(const std::string& path, bool verify_checksum = true);
+
+  /** \brief create a lexicon from words stored one per line in sorted order
+   *  \param[in] input the input stream of sorted words seperated by a new line
+   *  \throws std::invalid_argument if the words are not in sorted order
+   */
+  static FrozenLexicon fromSorted(std::istream& input);
+
+  /** \brief returns whether the lexicon contains a word
+   *  \param[in] word the query word
+   */
+  bool contains(const std::string& word) const;
+
+  /** \brief returns whether the lexicon contains a prefix
+   *  \return true if prefix is in lexicon
+   */
+  bool containsPrefix(const std::string& prefix) const;
+
+  /** \brief returns whether the lexicon contains any words */
+  bool isEmpty() const;
+
+  /** \brief apply a function to all words in the lexicon in sorted order.
+   *  The word passed to func is only valid for the duration of the call.
+   *  \param[in] the function to be applied
+   */
+  void mapAll(const std::function<void (const std::string&)>& func) const;
+
+  /** \brief returns number of words in lexicon */
+  size_t size() const;
+
+  /** \brief returns the number of states of the automaton */
+  size_t numStates() const;
+
+  /** \brief returns the number of transitions of the automaton */
+  size_t numEdges() const;
+
+  /** \brief returns the number of bytes used by the state and edge arrays */
+  size_t memoryUsage() const;
+
+  /** \brief write the lexicon to a file in the format read by mapFile()
+   *  \param[in] path the name of the file
+   *  \return true if the file was written
+   */
+  bool save(const std::string& path) const;
+
+private:
+  friend class EmbeddedLexicon;
+
+  static const StateId kNoState = 0xffffffffu;
+
+  /** \brief keeps the memory the arrays point into alive */
+  struct Storage {
+    virtual ~Storage() {}
+  };
+  struct OwnedStorage;
+  struct MappedStorage;
+
+  /** \brief returns the state reached from state by label, or kNoState */
+  StateId next(StateId state, char label) const;
+
+  /** \brief return the state whose path forms the input string if found */
+  StateId findState(const std::string& str) const;
+
+  std::shared_ptr<const Storage> storage_;
+  const State* states_;
+  const char* labels_;
+  const StateId* targets_;
+  size_t num_states_;
+  size_t num_edges_;
+  StateId root_;
+  size_t size_;
+};
+
+/** \brief Builds a minimal FrozenLexicon in one incremental pass over words
+ * given in sorted order (Daciuk et al.).  Only the states along the path of
+ * the most recently added word stay mutable; every state that falls off that
+ * path is replaced by an equivalent registered state or registered itself.
+ */
+class FrozenLexicon::Builder {
+public:
+  Builder();
+  ~Builder();
+  Builder(const Builder&) = delete;
+  Builder& operator=(const Builder&) = delete;
+
+  /** \brief add the next word.  Repeating the previous word is allowed and
+   *  has no effect.
+   *  \param[in] word the word to be added
+   *  \return false if word sorts before the previously added word, in which
+   *  case it is not added
+   */
+  bool add(const std::string& word);
+
+  /** \brief finish construction and return the automaton.  The builder is
+   *  left empty and can be reused.
+   */
+  FrozenLexicon finish();
+
+private:
+  /** \brief a state on the path of the previous word that can still change */
+  typedef struct PendingState {
+    bool is_word;
+    std::vector<std::pair<char, StateId>> edges;
+  } PendingState;
+
+  /** \brief hashes registered states by their contents */
+  struct StateHash {
+    const Builder* builder;
+    size_t operator()(StateId state) const;
+  };
+
+  /** \brief compares registered states by their contents */
+  struct StateEqual {
+    const Builder* builder;
+    bool operator()(StateId lhs, StateId rhs) const;
+  };
+
+  /** \brief register all pending states deeper than depth */
+  void minimize(size_t depth);
+
+  /** \brief return the id of a registered state equivalent to pending,
+   *  registering pending if there is none yet
+   */
+  StateId registerState(const PendingState& pending);
+
+  std::vector<PendingState> path_;
+  std::string previous_;
+  bool has_previous_;
+
+  /* \brief the arrays of the automaton being built */
+  std::unique_ptr<OwnedStorage> storage_;
+  size_t size_;
+
+  std::unordered_set<StateId, StateHash, StateEqual> register_;
+};
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef JOURNALED_LEXICON_H_
+#define JOURNALED_LEXICON_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Lexicon.h>
+
+/** \brief A Lexicon whose mutations are persisted incrementally, so that a
+ * restart costs time proportional to the recent changes rather than to
+ * rebuilding the whole word list from text.
+ *
+ * State lives in two kinds of files next to each other:
+ *
+ *   path.snapshot    the words and weights at some point, as an image of
+ *                    the tree that loads with sequential reads
+ *   path.journal.N   the mutations since then, one checksummed record each
+ *
+ * Every successful add, remove, removePrefix and clear appends a record to an
+ * in-memory buffer, which is written to the current journal once it fills
+ * up and on flush(); sync() also forces it to disk.  Opening loads the
+ * snapshot and then replays the journals in order.  A crash may tear the last record
+ * of the last journal; replay stops at the first record that is incomplete
+ * or fails its CRC-32, and the journal is truncated there before new records
+ * are appended.
+ *
+ * compact() switches to a new journal and writes a snapshot of the current
+ * words on a background thread.  That thread rebuilds the words from the old
+ * snapshot and the journals before the new one, so the tree is neither
+ * copied nor locked.  The snapshot is written to a temporary file and
+ * renamed into place, and only then are the journals it covers deleted, so a
+ * crash at any point leaves a snapshot and journals that replay to the same
+ * words.  Compaction also starts on its own once the current journal
+ * outgrows compaction_bytes.
+ *
+ * A JournaledLexicon is not thread-safe; the background compaction touches
+ * only the files it has finished with and its own copy of the words.
+ *
+ * \code
+ *   JournaledLexicon dictionary("/var/lib/app/words");
+ *   dictionary.add("word");
+ *   dictionary.sync();
+ *   dictionary.lexicon().contains("word");
+ * \endcode
+ */
+class JournaledLexicon {
+public:
+  /** \brief what opening the lexicon found on disk */
+  typedef struct Recovery {
+    /** \brief words read from the snapshot */
+    size_t snapshot_words;
+    /** \brief journal records replayed on top of the snapshot */
+    size_t replayed_records;
+    /** \brief bytes cut off the journals after a torn or corrupt record */
+    size_t discarded_bytes;
+  } Recovery;
+
+  /** \brief a journal is compacted once it holds this many bytes, unless
+   *  another threshold is given to the constructor
+   */
+  static const size_t kDefaultCompactionBytes = size_t(64) << 20;
+
+  /** \brief open the lexicon stored at path, creating it if there is none
+   *  \param[in] path the common prefix of the snapshot and journal files
+   *  \param[in] compaction_bytes start a compaction when the journal holds
+   *  this many bytes, 0 to compact only when asked to
+   *  \throws std::runtime_error if the files cannot be opened or the
+   *  snapshot is corrupt
+   */
+  explicit JournaledLexicon(const std::string& path,
+      size_t compaction_bytes = kDefaultCompactionBytes);
+
+  /** \brief writes buffered records and waits for a running compaction */
+  ~JournaledLexicon();
+
+  JournaledLexicon(const JournaledLexicon&) = delete;
+  JournaledLexicon& operator=(const JournaledLexicon&) = delete;
+
+  /** \brief add a word.  See Lexicon::add
+   *  \throws std::runtime_error if the journal cannot be written, or if an
+   *  earlier compaction failed when the next one is due; the word is added
+   *  and journaled either way
+   */
+  void add(const std::string& word);
+
+  /** \brief add a word with a weight.  See Lexicon::add */
+  void add(const std::string& word, uint32_t weight);
+
+  /** \brief delete all words */
+  void clear();
+
+  /** \brief start writing a snapshot of the current words on a background
+   *  thread, after which the journals written so far are deleted.  Does
+   *  nothing if a compaction is already running
+   *  \throws std::runtime_error if the next journal cannot be created, or if
+   *  the previous compaction failed, which then leaves the next one to the
+   *  next call
+   */
+  void compact();
+
+  /** \brief write the buffered records to the journal
+   *  \throws std::runtime_error if the write fails.  What was not written
+   *  stays buffered, and the next flush continues from there
+   */
+  void flush();
+
+  /** \brief returns the size of the current journal in bytes, buffered
+   *  records included
+   */
+  size_t journalBytes() const { return journal_bytes_ + buffer_.size(); }
+
+  /** \brief the words, for queries */
+  const Lexicon& lexicon() const { return lex_; }
+
+  /** \brief returns what opening the lexicon found on disk */
+  const Recovery& recovery() const { return recovery_; }
+
+  /** \brief remove a word.  See Lexicon::remove */
+  bool remove(const std::string& word);
+
+  /** \brief remove all words with a prefix.  See Lexicon::removePrefix */
+  size_t removePrefix(const std::string& prefix);
+
+  /** \brief write the buffered records and force the journal to disk
+   *  \throws std::runtime_error if the write fails
+   */
+  void sync();
+
+  /** \brief wait for a running compaction to finish
+   *  \throws std::runtime_error if it failed; the journals are then kept
+   */
+  void waitForCompaction();
+
+private:
+  /** \brief the kinds of records in journals */
+  enum RecordType {
+    kAdd = 1,
+    kAddWeighted = 2,
+    kRemove = 3,
+    kRemovePrefix = 4,
+    kClear = 5
+  };
+
+  /** \brief returns the name of the journal with the given generation */
+  std::string journalPath(uint64_t generation) const;
+
+  /** \brief read the snapshot, if any, and return its generation */
+  uint64_t loadSnapshot();
+
+  /** \brief replay the journals from generation on and open the last one for
+   *  appending
+   */
+  void replayJournals(uint64_t generation);
+
+  /** \brief append a record to out, its checksum first */
+  static void encodeRecord(std::vector<char>& out, RecordType type, const char* word,
+      size_t length, uint32_t weight);
+
+  /** \brief call func(type, word, length, weight) for each record at the
+   *  start of data, up to the first one that is incomplete or corrupt
+   *  \return the number of bytes taken by the records passed to func
+   */
+  template <typename Func>
+  static size_t forEachRecord(const char* data, size_t length, Func func);
+
+  /** \brief read the snapshot, if any, into words
+   *  \return the generation of the journal that continues from it
+   *  \throws std::runtime_error if the snapshot is corrupt
+   */
+  uint64_t readSnapshot(Lexicon& words) const;
+
+  /** \brief apply the records of the journal with the given generation to
+   *  words, reading it a block at a time
+   *  \throws std::runtime_error if the journal is incomplete or corrupt
+   */
+  void replayJournal(Lexicon& words, uint64_t generation) const;
+
+  /** \brief apply one record read from a journal to words */
+  static void apply(Lexicon& words, RecordType type, const char* word, size_t length,
+      uint32_t weight);
+
+  /** \brief append a record to the buffer, writing it out once it is full */
+  void append(RecordType type, const char* word, size_t length, uint32_t weight);
+
+  /** \brief close the current journal and create the next one */
+  void openNextJournal();
+
+  /** \brief write a snapshot of the words at the start of the journal
+   *  generation, loaded from the snapshot and the journals before it, and
+   *  delete those journals.  Runs on the compaction thread
+   */
+  void writeSnapshot(uint64_t generation);
+
+  /* \brief the words */
+  Lexicon lex_;
+
+  /* \brief the common prefix of the file names */
+  std::string path_;
+
+  /* \brief the journals are compacted at this size; 0 for never */
+  size_t compaction_bytes_;
+
+  /* \brief the journal records are appended to */
+  int journal_fd_;
+
+  /* \brief the generation of that journal */
+  uint64_t generation_;
+
+  /* \brief bytes written to the current journal, its header included */
+  size_t journal_bytes_;
+
+  /* \brief records not yet written */
+  std::vector<char> buffer_;
+
+  /* \brief what opening found */
+  Recovery recovery_;
+
+  /* \brief whether a compaction is running */
+  std::atomic<bool> compacting_;
+
+  /* \brief the running compaction, if any */
+  std::thread compaction_;
+
+  /* \brief set by the compaction thread if it failed */
+  std::exception_ptr compaction_error_;
+};
+
+#endif
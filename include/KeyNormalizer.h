@@ -0,0 +1,113 @@
+#ifndef KEY_NORMALIZER_H_
+#define KEY_NORMALIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/** \brief Maps keys to a normal form, such as lower case, one byte at a time
+ * as they are walked down a tree, so that "Apple" finds "apple" without a
+ * lowered copy of the key.
+ *
+ * There are two modes.  Bytewise normalizers map every byte through a table;
+ * asciiCaseFold() is one, and since it leaves bytes from 0x80 up alone it
+ * keeps UTF-8 intact.  UTF-8 normalizers decode each multi-byte sequence,
+ * fold the code point and encode the result, which may have another length;
+ * bytes that do not form a valid sequence are passed through as they are.
+ * ASCII is still mapped through the table in that mode, so plain ASCII keys
+ * cost the same as with a bytewise normalizer.
+ *
+ * \code
+ *   KeyNormalizer fold = KeyNormalizer::utf8CaseFold();
+ *   fold.normalize("Ünïcode");           // "ünïcode"
+ *   lex.contains("ÜBER", 5, fold);       // with lex holding normalized words
+ * \endcode
+ */
+class KeyNormalizer {
+public:
+  /** \brief maps a Unicode code point to the one it is normalized to */
+  typedef uint32_t (*Folding)(uint32_t codepoint);
+
+  /** \brief create a normalizer that leaves keys as they are */
+  KeyNormalizer();
+
+  /** \brief returns a bytewise normalizer folding 'A' to 'Z' to lower case */
+  static KeyNormalizer asciiCaseFold();
+
+  /** \brief returns a UTF-8 normalizer folding with foldCase() */
+  static KeyNormalizer utf8CaseFold();
+
+  /** \brief returns a UTF-8 normalizer folding with a function of your own
+   *  \param[in] folding maps each code point to its normal form.  Results
+   *  that are not valid code points leave the sequence unchanged
+   *  \throws std::invalid_argument if folding maps an ASCII character to a
+   *  code point outside ASCII
+   */
+  static KeyNormalizer utf8(Folding folding);
+
+  /** \brief simple case folding of ASCII, Latin-1, Latin Extended-A, Greek
+   *  and Cyrillic: upper case letters map to lower case, final sigma to
+   *  sigma and long s to s.  Other code points are returned unchanged
+   */
+  static uint32_t foldCase(uint32_t codepoint);
+
+  /** \brief returns whether keys are decoded as UTF-8 */
+  bool decodesUtf8() const { return folding_ != nullptr; }
+
+  /** \brief returns whether every key is its own normal form */
+  bool isIdentity() const;
+
+  /** \brief call func with each byte of the normal form of a key, in order,
+   *  until it returns false
+   *  \param[in] key the first letter of the key
+   *  \param[in] length the number of letters in the key
+   *  \param[in] func called as func(char), returns whether to go on
+   *  \return false if func stopped the walk
+   */
+  template <typename Func>
+  bool forEachByte(const char* key, size_t length, Func func) const;
+
+  /** \brief returns the normal form of a key */
+  std::string normalize(const std::string& key) const;
+
+  /** \brief returns the normal form of a key held in a buffer */
+  std::string normalize(const char* key, size_t length) const;
+
+private:
+  /** \brief fold the UTF-8 sequence at the start of key, whose first byte is
+   *  0x80 or more
+   *  \param[out] out receives the folded sequence
+   *  \param[out] out_length the number of bytes written to out
+   *  \return the number of bytes of key that were folded
+   */
+  size_t foldSequence(const char* key, size_t length, char* out,
+      size_t& out_length) const;
+
+  /* \brief the normal form of each byte; only ASCII is used in UTF-8 mode */
+  unsigned char byte_map_[256];
+
+  /* \brief the folding of code points, null for bytewise normalizers */
+  Folding folding_;
+};
+
+template <typename Func>
+bool KeyNormalizer::forEachByte(const char* key, size_t length, Func func) const {
+  for (size_t i = 0; i < length;) {
+    unsigned char byte = static_cast<unsigned char>(key[i]);
+    if (byte < 0x80 || !folding_) {
+      if (!func(static_cast<char>(byte_map_[byte])))
+        return false;
+      ++i;
+      continue;
+    }
+    char folded[4];
+    size_t folded_length;
+    i += foldSequence(key + i, length - i, folded, folded_length);
+    for (size_t j = 0; j < folded_length; ++j)
+      if (!func(folded[j]))
+        return false;
+  }
+  return true;
+}
+
+#endif
@@ -5,10 +5,14 @@
 #include <string>
 #include <map>
 #include <set>
-#include <stack>
+#include <vector>
 #include <utility>
 #include <memory>
 #include <functional>
+#include <limits>
+#include <TrieArena.h>
+#include <FrozenLexicon.h>
+#include <KeyNormalizer.h>
  
 /** \brief An interface representing a Lexicon, or a word list.  The class 
  * supports efficient look up operation on words and prefixes.  It is 
@@ -17,7 +21,39 @@
  * \author Mustafa Mohamad
  */
 class Lexicon {
+private:
+  typedef TrieArena::NodeId NodeId;
+
 public:
+  class Cursor;
+
+  /** \brief the position of a word in sorted order.  See idOf() */
+  typedef uint32_t WordId;
+
+  /** \brief returned by idOf for words that are not in the lexicon */
+  static const WordId kNoWord = 0xffffffffu;
+
+  /** \brief the shape and memory footprint of the lexicon.  See stats() */
+  typedef struct Stats {
+    size_t words;
+    size_t nodes;
+    size_t edges;
+    /** \brief depth_histogram[d] is the number of nodes at depth d */
+    std::vector<size_t> depth_histogram;
+    /** \brief fanout_histogram[k] is the number of nodes with k children */
+    std::vector<size_t> fanout_histogram;
+    /** \brief the first of the longest words in sorted order */
+    std::string longest_word;
+    /** \brief the bytes held by the prefix tree, by category */
+    TrieArena::Usage bytes;
+  } Stats;
+
+  /** \brief a word found by fuzzyMatches and its edit distance to the query */
+  typedef struct FuzzyMatch {
+    std::string word;
+    size_t distance;
+  } FuzzyMatch;
+
   Lexicon();
 
   /** \brief Constructor that creates a lexicon from words in an input stream
@@ -34,6 +70,30 @@ public:
    *  \param[in] word the word to be added
    */
   void add(const std::string& word);
+
+  /** \brief add a word held in a buffer.  See add above
+   *  \param[in] word the first letter of the word
+   *  \param[in] length the number of letters in the word
+   */
+  void add(const char* word, size_t length);
+
+  /** \brief add a word with a weight, or change the weight of a word already
+   *  in the lexicon.  Words added without a weight weigh 0.  Weights are used
+   *  by topCompletions() and are not kept by freeze() or save()
+   *  \param[in] word the word to be added
+   *  \param[in] weight the weight of the word, higher ranks first
+   */
+  void add(const std::string& word, uint32_t weight);
+
+  /** \brief add a word held in a buffer with a weight.  See add above */
+  void add(const char* word, size_t length, uint32_t weight);
+
+  /** \brief add("word", 5) would silently take 5 as a length rather than a
+   *  weight, so it does not compile.  Pass a std::string with a weight or a
+   *  size_t length instead
+   */
+  template <size_t N>
+  void add(const char (&word)[N], int weight_or_length) = delete;
   
   /**
    * \brief add words to lexicon from an input stream
@@ -45,6 +105,24 @@ public:
    *  \param[in] filename the name of the file
    */
   void addWordsFromFile (const std::string& filename);
+
+  /** \brief add words stored one per line in an input stream.  Meant for
+   *  large word lists: the input is read in large blocks without allocating
+   *  per line, and each word continues from the nodes it shares with the
+   *  previous word, so sorted input never re-walks the tree from the root.
+   *  When the lexicon is empty and more than one thread is used, the words
+   *  are partitioned by leading byte, the subtrees are built on separate
+   *  threads and then spliced under the root.
+   *  \param[in] input the input stream of words seperated by a new line
+   *  \param[in] num_threads the number of threads to use, 0 for one per core
+   */
+  void bulkLoad (std::istream& input, unsigned num_threads = 0);
+
+  /** \brief add words stored one per line in a file.  See bulkLoad above
+   *  \param[in] filename the name of the file
+   *  \param[in] num_threads the number of threads to use, 0 for one per core
+   */
+  void bulkLoad (const std::string& filename, unsigned num_threads = 0);
   
   /** \brief delete all words from the lexicon */
   void clear(); 
@@ -54,102 +132,560 @@ public:
    */
   bool contains(const std::string& word) const;
 
+  /** \brief returns whether the lexicon contains a word held in a buffer,
+   *  such as a slice of a network buffer.  Does not allocate
+   *  \param[in] word the first letter of the query word
+   *  \param[in] length the number of letters in the query word
+   */
+  bool contains(const char* word, size_t length) const;
+
   /** \brief returns whether the lexicon contains a prefix
    *  \return true if prefix is in lexicon
    */
   bool containsPrefix(const std::string& prefix) const;
 
+  /** \brief returns whether the lexicon contains a prefix held in a buffer.
+   *  Does not allocate
+   *  \param[in] prefix the first letter of the prefix
+   *  \param[in] length the number of letters in the prefix
+   */
+  bool containsPrefix(const char* prefix, size_t length) const;
+
+  /** \brief returns whether the lexicon contains the normal form of a word.
+   *  Meant for a lexicon holding normalized words: the word is normalized
+   *  byte by byte as the tree is walked, without a normalized copy
+   *  \param[in] word the first letter of the query word
+   *  \param[in] length the number of letters in the query word
+   *  \param[in] normalizer the normalizer the words were added through
+   */
+  bool contains(const char* word, size_t length, const KeyNormalizer& normalizer) const;
+
+  /** \brief returns whether the lexicon contains the normal form of a
+   *  prefix.  See contains above
+   */
+  bool containsPrefix(const char* prefix, size_t length,
+      const KeyNormalizer& normalizer) const;
+
+  /** \brief returns a cursor positioned at the empty prefix.  See Cursor */
+  Cursor cursor() const;
+
+  /** \brief look up many words at once.  The lookups advance in lockstep and
+   *  prefetch the nodes they need next, so their cache misses overlap
+   *  \param[in] words the query words
+   *  \param[in] count the number of query words
+   *  \param[out] results results[i] is set to contains(words[i])
+   */
+  void containsBatch(const std::string* words, size_t count, bool* results) const;
+
+  /** \brief look up many words at once.  See containsBatch above
+   *  \return a vector whose i-th entry is contains(words[i])
+   */
+  std::vector<bool> containsBatch(const std::vector<std::string>& words) const;
+
+  /** \brief look up many prefixes at once.  See containsBatch above
+   *  \param[out] results results[i] is set to containsPrefix(prefixes[i])
+   */
+  void containsPrefixBatch(const std::string* prefixes, size_t count,
+      bool* results) const;
+
+  /** \brief look up many prefixes at once.  See containsBatch above
+   *  \return a vector whose i-th entry is containsPrefix(prefixes[i])
+   */
+  std::vector<bool> containsPrefixBatch(const std::vector<std::string>& prefixes) const;
+
+  /** \brief returns the number of words that start with a prefix.  Reads the
+   *  word count cached at the node of the prefix, so it costs a lookup
+   *  \param[in] prefix the prefix, empty for all words
+   */
+  size_t countWithPrefix(const std::string& prefix) const;
+
+  /** \brief replace every token with its id.  See idOf
+   *  \param[in] tokens the words to encode
+   *  \param[in] count the number of tokens
+   *  \param[out] ids ids[i] is set to idOf(tokens[i])
+   */
+  void encode(const std::string* tokens, size_t count, WordId* ids) const;
+
+  /** \brief replace every token with its id.  See idOf
+   *  \return a vector whose i-th entry is idOf(tokens[i])
+   */
+  std::vector<WordId> encode(const std::vector<std::string>& tokens) const;
+
+  /** \brief replace every id with its word.  See wordOf
+   *  \param[in] ids the ids to decode
+   *  \param[in] count the number of ids
+   *  \param[out] words words[i] is set to wordOf(ids[i])
+   *  \throws std::out_of_range if an id is not less than size()
+   */
+  void decode(const WordId* ids, size_t count, std::string* words) const;
+
+  /** \brief replace every id with its word.  See wordOf
+   *  \return a vector whose i-th entry is wordOf(ids[i])
+   */
+  std::vector<std::string> decode(const std::vector<WordId>& ids) const;
+
+  /** \brief find all words within an edit distance of a query, for spelling
+   *  correction.  The search walks the tree carrying one row of the
+   *  Levenshtein table per depth, so words sharing a prefix share its rows,
+   *  and it skips every subtree whose row is already over the limit
+   *  \param[in] query the possibly misspelled word
+   *  \param[in] max_distance the largest number of inserted, deleted or
+   *  substituted letters allowed
+   *  \return the matching words in sorted order with their distances
+   */
+  std::vector<FuzzyMatch> fuzzyMatches(const std::string& query,
+      size_t max_distance) const;
+
+  /** \brief return an immutable copy of the lexicon with shared suffixes.
+   *  See FrozenLexicon for details
+   */
+  FrozenLexicon freeze() const;
+
+  /** \brief returns the id of a word: its position in sorted order, from 0
+   *  to size() - 1.  Ids are dense and computed from the subtree word counts,
+   *  with no table from words to ids.  They stay the same as long as the
+   *  lexicon does not change; adding or removing a word shifts the ids of the
+   *  words after it
+   *  \param[in] word the word to look up
+   *  \return the id, or kNoWord if the word is not in the lexicon
+   */
+  WordId idOf(const std::string& word) const;
+
+  /** \brief keep only the words that are also in other.  The two trees are
+   *  walked in lockstep and branches other does not have are cut off whole,
+   *  without visiting their words.  Weights are kept.  Each branch below the
+   *  root is independent, so they are handled on separate threads
+   *  \param[in] other the words to keep
+   *  \param[in] num_threads the number of threads to use, 0 for one per core
+   */
+  void intersect(const Lexicon& other, unsigned num_threads = 0);
+
+  /** \brief returns the words in both lhs and rhs.  See intersect above */
+  static Lexicon intersect(const Lexicon& lhs, const Lexicon& rhs,
+      unsigned num_threads = 0);
+
   /** \brief returns whether the lexicon contains any words */
   bool isEmpty() const;
 
-  /** \brief apply a function to all words in the lexicon
+  /** \brief map a lexicon image written by save() read-only into memory.  The
+   *  image is queried in place and shared by all processes mapping it.
+   *  See FrozenLexicon::mapFile for details
+   *  \param[in] filename the name of the file
+   *  \throws std::runtime_error if the file is not a valid lexicon image
+   */
+  static FrozenLexicon mapFile(const std::string& filename);
+
+  /** \brief apply a function to all words in the lexicon in sorted order.
+   *  The word passed to func is only valid for the duration of the call.
    *  \param[in] the function to be applied
    */
-  void mapAll(std::function<void (std::string)> func) const;
+  void mapAll(const std::function<void (const std::string&)>& func) const;
+
+  /** \brief apply a function to all words matching a wildcard pattern in
+   *  sorted order, without collecting them first.  '?' matches any one letter
+   *  and '*' any run of letters, including none.  The search branches only
+   *  where a wildcard is live and follows a single edge for literal letters.
+   *  The word passed to func is only valid for the duration of the call.
+   *  \param[in] pattern the pattern, e.g. "c?t" or "pre*ing"
+   *  \param[in] func the function to be applied
+   *  \param[in] min_length the shortest word to report
+   *  \param[in] max_length the longest word to report
+   */
+  void matchPattern(const std::string& pattern,
+      const std::function<void (const std::string&)>& func, size_t min_length = 0,
+      size_t max_length = std::numeric_limits<size_t>::max()) const;
+
+  /** \brief returns the number of words that sort before a word, which is
+   *  its position in sorted order if it is in the lexicon.  Adds up the word
+   *  counts of the siblings left of the path, so it costs O(length x fanout)
+   *  \param[in] word the query word, which need not be in the lexicon
+   */
+  size_t rank(const std::string& word) const;
 
   /** \brief remove a word from the lexicon
    *  \param[in] word the word to be removed
    *  \return true if the word was removed
    */
   bool remove (const std::string& word);
+
+  /** \brief remove a word held in a buffer.  See remove above
+   *  \param[in] word the first letter of the word
+   *  \param[in] length the number of letters in the word
+   */
+  bool remove (const char* word, size_t length);
   
-  /** \brief remove a word from the lexicon
-   *  \param[in] word the word to be removed
-   *  \return true if the word was removed
+  /** \brief remove all words starting with a prefix.  Every node knows how
+   *  many words are below it, so the count comes for free and the subtree is
+   *  released in one non-recursive pass
+   *  \param[in] prefix the prefix of the words to be removed
+   *  \return the number of words removed
+   */
+  size_t removePrefix (const std::string& prefix);
+
+  /** \brief remove all words starting with a prefix held in a buffer.  See
+   *  removePrefix above
+   *  \param[in] prefix the first letter of the prefix
+   *  \param[in] length the number of letters in the prefix
    */
-  bool removePrefix (const std::string& prefix);
+  size_t removePrefix (const char* prefix, size_t length);
+
+  /** \brief save a frozen image of the lexicon that can be loaded with mapFile()
+   *  \param[in] filename the name of the file
+   *  \return true if the file was written
+   */
+  bool save(const std::string& filename) const;
+
+  /** \brief returns the word at a position in sorted order, the inverse of
+   *  rank().  Descends into the child whose word counts cover the position,
+   *  so it costs O(length x fanout)
+   *  \param[in] index the position, from 0
+   *  \throws std::out_of_range if index is not less than size()
+   */
+  std::string select(size_t index) const;
 
   /** \brief returns number of words in lexicon */
   size_t size() const;
 
+  /** \brief return the words with the highest weights that start with a
+   *  prefix.  Every node knows the highest weight below it, so the search
+   *  expands the most promising nodes first and visits roughly k paths
+   *  instead of the whole subtree
+   *  \param[in] prefix the prefix typed so far
+   *  \param[in] k the maximum number of words to return
+   *  \return up to k words by descending weight, equal weights in sorted order
+   */
+  std::vector<std::string> topCompletions(const std::string& prefix, size_t k) const;
+
+  /** \brief returns node and edge counts, depth and fan-out histograms, the
+   *  longest word and a breakdown of the memory used.  Walks the whole tree
+   */
+  Stats stats() const;
+
+  /** \brief remove the words that are in other.  The two trees are walked in
+   *  lockstep only where other has nodes, so branches other does not have
+   *  are kept as they are.  See intersect for threads
+   *  \param[in] other the words to remove
+   *  \param[in] num_threads the number of threads to use, 0 for one per core
+   */
+  void subtract(const Lexicon& other, unsigned num_threads = 0);
+
+  /** \brief returns the words in lhs but not in rhs.  See subtract above */
+  static Lexicon subtract(const Lexicon& lhs, const Lexicon& rhs,
+      unsigned num_threads = 0);
+
   /** \brief return an stl set of all words in lexicon in sorted order */
   std::set<std::string> toSTLSet();
 
   /** \brief return a comma-separated string of all words in lexicon */
   std::string toString() const;
 
+  /** \brief add all words of other.  Branches only other has are copied node
+   *  by node, without building their words.  Words in both keep their weight
+   *  here, words only in other bring theirs.  See intersect for threads
+   *  \param[in] other the words to add
+   *  \param[in] num_threads the number of threads to use, 0 for one per core
+   */
+  void unite(const Lexicon& other, unsigned num_threads = 0);
+
+  /** \brief returns the words in lhs or rhs.  See unite above */
+  static Lexicon unite(const Lexicon& lhs, const Lexicon& rhs,
+      unsigned num_threads = 0);
+
+  /** \brief returns the weight of a word, or 0 if it is not in the lexicon */
+  uint32_t weight(const std::string& word) const;
+
+  /** \brief returns the word with an id, the inverse of idOf.  Same as select
+   *  \throws std::out_of_range if id is not less than size()
+   */
+  std::string wordOf(WordId id) const;
+
+  /** \brief return the words from lo up to but not including hi in sorted
+   *  order.  The walk starts at lo instead of at the first word, and stops at
+   *  hi.  To page through the words under a prefix, pass select() of the
+   *  page boundaries:
+   *  \code
+   *    size_t first = lex.rank("inter");
+   *    lex.wordsBetween(lex.select(first + 5000), lex.select(first + 5100));
+   *  \endcode
+   *  \param[in] lo the first word of the range, which need not be in the lexicon
+   *  \param[in] hi the end of the range, which need not be in the lexicon
+   */
+  std::vector<std::string> wordsBetween(const std::string& lo, const std::string& hi) const;
+
   friend std::ostream& operator <<(std::ostream& os, const Lexicon& lex);
 
+  /* \brief compiles the prefix tree into its automaton */
+  friend class LexiconScanner;
+
+  /* \brief copies the prefix tree into its succinct form */
+  friend class SuccinctLexicon;
+
+  /* \brief copies the prefix tree over its own alphabet */
+  friend class DenseLexicon;
+
+  /* \brief saves and restores the prefix tree as a snapshot */
+  friend class JournaledLexicon;
+
 private:
-  /** \brief the node of the prefix tree. */
-  typedef struct TrieNode {
-    bool isWord;
-    std::map<char,std::unique_ptr<TrieNode>> suffixes;
-  } TrieNode;
-  
-  typedef std::map<char, std::unique_ptr<TrieNode>> SuffixesT;
-  typedef SuffixesT::iterator SuffixesTItr;
-  typedef SuffixesT::const_iterator SuffixesTConstItr;
+  /** \brief the set operations shared by unite, intersect and subtract */
+  enum SetOperation { kUnite, kIntersect, kSubtract };
 
-  /** \brief a type used to populate an explicit stack for the removeSubtree recursive
-   * function.  It captures the current node being processed, which suffix in that node
-   * is currently being processed, and the prefix formed so far by the current traversal
-   * path
+  /** \brief a type used to populate the explicit stack of walkWords.  It
+   * captures the node being processed and which of its children is visited next
    */
   typedef struct StackElement {
-    TrieNode* node;
-    std::string prefix;
-    SuffixesTItr suffix;
+    NodeId node;
+    size_t next_child;
   } StackElement;
 
-  /** \brief return the TrieNode whose path forms the input string if found
+  /** \brief return the node whose path forms the input string if found
    *  \param[in] str the input string
-   *  \return pointer to TrieNode or nullptr if not found
+   *  \param[in] length the number of letters in str
+   *  \return index of the node or TrieArena::kNoNode if not found
+   */
+  NodeId findNode(const char* str, size_t length) const;
+
+  /** \brief return the node whose path forms the normal form of the input
+   *  string if found.  See findNode above
    */
-  const TrieNode* findNode(const std::string& str) const;
+  NodeId findNode(const char* str, size_t length, const KeyNormalizer& normalizer) const;
   
  
-  /** \brief Helper function for removePrefix
-   *  \param[in] prefix the word or prefix to be removed
-   *  \param[in] prefix_index the position of the letter currently being processed
-   *  \param[in] curr the current TrieNode being processed
-   *  \param[in] is_prefix whether the input prefix is a complete word or just a prefix
-   *  \return whether the prefix was successfully removed
+  /** \brief Shared implementation of rank and idOf
+   *  \param[in] word the query word
+   *  \param[in] length the number of letters in word
+   *  \param[out] found set to whether word is in the lexicon
+   *  \return the number of words that sort before word
+   */
+  size_t countBefore(const char* word, size_t length, bool& found) const;
+
+  /** \brief Shared implementation of containsBatch and containsPrefixBatch
+   *  \param[in] keys the query strings
+   *  \param[in] count the number of query strings
+   *  \param[out] results the result of each lookup
+   *  \param[in] whole_word whether a key must end at a word or just a node
+   */
+  void lookupBatch(const std::string* keys, size_t count, bool* results,
+      bool whole_word) const;
+
+  /** \brief set path_ to the nodes along the path of a key, root first
+   *  \param[in] key the word or prefix
+   *  \param[in] length the number of letters in key
+   *  \return false if the key leaves the tree, in which case path_ ends at
+   *  the last node found
    */
-  bool removePrefixHelper(const std::string& prefix, int prefix_index, 
-     TrieNode* curr, bool is_prefix);
+  bool findPath(const char* key, size_t length);
 
-  /** \brief Remove a substree from the prefix tree
-   *  \param[in] delete_stack_ptr the explicit recursion stack.  See StackElement for
-   *  more details
+  /** \brief take words off the word counts of the nodes along path_ and cut
+   *  off the highest node left without words, with everything below it
+   *  \param[in] key the key path_ was built from
+   *  \param[in] count the number of words removed at the end of path_
    */
-  void removeSubtree(std::stack<StackElement>* delete_stack_ptr);
+  void uncountWords(const char* key, size_t count);
+
+  /** \brief Apply a function to every word in a subtree in sorted order.  The
+   *  walk is not recursive and builds all words in the single prefix buffer.
+   *  \param[in] node the root of the subtree
+   *  \param[in,out] prefix the string formed by the path to node.  It is
+   *  restored to its original contents when the walk finishes
+   *  \param[in] func the function to be applied to each word
+   */
+  template <typename Func>
+  void walkWords(NodeId node, std::string& prefix, Func func) const;
   
+  /** \brief add a word, starting from the nodes it shares with the previous
+   *  word added through the same path and previous buffers
+   *  \param[in] word the first letter of the word
+   *  \param[in] length the number of letters in the word
+   *  \param[in,out] path path[i] is the node reached by the first i letters of
+   *  previous.  It holds only the root before the first word
+   *  \param[in,out] previous the previously added word
+   */
+  void addAlongPath(const char* word, size_t length, std::vector<NodeId>& path,
+      std::string& previous);
+
+  /** \brief build the empty lexicon from an in-memory word list on several
+   *  threads, one group of leading bytes per thread
+   *  \param[in] text the words seperated by a new line
+   *  \param[in] num_threads the number of threads to use
+   */
+  void parallelLoad(const std::vector<char>& text, unsigned num_threads);
+
+  /** \brief Shared implementation of unite, intersect and subtract.  The
+   *  branches below the root that both trees have, or that only other has
+   *  when uniting, are combined on separate threads in private lexicons and
+   *  spliced back in
+   *  \param[in] other the right hand side of the operation
+   *  \param[in] operation the set operation
+   *  \param[in] num_threads the number of threads to use, 0 for one per core
+   */
+  void combine(const Lexicon& other, SetOperation operation, unsigned num_threads);
+
+  /** \brief a change to the shape of the tree that combineBranch leaves to
+   *  the caller: cut off the child of node reached by label, or, if other
+   *  is not kNoNode, copy the subtree of other there
+   */
+  typedef struct DeferredEdit {
+    NodeId node;
+    char label;
+    NodeId other;
+  } DeferredEdit;
+
+  /** \brief apply a set operation to the subtree of node, walking it in
+   *  lockstep with the subtree of other_node in other.  Word counts and
+   *  weight bounds in the subtree are brought up to date and emptied nodes
+   *  below node are cut off; node itself is left to the caller
+   *  \param[out] deferred if not null, nodes are neither added nor released,
+   *  so that several threads can work on disjoint branches of the tree.  The
+   *  cuts and copies are appended here instead, in an order they can be
+   *  applied in, and the counts already include them
+   *  \return the number of words left in the subtree of node
+   */
+  size_t combineBranch(NodeId node, const TrieArena& other, NodeId other_node,
+      SetOperation operation, std::vector<DeferredEdit>* deferred = nullptr);
+
+  /** \brief set the word flag of node to the result of a set operation on
+   *  it and the flag of other_node in other.  A word brought in from other
+   *  brings its weight
+   */
+  void combineWord(NodeId node, const TrieArena& other, NodeId other_node,
+      SetOperation operation);
+
+  /** \brief copy the subtree of source_node in source below node, through an
+   *  edge labelled label that node must not have yet.  Word flags, counts and
+   *  weights are copied as they are
+   */
+  void copyBranch(NodeId node, char label, const TrieArena& source, NodeId source_node);
+
+  /** \brief recompute the word count and weight bound of node from its word
+   *  and its children
+   *  \return the word count of node
+   */
+  size_t recount(NodeId node);
+
+  /** \brief recompute the highest weight below each node on the path of
+   *  key, bottom up, after a word on or below that path changed.  Stops early
+   *  once a node's value is unchanged.  Weights must be enabled
+   *  \param[in] key the word or prefix that was changed
+   *  \param[in] length the number of letters in key
+   */
+  void updateMaxWeights(const char* key, size_t length);
+
   /** \brief Check whether there is a path in the prefix tree that forms the input 
    *  string. This method creates new nodes to form this path if they don't exist
+   *  and leaves the nodes of the path in path_
    *  \param[in] str the input string
-   *  \return A pointer to the TrieNode at the end of the path forming str
+   *  \param[in] length the number of letters in str
+   *  \return the index of the node at the end of the path forming str
    */
-  TrieNode* ensureNodeExists(const std::string& str);
+  NodeId ensureNodeExists(const char* str, size_t length);
 
-  /* \brief the root of the prefix tree */ 
-  std::unique_ptr<TrieNode> root_;
+  /* \brief the nodes of the prefix tree */
+  TrieArena trie_;
 
   /* \brief number of words in the lexicon */
-  int size_;
+  size_t size_;
 
-  /* \brief a set of all valid words in the lexicon */ 
-  std::set<std::string> word_set_;
+  /* \brief scratch path reused by add, remove and updateMaxWeights */
+  std::vector<NodeId> path_;
 };
+
+/** \brief A position in the prefix tree of a Lexicon, for searches that
+ * extend a prefix one letter at a time (grid word games, streaming
+ * tokenizers).  Each step costs O(1) instead of re-walking the whole prefix
+ * like containsPrefix does.  The cursor keeps the path it took, so it can back
+ * up as well.  A cursor must not be used after the Lexicon is modified.
+ *
+ * \code
+ *   Lexicon::Cursor cursor = lex.cursor();
+ *   if (cursor.advance('c')) {
+ *     for (char next : cursor.children()) ...
+ *     cursor.back();
+ *   }
+ * \endcode
+ */
+class Lexicon::Cursor {
+public:
+  /** \brief the letters that can follow the current position, in ascending
+   * order.  Like the cursor, it must not be used after the Lexicon is modified
+   */
+  typedef struct Children {
+    const char* first;
+    const char* last;
+    const char* begin() const { return first; }
+    const char* end() const { return last; }
+    size_t size() const { return last - first; }
+  } Children;
+
+  /** \brief move to the prefix extended by letter
+   *  \return false if no word continues with letter, in which case the cursor
+   *  does not move
+   */
+  bool advance(char letter) {
+    NodeId next = trie_->child(path_.back(), letter);
+    if (next == TrieArena::kNoNode)
+      return false;
+    path_.push_back(next);
+    return true;
+  }
+
+  /** \brief move back to the prefix without its last letter
+   *  \return false if the cursor is at the empty prefix
+   */
+  bool back() {
+    if (path_.size() == 1)
+      return false;
+    path_.pop_back();
+    return true;
+  }
+
+  /** \brief returns whether the current prefix is a word */
+  bool isWord() const { return trie_->isWord(path_.back()); }
+
+  /** \brief returns whether some word is longer than the current prefix */
+  bool hasChildren() const { return !trie_->isLeaf(path_.back()); }
+
+  /** \brief returns the letters that can follow the current prefix */
+  Children children() const {
+    const char* labels = trie_->labels(path_.back());
+    return Children{labels, labels + trie_->numChildren(path_.back())};
+  }
+
+  /** \brief returns the length of the current prefix */
+  size_t depth() const { return path_.size() - 1; }
+
+private:
+  friend class Lexicon;
+  explicit Cursor(const TrieArena* trie) : trie_(trie), path_(1, trie->root()) {}
+
+  const TrieArena* trie_;
+  std::vector<NodeId> path_;
+};
+
+template <typename Func>
+void Lexicon::walkWords(NodeId node, std::string& prefix, Func func) const {
+  size_t base_length = prefix.size();
+  if (trie_.isWord(node))
+    func(static_cast<const std::string&>(prefix));
+
+  std::vector<StackElement> walk_stack;
+  walk_stack.push_back({node, 0});
+  while (!walk_stack.empty()) {
+    StackElement& top = walk_stack.back();
+    /* all children visited: move back up and drop this node's letter */
+    if (top.next_child == trie_.numChildren(top.node)) {
+      walk_stack.pop_back();
+      if (prefix.size() > base_length)
+        prefix.pop_back();
+      continue;
+    }
+    NodeId child = trie_.children(top.node)[top.next_child];
+    prefix.push_back(trie_.labels(top.node)[top.next_child]);
+    ++top.next_child;
+    if (trie_.isWord(child))
+      func(static_cast<const std::string&>(prefix));
+    walk_stack.push_back({child, 0});
+  }
+}
  
 #endif
@@ -0,0 +1,51 @@
+#ifndef LEXICON_COUNTERS_H_
+#define LEXICON_COUNTERS_H_
+
+#include <atomic>
+#include <cstdint>
+
+/** \brief Process-wide counts of hot-path events, for sizing and for
+ * confirming the effect of layout changes.
+ *
+ * Counting is compiled in only when LEXICON_ENABLE_COUNTERS is defined (cmake
+ * -DLEXICON_ENABLE_COUNTERS=ON).  Otherwise LEXICON_COUNT expands to nothing,
+ * so the hot paths are exactly as without counters, and every count reads 0.
+ * Build the whole program with the same setting.
+ */
+class LexiconCounters {
+public:
+  enum Counter {
+    kLookups,           /**< contains, containsPrefix and batched keys */
+    kNodeVisits,        /**< steps from a node to one of its children */
+    kNodeAllocations,   /**< nodes taken by the arena */
+    kBlockAllocations,  /**< child blocks taken by the arena */
+    kRemovals,          /**< successful remove and removePrefix calls */
+    kNodesReleased,     /**< nodes given back by removals */
+    kNumCounters
+  };
+
+  /** \brief whether counting was compiled in */
+  static const bool kEnabled;
+
+  /** \brief returns the current value of a counter */
+  static uint64_t get(Counter counter) { return counts_[counter].load(); }
+
+  /** \brief set all counters to 0 */
+  static void reset();
+
+  /** \brief add n to a counter.  Use LEXICON_COUNT instead */
+  static void add(Counter counter, uint64_t n) {
+    counts_[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+
+private:
+  static std::atomic<uint64_t> counts_[kNumCounters];
+};
+
+#if defined(LEXICON_ENABLE_COUNTERS)
+#define LEXICON_COUNT(counter, n) LexiconCounters::add(LexiconCounters::counter, (n))
+#else
+#define LEXICON_COUNT(counter, n) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef LEXICON_SCANNER_H_
+#define LEXICON_SCANNER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class Lexicon;
+
+/** \brief Finds every occurrence of every word of a Lexicon in a text in a
+ * single pass (Aho-Corasick).
+ *
+ * The prefix tree of the lexicon is compiled into a deterministic automaton:
+ * each state is a prefix, failure links are folded into a complete transition
+ * table, and each state links to the longest word that ends there.  Bytes
+ * that appear in no word share one column of the table, so it has one column
+ * per distinct letter plus one.  Scanning costs one table load per byte,
+ * however many words match.
+ *
+ * The scanner is a compiled copy: later changes to the Lexicon do not affect
+ * it.  The empty word is never reported.
+ *
+ * \code
+ *   LexiconScanner scanner(lex);
+ *   scanner.scan(text, length, [](size_t pos, size_t len) { ... });
+ *
+ *   LexiconScanner::Stream stream(scanner);
+ *   while (read a chunk)
+ *     stream.scan(chunk, chunk_length, on_match);
+ * \endcode
+ */
+class LexiconScanner {
+public:
+  class Stream;
+
+  /** \brief called with the offset and length of each occurrence */
+  typedef std::function<void (size_t pos, size_t length)> MatchFunc;
+
+  /** \brief compile the words of lex
+   *  \throws std::length_error if the automaton would exceed 2^31 entries
+   */
+  explicit LexiconScanner(const Lexicon& lex);
+
+  /** \brief report every occurrence of a word in a buffer.  Occurrences are
+   *  reported by ascending end, longer words first when several end at once
+   *  \param[in] data the text
+   *  \param[in] length the number of bytes in data
+   *  \param[in] func called with the offset into data and the length of
+   *  each occurrence
+   */
+  void scan(const char* data, size_t length, const MatchFunc& func) const;
+
+  /** \brief returns the number of states of the automaton */
+  size_t numStates() const { return word_lengths_.size(); }
+
+  /** \brief returns the number of bytes used by the automaton */
+  size_t memoryUsage() const;
+
+private:
+  /** \brief a transition with this bit set enters a state where a word ends */
+  static const uint32_t kMatchBit = 0x80000000u;
+
+  /** \brief marks the end of a chain of output links */
+  static const uint32_t kNoState = 0xffffffffu;
+
+  /** \brief run the automaton from state over data, reporting occurrences
+   *  with offsets relative to base
+   *  \return the state after the last byte
+   */
+  uint32_t run(uint32_t state, const char* data, size_t length, size_t base,
+      const MatchFunc& func) const;
+
+  /** \brief report the words ending in state at position end of the text */
+  void report(uint32_t state, size_t end, const MatchFunc& func) const;
+
+  /* \brief the column of each byte value */
+  uint8_t byte_classes_[256];
+  size_t num_classes_;
+
+  /* \brief transitions_[s * num_classes_ + c] is the target of state s on
+   * class c, stored pre-multiplied by num_classes_ and tagged with kMatchBit */
+  std::vector<uint32_t> transitions_;
+
+  /* \brief the length of the word ending at each state, or 0 */
+  std::vector<uint32_t> word_lengths_;
+
+  /* \brief the next shorter state on the failure chain that ends a word */
+  std::vector<uint32_t> output_links_;
+};
+
+/** \brief scans a text that arrives in chunks.  Occurrences that straddle
+ * chunk boundaries are found, and positions count from the start of the
+ * first chunk.
+ */
+class LexiconScanner::Stream {
+public:
+  /** \brief start a text.  The scanner must outlive the stream */
+  explicit Stream(const LexiconScanner& scanner);
+
+  /** \brief continue the text with the next chunk
+   *  \param[in] data the chunk
+   *  \param[in] length the number of bytes in the chunk
+   *  \param[in] func called with the offset from the start of the text and
+   *  the length of each occurrence that ends in this chunk
+   */
+  void scan(const char* data, size_t length, const MatchFunc& func);
+
+  /** \brief start over with a new text */
+  void reset();
+
+  /** \brief returns the number of bytes scanned since the start of the text */
+  size_t position() const { return position_; }
+
+private:
+  const LexiconScanner* scanner_;
+  uint32_t state_;
+  size_t position_;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef RADIX_LEXICON_H_
+#define RADIX_LEXICON_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+#include <TrieArena.h>
+
+/** \brief A word list stored as a path-compressed prefix tree (also referred
+ * to as a radix tree or Patricia trie), for long keys such as URL paths or
+ * qualified identifiers.
+ *
+ * Lexicon spends one node per letter, so a 200-byte key that shares nothing
+ * with its neighbours costs 200 nodes and 200 dependent loads per lookup.
+ * Here every chain of nodes with a single child and no word collapses into
+ * one edge that carries a whole string.  The branching structure lives in a
+ * TrieArena keyed by the first letter of each edge; the rest of the edge, its
+ * tail, is a slice of one shared byte pool and is compared with memcmp.  Only
+ * the root may have fewer than two children without ending a word, so a
+ * lexicon of n words has fewer than 2n nodes however long the words are.
+ *
+ * Adding a word splits at most one edge and removing one merges at most one.
+ * Removed tails leave garbage in the pool, which is compacted once it
+ * outgrows the live bytes.  RadixLexicon answers the same membership queries
+ * as Lexicon.
+ */
+class RadixLexicon {
+private:
+  typedef TrieArena::NodeId NodeId;
+
+public:
+  RadixLexicon();
+
+  /** \brief add a word to the lexicon
+   *  \param[in] word the word to be added
+   *  \throws std::length_error if the live tails would exceed 4 GiB
+   */
+  void add(const std::string& word);
+
+  /** \brief add a word held in a buffer.  See add above
+   *  \param[in] word the first letter of the word
+   *  \param[in] length the number of letters in the word
+   */
+  void add(const char* word, size_t length);
+
+  /** \brief delete all words from the lexicon */
+  void clear();
+
+  /** \brief returns whether the lexicon contains a word
+   *  \param[in] word the query word
+   */
+  bool contains(const std::string& word) const;
+
+  /** \brief returns whether the lexicon contains a word held in a buffer.
+   *  Does not allocate
+   *  \param[in] word the first letter of the query word
+   *  \param[in] length the number of letters in the query word
+   */
+  bool contains(const char* word, size_t length) const;
+
+  /** \brief returns whether the lexicon contains a prefix
+   *  \return true if prefix is in lexicon
+   */
+  bool containsPrefix(const std::string& prefix) const;
+
+  /** \brief returns whether the lexicon contains a prefix held in a buffer.
+   *  Does not allocate
+   *  \param[in] prefix the first letter of the prefix
+   *  \param[in] length the number of letters in the prefix
+   */
+  bool containsPrefix(const char* prefix, size_t length) const;
+
+  /** \brief returns whether the lexicon contains any words */
+  bool isEmpty() const;
+
+  /** \brief apply a function to all words in the lexicon in sorted order.
+   *  The word passed to func is only valid for the duration of the call.
+   *  \param[in] the function to be applied
+   */
+  void mapAll(const std::function<void (const std::string&)>& func) const;
+
+  /** \brief returns the number of bytes used by the nodes and tails */
+  size_t memoryUsage() const;
+
+  /** \brief returns the number of nodes, including the root */
+  size_t nodeCount() const { return trie_.nodeCount(); }
+
+  /** \brief remove a word from the lexicon
+   *  \param[in] word the word to be removed
+   *  \return true if the word was removed
+   *  \throws std::length_error if merging two edges would take the live
+   *  tails past 4 GiB
+   */
+  bool remove(const std::string& word);
+
+  /** \brief remove a word held in a buffer.  See remove above */
+  bool remove(const char* word, size_t length);
+
+  /** \brief remove all words starting with a prefix
+   *  \param[in] prefix the prefix of the words to be removed
+   *  \return the number of words removed
+   *  \throws std::length_error as remove above
+   */
+  size_t removePrefix(const std::string& prefix);
+
+  /** \brief remove all words starting with a prefix held in a buffer.  See
+   *  removePrefix above
+   */
+  size_t removePrefix(const char* prefix, size_t length);
+
+  /** \brief returns number of words in lexicon */
+  size_t size() const { return size_; }
+
+  /** \brief return an stl set of all words in lexicon in sorted order */
+  std::set<std::string> toSTLSet() const;
+
+private:
+  /** \brief the letters of an edge after the first one, which is the label of
+   * the edge in the arena.  They are tail_bytes_[offset, offset + length)
+   */
+  typedef struct Tail {
+    uint32_t offset;
+    uint32_t length;
+  } Tail;
+
+  /** \brief a node on the path of a key and the position of the first
+   * letter of its edge in the key
+   */
+  typedef struct PathElement {
+    NodeId node;
+    size_t begin;
+  } PathElement;
+
+  /** \brief the node a lookup stops at and how far into its edge it got */
+  typedef struct Position {
+    NodeId node;
+    size_t unmatched;
+  } Position;
+
+  /** \brief follow key from the root
+   *  \param[in] key the word or prefix
+   *  \param[in] length the number of letters in key
+   *  \param[out] path if not null, set to the nodes passed, root first
+   *  \return the node whose edge key ends on, with the number of letters of
+   *  that edge beyond the end of key, or kNoNode if key leaves the tree
+   */
+  Position locate(const char* key, size_t length,
+      std::vector<PathElement>* path) const;
+
+  /** \brief copy letters to the end of the pool and return their tail */
+  Tail appendTail(const char* letters, size_t length);
+
+  /** \brief make room for length more bytes at the end of the pool,
+   *  compacting it if the garbage is all that stands in the way
+   *  \throws std::length_error if the live tails would exceed 4 GiB
+   */
+  void reserveTails(size_t length);
+
+  /** \brief store the tail of node, which may have just been allocated */
+  void setTail(NodeId node, Tail tail);
+
+  /** \brief restore path compression at the end of path_, after the node
+   *  there lost its word or a child.  key is the key path_ was built from
+   */
+  void compressPath(const char* key);
+
+  /** \brief merge the child of node reached by label, which has a single
+   *  child and no word, into the edge to that grandchild
+   */
+  void mergeChild(NodeId node, char label);
+
+  /** \brief returns the number of tail bytes below node, its own included */
+  size_t subtreeTailBytes(NodeId node) const;
+
+  /** \brief rewrite the pool with only the tails of the nodes in the tree,
+   *  once removals have left more garbage than live bytes
+   */
+  void compactTails();
+
+  /* \brief the branching structure; edges are keyed by their first letter */
+  TrieArena trie_;
+
+  /* \brief tails_[n] is the tail of the edge into node n */
+  std::vector<Tail> tails_;
+
+  /* \brief the pool all tails point into */
+  std::vector<char> tail_bytes_;
+
+  /* \brief bytes of the pool used by nodes in the tree */
+  size_t live_tail_bytes_;
+
+  /* \brief number of words in the lexicon */
+  size_t size_;
+
+  /* \brief scratch path reused by remove and removePrefix */
+  std::vector<PathElement> path_;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SUCCINCT_LEXICON_H_
+#define SUCCINCT_LEXICON_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Lexicon;
+
+/** \brief An immutable copy of a Lexicon in a level-order unary degree
+ * sequence (LOUDS), for very large word lists on small devices.
+ *
+ * The nodes of the prefix tree are numbered breadth first.  The topology is a
+ * single bit string: a 1 for the edge into the root, then for every node in
+ * order as many 1s as it has children followed by a 0.  The children of a
+ * node are therefore consecutive numbers, found from the position of the
+ * node's 0 in the bit string; a sample of every 256th 0 makes that select a
+ * short scan.  Next to the topology there is one label byte and one word bit
+ * per node, so a node costs 2 bits of topology plus about 0.125 bits of
+ * samples, 8 bits of label and 1 bit for the word flag.
+ *
+ * \code
+ *   SuccinctLexicon compact(lex);
+ *   compact.contains("word");
+ * \endcode
+ */
+class SuccinctLexicon {
+public:
+  /** \brief copy the words of lex
+   *  \throws std::length_error if the tree has 2^31 nodes or more
+   */
+  explicit SuccinctLexicon(const Lexicon& lex);
+
+  /** \brief returns whether the lexicon contains a word */
+  bool contains(const std::string& word) const;
+
+  /** \brief returns whether the lexicon contains a word held in a buffer */
+  bool contains(const char* word, size_t length) const;
+
+  /** \brief returns whether the lexicon contains a prefix */
+  bool containsPrefix(const std::string& prefix) const;
+
+  /** \brief returns whether the lexicon contains a prefix held in a buffer */
+  bool containsPrefix(const char* prefix, size_t length) const;
+
+  /** \brief returns whether the lexicon contains any words */
+  bool isEmpty() const { return size_ == 0; }
+
+  /** \brief apply a function to all words in the lexicon in sorted order.
+   *  The word passed to func is only valid for the duration of the call.
+   *  \param[in] the function to be applied
+   */
+  void mapAll(const std::function<void (const std::string&)>& func) const;
+
+  /** \brief returns the number of bytes used by the bit strings and labels */
+  size_t memoryUsage() const;
+
+  /** \brief returns the number of nodes, including the root */
+  size_t nodeCount() const { return labels_.size(); }
+
+  /** \brief returns number of words in lexicon */
+  size_t size() const { return size_; }
+
+private:
+  /** \brief every kSelectSample-th 0 of the topology has its position stored */
+  static const size_t kSelectSample = 256;
+
+  /** \brief returned by findNode when a key leaves the tree */
+  static const uint32_t kNoNode = 0xffffffffu;
+
+  /** \brief the children of a node are the nodes [first, first + count) */
+  typedef struct Children {
+    uint32_t first;
+    uint32_t count;
+  } Children;
+
+  /** \brief returns the position of the 0 with the given index in louds_ */
+  size_t selectZero(size_t index) const;
+
+  /** \brief returns the children of node */
+  Children children(uint32_t node) const;
+
+  /** \brief returns the node reached by key from the root, or kNoNode */
+  uint32_t findNode(const char* key, size_t length) const;
+
+  /** \brief returns whether node ends a word */
+  bool isWord(uint32_t node) const { return (words_[node >> 6] >> (node & 63)) & 1; }
+
+  /* \brief the topology, bit i is bit i % 64 of word i / 64 */
+  std::vector<uint64_t> louds_;
+
+  /* \brief select_samples_[i] is the position of 0 number i * kSelectSample */
+  std::vector<uint32_t> select_samples_;
+
+  /* \brief the label of the edge into each node; the root has none */
+  std::vector<char> labels_;
+
+  /* \brief the word flag of each node */
+  std::vector<uint64_t> words_;
+
+  /* \brief number of words */
+  size_t size_;
+};
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef TRIE_ARENA_H_
+#define TRIE_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <LexiconCounters.h>
+
+#if defined(__GNUC__)
+#define TRIE_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define TRIE_PREFETCH(address) ((void)(address))
+#endif
+
+/** \brief Node storage engine for the Lexicon prefix tree.
+ *
+ * All nodes live in one contiguous array and are addressed by 32-bit indices
+ * instead of pointers.  The children of a node are stored as a sorted array of
+ * labels plus a parallel array of child indices.  Both arrays are carved out
+ * of two shared pools in power-of-two sized blocks, so a node with k children
+ * costs one block of capacity <= 2k rather than k separately allocated map
+ * nodes.  Released nodes and blocks are recycled through free lists.
+ *
+ * Labels are kept in ascending unsigned-byte order, which is the order
+ * std::string compares in, so an in-order walk of the tree yields words in
+ * sorted order.
+ *
+ * Node indices stay valid across insertions, but any pointer returned by
+ * labels() or children() is invalidated by the next addChild/removeChild.
+ *
+ * Every node has room for the number of words in its subtree, so that the
+ * size of a subtree is known without walking it.  Like the weights below,
+ * the arena only stores the counts and zeroes them for new nodes; keeping
+ * them right is up to the user.
+ *
+ * Optionally every node also carries two weights: the weight of the word it
+ * ends and a bound on the weights below it.  The arena only stores them and
+ * zeroes them for new nodes; keeping the bounds meaningful is up to the user.
+ */
+class TrieArena {
+public:
+  typedef uint32_t NodeId;
+
+  /** \brief where the bytes reported by memoryUsage() go.  The fields add up
+   * to memoryUsage()
+   */
+  typedef struct Usage {
+    size_t nodes;         /**< records of the nodes in the tree */
+    size_t free_nodes;    /**< released records waiting to be reused */
+    size_t edges;         /**< labels and child indices in use */
+    size_t block_slack;   /**< unused slots in the blocks of nodes in the tree */
+    size_t free_blocks;   /**< released blocks waiting to be reused */
+    size_t weights;       /**< node weights, if enabled */
+    size_t reserved;      /**< capacity of the arrays beyond their size */
+    size_t total() const {
+      return nodes + free_nodes + edges + block_slack + free_blocks + weights + reserved;
+    }
+  } Usage;
+
+  /** \brief sentinel returned when a node has no child with a given label */
+  static const NodeId kNoNode = 0xffffffffu;
+
+  /** \brief create an arena holding only an empty root node */
+  TrieArena();
+
+  /** \brief the root node, which always exists */
+  NodeId root() const { return 0; }
+
+  /** \brief returns whether the path to node spells a word */
+  bool isWord(NodeId node) const { return nodes_[node].is_word; }
+
+  /** \brief mark or unmark node as the end of a word */
+  void setWord(NodeId node, bool is_word) { nodes_[node].is_word = is_word; }
+
+  /** \brief returns the number of words stored for the subtree of node */
+  uint32_t wordCount(NodeId node) const { return nodes_[node].words; }
+
+  /** \brief store the number of words in the subtree of node */
+  void setWordCount(NodeId node, uint32_t count) { nodes_[node].words = count; }
+
+  /** \brief returns whether nodes carry weights.  See enableWeights() */
+  bool hasWeights() const { return !weights_.empty(); }
+
+  /** \brief start storing weights for all nodes, initially 0.  They stay on
+   *  until clear() and cost 8 bytes per node
+   */
+  void enableWeights();
+
+  /** \brief returns the weight stored for the word at node, 0 if disabled */
+  uint32_t weight(NodeId node) const {
+    return weights_.empty() ? 0 : weights_[node].word;
+  }
+
+  /** \brief store the weight of the word at node.  Weights must be enabled */
+  void setWeight(NodeId node, uint32_t weight) { weights_[node].word = weight; }
+
+  /** \brief returns the weight bound stored for the subtree of node, 0 if
+   *  disabled
+   */
+  uint32_t maxWeight(NodeId node) const {
+    return weights_.empty() ? 0 : weights_[node].subtree;
+  }
+
+  /** \brief store the weight bound of the subtree of node.  Weights must be
+   *  enabled
+   */
+  void setMaxWeight(NodeId node, uint32_t weight) { weights_[node].subtree = weight; }
+
+  /** \brief returns the number of children of node */
+  size_t numChildren(NodeId node) const { return nodes_[node].num_edges; }
+
+  /** \brief returns whether node has no children */
+  bool isLeaf(NodeId node) const { return nodes_[node].num_edges == 0; }
+
+  /** \brief the labels of the children of node in ascending order */
+  const char* labels(NodeId node) const {
+    return labels_.data() + nodes_[node].edges;
+  }
+
+  /** \brief the children of node, parallel to labels(node) */
+  const NodeId* children(NodeId node) const {
+    return targets_.data() + nodes_[node].edges;
+  }
+
+  /** \brief returns the child of node reached by label, or kNoNode */
+  NodeId child(NodeId node, char label) const {
+    LEXICON_COUNT(kNodeVisits, 1);
+    const Node& n = nodes_[node];
+    const char* base = labels_.data() + n.edges;
+    /* short child arrays are cheaper to scan than to call into memchr */
+    if (n.num_edges <= kLinearScanLimit) {
+      for (uint32_t i = 0; i < n.num_edges; ++i)
+        if (base[i] == label)
+          return targets_[n.edges + i];
+      return kNoNode;
+    }
+    const void* hit = std::memchr(base, label, n.num_edges);
+    return hit ? targets_[n.edges + (static_cast<const char*>(hit) - base)]
+               : kNoNode;
+  }
+
+  /** \brief start loading the record of node into the cache */
+  void prefetchNode(NodeId node) const {
+    TRIE_PREFETCH(nodes_.data() + node);
+  }
+
+  /** \brief start loading the labels and children of node into the cache.
+   *  Reads the record of node, so it pays off after prefetchNode(node)
+   */
+  void prefetchChildren(NodeId node) const {
+    const Node& n = nodes_[node];
+    TRIE_PREFETCH(labels_.data() + n.edges);
+    TRIE_PREFETCH(targets_.data() + n.edges);
+  }
+
+  /** \brief returns the child of node reached by label, creating it if needed
+   *  \param[in] node the parent node
+   *  \param[in] label the label of the edge to the child
+   *  \return the index of the (possibly new) child
+   *  \throws std::length_error if the node or edge indices would run out
+   */
+  NodeId addChild(NodeId node, char label);
+
+  /** \brief detach the child of node reached by label and release the whole
+   *  subtree below it
+   *  \return number of word nodes that were released
+   */
+  size_t removeChild(NodeId node, char label);
+
+  /** \brief insert a new node on the edge from node to its child reached by
+   *  label.  The new node takes the place of the child, and the child hangs
+   *  below it through an edge labelled child_label.  Used to split the edges
+   *  of a path-compressed tree
+   *  \return the index of the new node, or kNoNode if node has no such child
+   *  \throws std::length_error as addChild above
+   */
+  NodeId interpose(NodeId node, char label, char child_label);
+
+  /** \brief the reverse of interpose: if the child of node reached by label
+   *  has exactly one child, release it and let the edge point to that
+   *  grandchild instead.  The word flag of the released node is dropped
+   *  \return the index of the grandchild, or kNoNode if nothing was changed
+   */
+  NodeId contract(NodeId node, char label);
+
+  /** \brief move all nodes of another arena into this one and attach the
+   *  children of its root to node.  The arrays of source are appended with
+   *  their indices shifted, so no node is visited individually.  node must
+   *  not have a child with any label used by the root of source, and the word
+   *  flag of the root of source is ignored
+   *  \param[in] node the parent node in this arena
+   *  \param[in,out] source the arena to take the nodes from.  It is left
+   *  holding only an empty root
+   *  \throws std::length_error if the node or edge indices would run out,
+   *  in which case neither arena is changed
+   */
+  void splice(NodeId node, TrieArena& source);
+
+  /** \brief release all nodes and return to a tree holding only the root */
+  void clear();
+
+  /** \brief pass an image of the arena to write, a few large pieces at a
+   *  time.  The arrays are written as they are, free lists included, in host
+   *  byte order, so readImage() restores them with sequential copies
+   *  \param[in] write called as write(data, length) for each piece
+   */
+  void writeImage(const std::function<void (const char*, size_t)>& write) const;
+
+  /** \brief replace the nodes by an image written by writeImage(), read
+   *  straight into the arrays
+   *  \param[in] length the size of the whole image in bytes
+   *  \param[in] read called as read(data, length) to fill each piece, returns
+   *  false if it cannot
+   *  \return false, leaving the arena holding only the root, if the image is
+   *  malformed or cannot be read
+   */
+  bool readImage(size_t length, const std::function<bool (char*, size_t)>& read);
+
+  /** \brief returns the number of live nodes, including the root */
+  size_t nodeCount() const { return live_nodes_; }
+
+  /** \brief returns the number of bytes reserved by the arena */
+  size_t memoryUsage() const;
+
+  /** \brief returns memoryUsage() broken down by what the bytes hold.  Takes
+   *  time linear in the number of nodes
+   */
+  Usage usage() const;
+
+private:
+  /** \brief a node of the prefix tree.  Its children occupy the block
+   * [edges, edges + num_edges) of labels_ and targets_.
+   */
+  typedef struct Node {
+    uint32_t edges;
+    uint16_t num_edges;
+    uint8_t block_class;
+    bool is_word;
+    uint32_t words;
+  } Node;
+
+  /** \brief the optional weights of a node, parallel to nodes_ */
+  typedef struct Weights {
+    uint32_t word;
+    uint32_t subtree;
+  } Weights;
+
+  /** \brief blocks hold 1 << block_class edges, up to one per byte value */
+  static const unsigned kNumBlockClasses = 9;
+  static const uint8_t kNoBlock = 0xff;
+  static const uint32_t kNoOffset = 0xffffffffu;
+  static const uint32_t kLinearScanLimit = 16;
+
+  /** \brief take a node from the free list or grow the node array */
+  NodeId allocNode();
+
+  /** \brief take a block from the free list of its class or grow the pools */
+  uint32_t allocBlock(unsigned block_class);
+
+  /** \brief return a block to the free list of its class */
+  void freeBlock(uint32_t offset, unsigned block_class);
+
+  /** \brief move the children of node to a block of another size class */
+  void resizeBlock(NodeId node, unsigned block_class);
+
+  /** \brief insert an edge to an existing child at position pos of node */
+  void insertEdge(NodeId node, uint32_t pos, char label, NodeId child);
+
+  /** \brief position of the first label in node that is not less than label */
+  uint32_t lowerBound(const Node& node, char label) const;
+
+  /** \brief position of the edge labelled label in node, or kNoOffset */
+  uint32_t findEdge(const Node& node, char label) const;
+
+  /** \brief release node and all its descendants */
+  size_t releaseSubtree(NodeId node);
+
+  std::vector<Node> nodes_;
+  std::vector<char> labels_;
+  std::vector<NodeId> targets_;
+
+  /* \brief empty unless weights are enabled */
+  std::vector<Weights> weights_;
+
+  /* \brief released nodes are chained through their edges field */
+  NodeId free_nodes_;
+
+  /* \brief released blocks are chained through their first target slot */
+  uint32_t free_blocks_[kNumBlockClasses];
+
+  size_t live_nodes_;
+
+  /* \brief scratch stack reused by releaseSubtree */
+  std::vector<NodeId> release_stack_;
+};
+
+#endif
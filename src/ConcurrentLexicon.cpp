@@ -0,0 +1,439 @@
+#include <ConcurrentLexicon.h>
+#include <Lexicon.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <unordered_set>
+using namespace std;
+
+const size_t ConcurrentLexicon::kMaxReaders;
+
+/** \brief working state of one apply(): the root and size being built, the
+ * nodes allocated by this batch (which are unpublished and can still be
+ * modified in place) and the published nodes it replaced
+ */
+struct ConcurrentLexicon::Update {
+  const Node* root;
+  size_t size;
+  unordered_set<const Node*> fresh;
+  vector<const Node*> retired;
+};
+
+ConcurrentLexicon::ConcurrentLexicon() :
+  current_(new Version{nullptr, 0}),
+  global_epoch_(1)
+{
+  for (ReaderSlot& slot : slots_) {
+    slot.epoch.store(0);
+    slot.claimed.store(false);
+  }
+}
+
+ConcurrentLexicon::ConcurrentLexicon(const Lexicon& lex) :
+  ConcurrentLexicon()
+{
+  Batch batch;
+  lex.mapAll([&batch](const string& word) { batch.add(word); });
+  apply(batch);
+}
+
+ConcurrentLexicon::~ConcurrentLexicon() {
+  for (auto& retired : retired_nodes_)
+    freeNode(retired.second);
+  for (auto& retired : retired_versions_)
+    delete retired.second;
+  const Version* version = current_.load();
+  Update update{version->root, version->size, {}, {}};
+  discardSubtree(update, version->root);
+  for (const Node* node : update.retired)
+    freeNode(node);
+  delete version;
+}
+
+ConcurrentLexicon::Reader ConcurrentLexicon::reader() {
+  for (ReaderSlot& slot : slots_) {
+    bool expected = false;
+    if (!slot.claimed.load() && slot.claimed.compare_exchange_strong(expected, true))
+      return Reader(this, &slot);
+  }
+  throw runtime_error("ConcurrentLexicon: too many readers");
+}
+
+void ConcurrentLexicon::apply(const Batch& batch) {
+  lock_guard<mutex> lock(writer_mutex_);
+  const Version* old_version = current_.load();
+  Update update{old_version->root, old_version->size, {}, {}};
+
+  for (auto& operation : batch.operations_) {
+    switch (operation.first) {
+      case Batch::kAdd:          applyAdd(update, operation.second); break;
+      case Batch::kRemove:       applyRemove(update, operation.second); break;
+      case Batch::kRemovePrefix: applyRemovePrefix(update, operation.second); break;
+    }
+  }
+  if (update.root == old_version->root)
+    return;
+
+  /* publish, then open a new epoch: a reader announcing the new epoch is
+   * guaranteed to load the new version */
+  current_.store(new Version{update.root, update.size});
+  uint64_t retire_epoch = global_epoch_.fetch_add(1) + 1;
+  for (const Node* node : update.retired)
+    retired_nodes_.push_back(make_pair(retire_epoch, node));
+  retired_versions_.push_back(make_pair(retire_epoch, old_version));
+
+  reclaimLocked();
+}
+
+void ConcurrentLexicon::add(const string& word) {
+  Batch batch;
+  batch.add(word);
+  apply(batch);
+}
+
+void ConcurrentLexicon::remove(const string& word) {
+  Batch batch;
+  batch.remove(word);
+  apply(batch);
+}
+
+void ConcurrentLexicon::removePrefix(const string& prefix) {
+  Batch batch;
+  batch.removePrefix(prefix);
+  apply(batch);
+}
+
+void ConcurrentLexicon::reclaim() {
+  lock_guard<mutex> lock(writer_mutex_);
+  reclaimLocked();
+}
+
+size_t ConcurrentLexicon::pendingReclamation() const {
+  lock_guard<mutex> lock(writer_mutex_);
+  return retired_nodes_.size();
+}
+
+ConcurrentLexicon::Node* ConcurrentLexicon::allocNode(bool is_word, size_t num_children) {
+  void* memory = ::operator new(sizeof(Node) + num_children * (sizeof(Node*) + 1));
+  Node* node = static_cast<Node*>(memory);
+  node->is_word = is_word;
+  node->num_children = static_cast<uint32_t>(num_children);
+  return node;
+}
+
+void ConcurrentLexicon::freeNode(const Node* node) {
+  ::operator delete(const_cast<Node*>(node));
+}
+
+const ConcurrentLexicon::Node* ConcurrentLexicon::child(const Node* node, char label) {
+  const void* hit = memchr(node->labels(), label, node->num_children);
+  return hit ? node->children()[static_cast<const char*>(hit) - node->labels()] : nullptr;
+}
+
+const ConcurrentLexicon::Node* ConcurrentLexicon::findNode(const Node* root,
+    const string& str) {
+  const Node* curr = root;
+  for (size_t i = 0; i < str.size() && curr; ++i)
+    curr = child(curr, str[i]);
+  return curr;
+}
+
+void ConcurrentLexicon::walkWords(const Node* root,
+    const function<void (const string&)>& func) {
+  if (!root)
+    return;
+  string prefix;
+  vector<pair<const Node*, uint32_t>> walk_stack;
+  if (root->is_word)
+    func(prefix);
+  walk_stack.push_back(make_pair(root, 0u));
+  while (!walk_stack.empty()) {
+    pair<const Node*, uint32_t>& top = walk_stack.back();
+    if (top.second == top.first->num_children) {
+      walk_stack.pop_back();
+      if (!prefix.empty())
+        prefix.pop_back();
+      continue;
+    }
+    const Node* next = top.first->children()[top.second];
+    prefix.push_back(top.first->labels()[top.second++]);
+    if (next->is_word)
+      func(prefix);
+    walk_stack.push_back(make_pair(next, 0u));
+  }
+}
+
+void ConcurrentLexicon::applyAdd(Update& update, const string& word) {
+  vector<const Node*> path(1, update.root);
+  for (size_t i = 0; i < word.size(); ++i)
+    path.push_back(path.back() ? child(path.back(), word[i]) : nullptr);
+  if (path.back() && path.back()->is_word)
+    return;
+  ++update.size;
+  replacePath(update, word, path, setWord(update, path.back(), true), false);
+}
+
+void ConcurrentLexicon::applyRemove(Update& update, const string& word) {
+  vector<const Node*> path(1, update.root);
+  for (size_t i = 0; i < word.size() && path.back(); ++i)
+    path.push_back(child(path.back(), word[i]));
+  const Node* node = path.back();
+  if (path.size() != word.size() + 1 || !node || !node->is_word)
+    return;
+  --update.size;
+  const Node* replacement = nullptr;
+  if (node->num_children > 0)
+    replacement = setWord(update, node, false);
+  else
+    discard(update, node);
+  replacePath(update, word, path, replacement, true);
+}
+
+void ConcurrentLexicon::applyRemovePrefix(Update& update, const string& prefix) {
+  vector<const Node*> path(1, update.root);
+  for (size_t i = 0; i < prefix.size() && path.back(); ++i)
+    path.push_back(child(path.back(), prefix[i]));
+  if (path.size() != prefix.size() + 1 || !path.back())
+    return;
+  update.size -= discardSubtree(update, path.back());
+  replacePath(update, prefix, path, nullptr, true);
+}
+
+void ConcurrentLexicon::replacePath(Update& update, const string& key,
+    const vector<const Node*>& path, const Node* replacement, bool prune) {
+  for (size_t depth = key.size(); depth-- > 0; ) {
+    /* a node updated in place leaves all its ancestors unchanged */
+    if (replacement == path[depth + 1])
+      return;
+    const Node* parent = setChild(update, path[depth], key[depth], replacement);
+    /* after a removal, a node that leads to no word is dropped as well */
+    if (prune && parent && parent->num_children == 0 && !parent->is_word) {
+      discard(update, parent);
+      parent = nullptr;
+    }
+    replacement = parent;
+  }
+  update.root = replacement;
+}
+
+const ConcurrentLexicon::Node* ConcurrentLexicon::setChild(Update& update,
+    const Node* node, char label, const Node* new_child) {
+  size_t count = node ? node->num_children : 0;
+  const unsigned char* labels = node ?
+    reinterpret_cast<const unsigned char*>(node->labels()) : nullptr;
+  size_t pos = lower_bound(labels, labels + count, static_cast<unsigned char>(label)) - labels;
+  bool exists = pos < count && labels[pos] == static_cast<unsigned char>(label);
+
+  if (exists && new_child && update.fresh.count(node)) {
+    const_cast<Node*>(node)->children()[pos] = new_child;
+    return node;
+  }
+  if (!exists && !new_child)
+    return node;
+
+  /* copy node with the edge at pos replaced, inserted or erased */
+  size_t new_count = count + (exists ? 0 : 1) - (new_child ? 0 : 1);
+  Node* copy = allocNode(node && node->is_word, new_count);
+  size_t out = 0;
+  for (size_t i = 0; i <= count; ++i) {
+    if (i == pos && new_child) {
+      copy->children()[out] = new_child;
+      copy->labels()[out++] = label;
+    }
+    if (i == count)
+      break;
+    if (i == pos && exists)
+      continue;
+    copy->children()[out] = node->children()[i];
+    copy->labels()[out++] = node->labels()[i];
+  }
+  update.fresh.insert(copy);
+  if (node)
+    discard(update, node);
+  return copy;
+}
+
+const ConcurrentLexicon::Node* ConcurrentLexicon::setWord(Update& update,
+    const Node* node, bool is_word) {
+  if (node && update.fresh.count(node)) {
+    const_cast<Node*>(node)->is_word = is_word;
+    return node;
+  }
+  size_t count = node ? node->num_children : 0;
+  Node* copy = allocNode(is_word, count);
+  if (count > 0) {
+    copy_n(node->children(), count, copy->children());
+    copy_n(node->labels(), count, copy->labels());
+  }
+  update.fresh.insert(copy);
+  if (node)
+    discard(update, node);
+  return copy;
+}
+
+void ConcurrentLexicon::discard(Update& update, const Node* node) {
+  if (update.fresh.erase(node))
+    freeNode(node);
+  else
+    update.retired.push_back(node);
+}
+
+size_t ConcurrentLexicon::discardSubtree(Update& update, const Node* node) {
+  size_t words = 0;
+  vector<const Node*> discard_stack;
+  if (node)
+    discard_stack.push_back(node);
+  while (!discard_stack.empty()) {
+    const Node* curr = discard_stack.back();
+    discard_stack.pop_back();
+    if (curr->is_word)
+      ++words;
+    discard_stack.insert(discard_stack.end(), curr->children(),
+        curr->children() + curr->num_children);
+    discard(update, curr);
+  }
+  return words;
+}
+
+void ConcurrentLexicon::reclaimLocked() {
+  /* anything retired in an epoch no active reader predates is unreachable */
+  uint64_t oldest = UINT64_MAX;
+  for (ReaderSlot& slot : slots_) {
+    uint64_t epoch = slot.epoch.load();
+    if (epoch != 0)
+      oldest = min(oldest, epoch);
+  }
+
+  size_t kept = 0;
+  for (auto& retired : retired_nodes_) {
+    if (retired.first <= oldest)
+      freeNode(retired.second);
+    else
+      retired_nodes_[kept++] = retired;
+  }
+  retired_nodes_.resize(kept);
+
+  kept = 0;
+  for (auto& retired : retired_versions_) {
+    if (retired.first <= oldest)
+      delete retired.second;
+    else
+      retired_versions_[kept++] = retired;
+  }
+  retired_versions_.resize(kept);
+}
+
+const ConcurrentLexicon::Version* ConcurrentLexicon::pin(ReaderSlot& slot) const {
+  /* announce before loading: a writer that misses the announcement has
+   * already published the version loaded below */
+  slot.epoch.store(global_epoch_.load());
+  return current_.load();
+}
+
+/*************************************************
+ * ConcurrentLexicon::Batch
+ */
+
+void ConcurrentLexicon::Batch::add(const string& word) {
+  operations_.push_back(make_pair(kAdd, word));
+}
+
+void ConcurrentLexicon::Batch::remove(const string& word) {
+  operations_.push_back(make_pair(kRemove, word));
+}
+
+void ConcurrentLexicon::Batch::removePrefix(const string& prefix) {
+  operations_.push_back(make_pair(kRemovePrefix, prefix));
+}
+
+void ConcurrentLexicon::Batch::clear() {
+  operations_.clear();
+}
+
+bool ConcurrentLexicon::Batch::empty() const {
+  return operations_.empty();
+}
+
+/*************************************************
+ * ConcurrentLexicon::Snapshot
+ */
+
+ConcurrentLexicon::Snapshot::Snapshot(Reader* reader, const Version* version) :
+  reader_(reader),
+  version_(version)
+{}
+
+ConcurrentLexicon::Snapshot::Snapshot(Snapshot&& other) :
+  reader_(other.reader_),
+  version_(other.version_)
+{
+  other.reader_ = nullptr;
+}
+
+ConcurrentLexicon::Snapshot::~Snapshot() {
+  if (reader_ && --reader_->pins_ == 0)
+    reader_->slot_->epoch.store(0);
+}
+
+bool ConcurrentLexicon::Snapshot::contains(const string& word) const {
+  const Node* found = findNode(version_->root, word);
+  return found && found->is_word;
+}
+
+bool ConcurrentLexicon::Snapshot::containsPrefix(const string& prefix) const {
+  return findNode(version_->root, prefix) != nullptr;
+}
+
+size_t ConcurrentLexicon::Snapshot::size() const {
+  return version_->size;
+}
+
+void ConcurrentLexicon::Snapshot::mapAll(
+    const function<void (const string&)>& func) const {
+  walkWords(version_->root, func);
+}
+
+/*************************************************
+ * ConcurrentLexicon::Reader
+ */
+
+ConcurrentLexicon::Reader::Reader(const ConcurrentLexicon* lexicon, ReaderSlot* slot) :
+  lexicon_(lexicon),
+  slot_(slot),
+  pins_(0)
+{}
+
+ConcurrentLexicon::Reader::Reader(Reader&& other) :
+  lexicon_(other.lexicon_),
+  slot_(other.slot_),
+  pins_(other.pins_)
+{
+  other.slot_ = nullptr;
+}
+
+ConcurrentLexicon::Reader::~Reader() {
+  if (slot_) {
+    slot_->epoch.store(0);
+    slot_->claimed.store(false);
+  }
+}
+
+bool ConcurrentLexicon::Reader::contains(const string& word) {
+  return snapshot().contains(word);
+}
+
+bool ConcurrentLexicon::Reader::containsPrefix(const string& prefix) {
+  return snapshot().containsPrefix(prefix);
+}
+
+size_t ConcurrentLexicon::Reader::size() {
+  return snapshot().size();
+}
+
+ConcurrentLexicon::Snapshot ConcurrentLexicon::Reader::snapshot() {
+  /* a nested snapshot is covered by the epoch the outermost one announced */
+  const Version* version = pins_++ == 0 ? lexicon_->pin(*slot_)
+                                        : lexicon_->current_.load();
+  return Snapshot(this, version);
+}
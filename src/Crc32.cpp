@@ -0,0 +1,35 @@
+#include <Crc32.h>
+#include <vector>
+using namespace std;
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc) {
+  /* slicing by 8: tables[k][b] is the checksum of byte b followed by k zero
+   * bytes, so eight bytes are folded in with eight independent lookups */
+  static const vector<uint32_t> tables = [] {
+    vector<uint32_t> t(8 * 256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i)
+      for (size_t k = 1; k < 8; ++k)
+        t[k * 256 + i] = (t[(k - 1) * 256 + i] >> 8) ^ t[t[(k - 1) * 256 + i] & 0xff];
+    return t;
+  }();
+  const uint32_t* table = tables.data();
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  crc = ~crc;
+  for (; length >= 8; bytes += 8, length -= 8) {
+    crc ^= uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 |
+      uint32_t(bytes[3]) << 24;
+    crc = table[7 * 256 + (crc & 0xff)] ^ table[6 * 256 + ((crc >> 8) & 0xff)] ^
+      table[5 * 256 + ((crc >> 16) & 0xff)] ^ table[4 * 256 + (crc >> 24)] ^
+      table[3 * 256 + bytes[4]] ^ table[2 * 256 + bytes[5]] ^
+      table[1 * 256 + bytes[6]] ^ table[bytes[7]];
+  }
+  for (size_t i = 0; i < length; ++i)
+    crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
@@ -0,0 +1,193 @@
+#include <DenseLexicon.h>
+#include <Lexicon.h>
+#include <LexiconCounters.h>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+/* a level of the walk in mapAll: the node, its next child and that child's code */
+typedef struct WalkElement {
+  uint32_t node;
+  uint32_t child;
+  size_t code;
+} WalkElement;
+
+/* returns the number of set bits of word */
+size_t popCount(uint64_t word) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(word);
+#else
+  size_t count = 0;
+  for (; word; word &= word - 1)
+    ++count;
+  return count;
+#endif
+}
+
+/* returns the position of the lowest set bit of word, which must not be 0 */
+size_t lowestBit(uint64_t word) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(word);
+#else
+  size_t pos = 0;
+  for (; !(word & 1); word >>= 1)
+    ++pos;
+  return pos;
+#endif
+}
+
+}  // namespace
+
+const uint32_t DenseLexicon::kNoNode;
+const uint16_t DenseLexicon::kNoCode;
+const uint64_t DenseLexicon::kWordBit;
+
+DenseLexicon::DenseLexicon(const Lexicon& lex, const KeyNormalizer& normalizer) :
+  normalizer_(normalizer)
+{
+  /* merge the words that share a normal form before copying the tree */
+  Lexicon normalized;
+  if (!normalizer.isIdentity())
+    lex.mapAll([&normalized, &normalizer](const string& word) {
+      normalized.add(normalizer.normalize(word));
+    });
+  const Lexicon& words = normalizer.isIdentity() ? lex : normalized;
+  const TrieArena& trie = words.trie_;
+  size_ = words.size();
+
+  /* number the nodes depth first, giving the children of a node consecutive
+   * numbers when it is visited, so a run of single children is a run of
+   * neighbouring nodes.  Also collect the bytes used on the edges */
+  vector<TrieArena::NodeId> order(1, trie.root());
+  vector<uint32_t> first_child(1, 0);
+  vector<uint32_t> pending(1, 0);
+  bool used[256] = {false};
+  while (!pending.empty()) {
+    uint32_t node = pending.back();
+    pending.pop_back();
+    size_t count = trie.numChildren(order[node]);
+    if (order.size() + count >= (size_t(1) << 31))
+      throw length_error("DenseLexicon: too many nodes");
+    uint32_t first = static_cast<uint32_t>(order.size());
+    first_child[node] = first;
+    const char* labels = trie.labels(order[node]);
+    const TrieArena::NodeId* children = trie.children(order[node]);
+    for (size_t j = 0; j < count; ++j) {
+      used[static_cast<unsigned char>(labels[j])] = true;
+      order.push_back(children[j]);
+      first_child.push_back(0);
+    }
+    for (size_t j = count; j > 0; --j)
+      pending.push_back(first + static_cast<uint32_t>(j - 1));
+  }
+  for (unsigned byte = 0; byte < 256; ++byte) {
+    codes_[byte] = used[byte] ? static_cast<uint16_t>(letters_.size()) : kNoCode;
+    if (used[byte])
+      letters_.push_back(static_cast<char>(byte));
+  }
+
+  stride_ = 1 + (letters_.size() > 64 ? (letters_.size() + 63) / 64 : 1);
+  nodes_.assign(order.size() * stride_, 0);
+  for (size_t i = 0; i < order.size(); ++i) {
+    uint64_t* node = nodes_.data() + i * stride_;
+    node[0] = first_child[i] | (trie.isWord(order[i]) ? kWordBit : 0);
+    size_t count = trie.numChildren(order[i]);
+    const char* labels = trie.labels(order[i]);
+    for (size_t j = 0; j < count; ++j) {
+      size_t code = codes_[static_cast<unsigned char>(labels[j])];
+      node[1 + (code >> 6)] |= uint64_t(1) << (code & 63);
+    }
+  }
+  letters_.shrink_to_fit();
+}
+
+bool DenseLexicon::contains(const string& word) const {
+  return contains(word.data(), word.size());
+}
+
+bool DenseLexicon::contains(const char* word, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  uint32_t node = findNode(word, length);
+  return node != kNoNode && isWord(node);
+}
+
+bool DenseLexicon::containsPrefix(const string& prefix) const {
+  return containsPrefix(prefix.data(), prefix.size());
+}
+
+bool DenseLexicon::containsPrefix(const char* prefix, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  /* the root always exists, but is only a prefix once some word was added;
+   * every node below it leads to a word */
+  return !isEmpty() && findNode(prefix, length) != kNoNode;
+}
+
+void DenseLexicon::mapAll(const function<void (const string&)>& func) const {
+  string word;
+  if (isWord(0))
+    func(word);
+
+  size_t first = nextCode(0, 0);
+  if (first == kNoCode)
+    return;
+  vector<WalkElement> walk_stack(1, WalkElement{0,
+      static_cast<uint32_t>(nodes_[0]), first});
+  while (!walk_stack.empty()) {
+    WalkElement& top = walk_stack.back();
+    if (top.code == kNoCode) {
+      walk_stack.pop_back();
+      continue;
+    }
+    uint32_t node = top.child++;
+    /* the stack holds one level per letter of the word */
+    word.resize(walk_stack.size() - 1);
+    word.push_back(letters_[top.code]);
+    top.code = nextCode(top.node, top.code + 1);
+    if (isWord(node))
+      func(static_cast<const string&>(word));
+    size_t code = nextCode(node, 0);
+    if (code != kNoCode)
+      walk_stack.push_back(WalkElement{node,
+          static_cast<uint32_t>(nodes_[node * stride_]), code});
+  }
+}
+
+size_t DenseLexicon::memoryUsage() const {
+  return nodes_.capacity() * sizeof(uint64_t) + letters_.capacity() + sizeof(codes_);
+}
+
+uint32_t DenseLexicon::child(uint32_t node, size_t code) const {
+  const uint64_t* record = nodes_.data() + node * stride_;
+  const uint64_t* bitmap = record + 1;
+  uint64_t bit = uint64_t(1) << (code & 63);
+  uint64_t word = bitmap[code >> 6];
+  if (!(word & bit))
+    return kNoNode;
+  size_t index = popCount(word & (bit - 1));
+  for (size_t i = 0; i < (code >> 6); ++i)
+    index += popCount(bitmap[i]);
+  return static_cast<uint32_t>(record[0]) + static_cast<uint32_t>(index);
+}
+
+size_t DenseLexicon::nextCode(uint32_t node, size_t from) const {
+  const uint64_t* bitmap = nodes_.data() + node * stride_ + 1;
+  for (size_t i = from >> 6; i + 1 < stride_; ++i) {
+    uint64_t word = bitmap[i];
+    if (i == (from >> 6))
+      word &= ~uint64_t(0) << (from & 63);
+    if (word)
+      return (i << 6) + lowestBit(word);
+  }
+  return kNoCode;
+}
+
+uint32_t DenseLexicon::findNode(const char* key, size_t length) const {
+  uint32_t node = 0;
+  bool found = normalizer_.forEachByte(key, length, [this, &node](char byte) {
+    uint16_t code = codes_[static_cast<unsigned char>(byte)];
+    node = code == kNoCode ? kNoNode : child(node, code);
+    return node != kNoNode;
+  });
+  return found ? node : kNoNode;
+}
@@ -0,0 +1,148 @@
+#include <EmbeddedLexicon.h>
+#include <LexiconCounters.h>
+#include <cctype>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+/* array elements written per line of generated source */
+const size_t kStatesPerLine = 6;
+const size_t kTargetsPerLine = 10;
+const size_t kLabelsPerLine = 48;
+
+/* returns whether name can be used as a C++ identifier */
+bool isIdentifier(const string& name) {
+  if (name.empty() || isdigit(static_cast<unsigned char>(name[0])))
+    return false;
+  for (size_t i = 0; i < name.size(); ++i) {
+    if (!isalnum(static_cast<unsigned char>(name[i])) && name[i] != '_')
+      return false;
+  }
+  return true;
+}
+
+/* append label to a string literal.  Anything but letters and digits is
+ * written as a three digit octal escape, which cannot run into the next
+ * character and keeps quotes, backslashes and trigraphs out of the literal
+ */
+void writeLabel(ostream& out, char label) {
+  unsigned char byte = static_cast<unsigned char>(label);
+  if (byte < 0x80 && isalnum(byte)) {
+    out << label;
+    return;
+  }
+  const char digits[] = "01234567";
+  out << '\\' << digits[byte >> 6] << digits[(byte >> 3) & 7] << digits[byte & 7];
+}
+
+}  // namespace
+
+bool EmbeddedLexicon::contains(const string& word) const {
+  return contains(word.data(), word.size());
+}
+
+bool EmbeddedLexicon::contains(const char* word, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  StateId found = findState(word, length);
+  return found != FrozenLexicon::kNoState && states_[found].is_word;
+}
+
+bool EmbeddedLexicon::containsPrefix(const string& prefix) const {
+  return containsPrefix(prefix.data(), prefix.size());
+}
+
+bool EmbeddedLexicon::containsPrefix(const char* prefix, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  return !isEmpty() && findState(prefix, length) != FrozenLexicon::kNoState;
+}
+
+void EmbeddedLexicon::mapAll(const function<void (const string&)>& func) const {
+  frozen().mapAll(func);
+}
+
+FrozenLexicon EmbeddedLexicon::frozen() const {
+  /* the arrays are static, so there is no storage to keep alive */
+  FrozenLexicon lex;
+  lex.states_ = states_;
+  lex.labels_ = labels_;
+  lex.targets_ = targets_;
+  lex.num_states_ = num_states_;
+  lex.num_edges_ = num_edges_;
+  lex.root_ = root_;
+  lex.size_ = size_;
+  return lex;
+}
+
+void EmbeddedLexicon::generate(const FrozenLexicon& words, const string& name,
+    ostream& header, ostream& source) {
+  if (!isIdentifier(name))
+    throw invalid_argument("EmbeddedLexicon: '" + name + "' is not an identifier");
+
+  string guard = "LEXICON_EMBED_";
+  for (size_t i = 0; i < name.size(); ++i)
+    guard.push_back(static_cast<char>(toupper(static_cast<unsigned char>(name[i]))));
+  guard += "_H_";
+  header << "// Generated by lexicon-embed.  Do not edit.\n"
+         << "#ifndef " << guard << "\n"
+         << "#define " << guard << "\n"
+         << "\n"
+         << "#include <EmbeddedLexicon.h>\n"
+         << "\n"
+         << "/** \\brief " << words.size() << " words embedded at build time */\n"
+         << "extern const EmbeddedLexicon " << name << ";\n"
+         << "\n"
+         << "#endif\n";
+
+  /* C++ has no empty arrays, so an empty lexicon gets one unused element */
+  source << "// Generated by lexicon-embed.  Do not edit.\n"
+         << "#include \"" << name << ".h\"\n"
+         << "\n"
+         << "namespace {\n"
+         << "\n"
+         << "const EmbeddedLexicon::State kStates[] = {";
+  for (size_t i = 0; i < words.num_states_; ++i) {
+    const State& state = words.states_[i];
+    source << (i % kStatesPerLine ? " " : "\n  ")
+           << "{" << state.edges << "u, " << state.num_edges << ", "
+           << unsigned(state.is_word) << ", 0},";
+  }
+  if (words.num_states_ == 0)
+    source << "\n  {0u, 0, 0, 0}";
+  source << "\n};\n"
+         << "\n"
+         << "const EmbeddedLexicon::StateId kTargets[] = {";
+  for (size_t i = 0; i < words.num_edges_; ++i)
+    source << (i % kTargetsPerLine ? " " : "\n  ") << words.targets_[i] << "u,";
+  if (words.num_edges_ == 0)
+    source << "\n  0u";
+  source << "\n};\n"
+         << "\n"
+         << "const char kLabels[] =";
+  for (size_t i = 0; i < words.num_edges_; ++i) {
+    if (i % kLabelsPerLine == 0)
+      source << (i ? "\"\n  \"" : "\n  \"");
+    writeLabel(source, words.labels_[i]);
+  }
+  source << (words.num_edges_ ? "\";\n" : "\n  \"\";\n")
+         << "\n"
+         << "}  // namespace\n"
+         << "\n"
+         << "extern const EmbeddedLexicon " << name << "(kStates, kTargets, kLabels,\n"
+         << "    " << words.num_states_ << "u, " << words.num_edges_ << "u, "
+         << words.root_ << "u, " << words.size_ << "u);\n";
+}
+
+EmbeddedLexicon::StateId EmbeddedLexicon::findState(const char* key, size_t length) const {
+  StateId curr = root_;
+  for (size_t i = 0; i < length && curr != FrozenLexicon::kNoState; ++i) {
+    const State& state = states_[curr];
+    const char* base = labels_ + state.edges;
+    const void* hit = state.num_edges ? memchr(base, key[i], state.num_edges) : nullptr;
+    curr = hit ? targets_[state.edges + (static_cast<const char*>(hit) - base)]
+      : FrozenLexicon::kNoState;
+  }
+  return curr;
+}
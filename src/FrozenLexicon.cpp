@@ -0,0 +1,385 @@
+#include <FrozenLexicon.h>
+#include <Crc32.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+/* A lexicon image is a FileHeader followed by the state array, the target
+ * array and the label array, each stored exactly as it is laid out in memory.
+ * The byte order mark rejects images written on a host of the other
+ * endianness.
+ */
+const char kImageMagic[8] = {'L', 'E', 'X', 'D', 'A', 'W', 'G', '\0'};
+const uint32_t kImageVersion = 1;
+const uint32_t kByteOrderMark = 0x01020304u;
+
+typedef struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t num_words;
+  uint32_t num_states;
+  uint32_t num_edges;
+  uint32_t root;
+  /* CRC-32 of everything that follows the header */
+  uint32_t payload_checksum;
+  /* CRC-32 of the header with this field set to zero */
+  uint32_t header_checksum;
+  uint32_t reserved[5];
+} FileHeader;
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader must have a fixed layout");
+static_assert(sizeof(FrozenLexicon::State) == 8, "State must have a fixed layout");
+
+uint32_t headerChecksum(FileHeader header) {
+  header.header_checksum = 0;
+  return crc32(&header, sizeof(header));
+}
+
+}
+
+const FrozenLexicon::StateId FrozenLexicon::kNoState;
+
+/** \brief arrays built in memory by a Builder */
+struct FrozenLexicon::OwnedStorage : public FrozenLexicon::Storage {
+  vector<State> states;
+  vector<char> labels;
+  vector<StateId> targets;
+};
+
+/** \brief a read-only mapping of a file written by save() */
+struct FrozenLexicon::MappedStorage : public FrozenLexicon::Storage {
+  MappedStorage(void* address, size_t length) : address(address), length(length) {}
+  ~MappedStorage() { munmap(address, length); }
+  void* address;
+  size_t length;
+};
+
+FrozenLexicon::FrozenLexicon() :
+  states_(nullptr),
+  labels_(nullptr),
+  targets_(nullptr),
+  num_states_(0),
+  num_edges_(0),
+  root_(kNoState),
+  size_(0)
+{}
+
+FrozenLexicon FrozenLexicon::mapFile(const string& path, bool verify_checksum) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw runtime_error("FrozenLexicon: cannot open " + path);
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(FileHeader)) {
+    close(fd);
+    throw runtime_error("FrozenLexicon: " + path + " is not a lexicon image");
+  }
+  size_t length = static_cast<size_t>(file_stat.st_size);
+  void* address = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED)
+    throw runtime_error("FrozenLexicon: cannot map " + path);
+  /* from here on the mapping is released by storage if we throw */
+  shared_ptr<MappedStorage> storage(new MappedStorage(address, length));
+
+  const char* image = static_cast<const char*>(address);
+  FileHeader header;
+  memcpy(&header, image, sizeof(header));
+  if (memcmp(header.magic, kImageMagic, sizeof(kImageMagic)) != 0 ||
+      header.header_checksum != headerChecksum(header))
+    throw runtime_error("FrozenLexicon: " + path + " is not a lexicon image");
+  if (header.version != kImageVersion)
+    throw runtime_error("FrozenLexicon: " + path + " has an unsupported version");
+  if (header.byte_order != kByteOrderMark)
+    throw runtime_error("FrozenLexicon: " + path + " was written with another byte order");
+
+  size_t states_bytes = size_t(header.num_states) * sizeof(State);
+  size_t targets_bytes = size_t(header.num_edges) * sizeof(StateId);
+  size_t labels_bytes = size_t(header.num_edges);
+  bool valid_root = header.num_words == 0 ? header.root == kNoState
+                                          : header.root < header.num_states;
+  if (length != sizeof(header) + states_bytes + targets_bytes + labels_bytes || !valid_root)
+    throw runtime_error("FrozenLexicon: " + path + " is truncated or inconsistent");
+
+  FrozenLexicon lexicon;
+  lexicon.states_ = reinterpret_cast<const State*>(image + sizeof(header));
+  lexicon.targets_ = reinterpret_cast<const StateId*>(image + sizeof(header) + states_bytes);
+  lexicon.labels_ = image + sizeof(header) + states_bytes + targets_bytes;
+  lexicon.num_states_ = header.num_states;
+  lexicon.num_edges_ = header.num_edges;
+  lexicon.root_ = header.root;
+  lexicon.size_ = header.num_words;
+
+  if (verify_checksum) {
+    if (crc32(image + sizeof(header), length - sizeof(header)) != header.payload_checksum)
+      throw runtime_error("FrozenLexicon: checksum mismatch in " + path);
+    /* make sure no state can lead a lookup outside of the arrays */
+    for (size_t i = 0; i < lexicon.num_states_; ++i) {
+      const State& state = lexicon.states_[i];
+      if (size_t(state.edges) + state.num_edges > lexicon.num_edges_)
+        throw runtime_error("FrozenLexicon: corrupt state in " + path);
+    }
+    for (size_t i = 0; i < lexicon.num_edges_; ++i)
+      if (lexicon.targets_[i] >= lexicon.num_states_)
+        throw runtime_error("FrozenLexicon: corrupt edge in " + path);
+  }
+  lexicon.storage_ = storage;
+  return lexicon;
+}
+
+FrozenLexicon FrozenLexicon::fromSorted(istream& input) {
+  Builder builder;
+  string word;
+  while (getline(input, word)) {
+    if (!builder.add(word))
+      throw invalid_argument("FrozenLexicon: input is not sorted at '" + word + "'");
+  }
+  return builder.finish();
+}
+
+bool FrozenLexicon::contains(const string& word) const {
+  StateId found = findState(word);
+  return found != kNoState && states_[found].is_word;
+}
+
+bool FrozenLexicon::containsPrefix(const string& prefix) const {
+  return !isEmpty() && findState(prefix) != kNoState;
+}
+
+bool FrozenLexicon::isEmpty() const {
+  return size_ == 0;
+}
+
+void FrozenLexicon::mapAll(const function<void (const string&)>& func) const {
+  if (isEmpty())
+    return;
+  /* iterative in-order walk; the path is kept as (state, next edge) pairs */
+  string prefix;
+  vector<pair<StateId, uint32_t>> walk_stack;
+  if (states_[root_].is_word)
+    func(prefix);
+  walk_stack.push_back(make_pair(root_, 0u));
+  while (!walk_stack.empty()) {
+    pair<StateId, uint32_t>& top = walk_stack.back();
+    const State& state = states_[top.first];
+    if (top.second == state.num_edges) {
+      walk_stack.pop_back();
+      if (!prefix.empty())
+        prefix.pop_back();
+      continue;
+    }
+    uint32_t edge = state.edges + top.second++;
+    StateId target = targets_[edge];
+    prefix.push_back(labels_[edge]);
+    if (states_[target].is_word)
+      func(prefix);
+    walk_stack.push_back(make_pair(target, 0u));
+  }
+}
+
+size_t FrozenLexicon::size() const {
+  return size_;
+}
+
+size_t FrozenLexicon::numStates() const {
+  return num_states_;
+}
+
+size_t FrozenLexicon::numEdges() const {
+  return num_edges_;
+}
+
+size_t FrozenLexicon::memoryUsage() const {
+  return num_states_ * sizeof(State) + num_edges_ * sizeof(char) +
+    num_edges_ * sizeof(StateId);
+}
+
+bool FrozenLexicon::save(const string& path) const {
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kImageMagic, sizeof(kImageMagic));
+  header.version = kImageVersion;
+  header.byte_order = kByteOrderMark;
+  header.num_words = size_;
+  header.num_states = static_cast<uint32_t>(num_states_);
+  header.num_edges = static_cast<uint32_t>(num_edges_);
+  header.root = root_;
+
+  size_t states_bytes = num_states_ * sizeof(State);
+  size_t targets_bytes = num_edges_ * sizeof(StateId);
+  header.payload_checksum = crc32(labels_, num_edges_,
+      crc32(targets_, targets_bytes, crc32(states_, states_bytes)));
+  header.header_checksum = headerChecksum(header);
+
+  /* write to a temporary file and rename it so that readers never map a
+   * partially written image */
+  string temp_path = path + ".tmp";
+  ofstream out(temp_path, ios::binary | ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(states_), states_bytes);
+  out.write(reinterpret_cast<const char*>(targets_), targets_bytes);
+  out.write(labels_, num_edges_);
+  out.close();
+  if (!out || rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+FrozenLexicon::StateId FrozenLexicon::next(StateId state, char label) const {
+  const State& s = states_[state];
+  if (s.num_edges == 0)
+    return kNoState;
+  const char* base = labels_ + s.edges;
+  const void* hit = memchr(base, label, s.num_edges);
+  return hit ? targets_[s.edges + (static_cast<const char*>(hit) - base)] : kNoState;
+}
+
+FrozenLexicon::StateId FrozenLexicon::findState(const string& str) const {
+  StateId curr = root_;
+  for (size_t i = 0; i < str.size() && curr != kNoState; ++i)
+    curr = next(curr, str[i]);
+  return curr;
+}
+
+/*************************************************
+ * FrozenLexicon::Builder
+ */
+
+FrozenLexicon::Builder::Builder() :
+  path_(1),
+  has_previous_(false),
+  storage_(new OwnedStorage),
+  size_(0),
+  register_(0, StateHash{this}, StateEqual{this})
+{
+  path_[0].is_word = false;
+}
+
+FrozenLexicon::Builder::~Builder() {}
+
+bool FrozenLexicon::Builder::add(const string& word) {
+  if (has_previous_) {
+    int order = word.compare(previous_);
+    if (order < 0)
+      return false;
+    if (order == 0)
+      return true;
+  }
+
+  /* states past the common prefix with the previous word can no longer
+   * change, so they are replaced by their registered equivalents */
+  size_t common = 0;
+  while (common < word.size() && common < previous_.size() &&
+      word[common] == previous_[common])
+    ++common;
+  minimize(common);
+
+  /* append the remaining suffix as a fresh chain of pending states */
+  for (size_t i = common; i < word.size(); ++i) {
+    path_.back().edges.push_back(make_pair(word[i], kNoState));
+    path_.push_back(PendingState());
+    path_.back().is_word = false;
+  }
+  path_.back().is_word = true;
+
+  previous_ = word;
+  has_previous_ = true;
+  ++size_;
+  return true;
+}
+
+FrozenLexicon FrozenLexicon::Builder::finish() {
+  FrozenLexicon result;
+  minimize(0);
+  if (size_ > 0)
+    result.root_ = registerState(path_[0]);
+  result.size_ = size_;
+  result.states_ = storage_->states.data();
+  result.labels_ = storage_->labels.data();
+  result.targets_ = storage_->targets.data();
+  result.num_states_ = storage_->states.size();
+  result.num_edges_ = storage_->labels.size();
+  result.storage_.reset(storage_.release());
+
+  /* reset for reuse */
+  storage_.reset(new OwnedStorage);
+  size_ = 0;
+  register_.clear();
+  path_.assign(1, PendingState());
+  path_[0].is_word = false;
+  previous_.clear();
+  has_previous_ = false;
+  return result;
+}
+
+void FrozenLexicon::Builder::minimize(size_t depth) {
+  while (path_.size() > depth + 1) {
+    StateId registered = registerState(path_.back());
+    path_.pop_back();
+    path_.back().edges.back().second = registered;
+  }
+}
+
+FrozenLexicon::StateId FrozenLexicon::Builder::registerState(
+    const PendingState& pending) {
+  /* append the candidate to the arrays so it can be hashed and compared like
+   * any registered state, and roll it back if an equivalent one exists */
+  vector<State>& states = storage_->states;
+  vector<char>& labels = storage_->labels;
+  vector<StateId>& targets = storage_->targets;
+
+  State state;
+  state.edges = static_cast<uint32_t>(labels.size());
+  state.num_edges = static_cast<uint16_t>(pending.edges.size());
+  state.is_word = pending.is_word;
+  state.reserved = 0;
+  for (auto& edge : pending.edges) {
+    labels.push_back(edge.first);
+    targets.push_back(edge.second);
+  }
+  StateId candidate = static_cast<StateId>(states.size());
+  states.push_back(state);
+
+  auto inserted = register_.insert(candidate);
+  if (!inserted.second) {
+    states.pop_back();
+    labels.resize(state.edges);
+    targets.resize(state.edges);
+    return *inserted.first;
+  }
+  return candidate;
+}
+
+size_t FrozenLexicon::Builder::StateHash::operator()(StateId state) const {
+  const OwnedStorage& storage = *builder->storage_;
+  const State& s = storage.states[state];
+  /* FNV-1a over the finality flag and the outgoing edges */
+  size_t hash = 2166136261u ^ s.is_word;
+  for (uint32_t i = s.edges; i < s.edges + s.num_edges; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(storage.labels[i])) * 16777619u;
+    hash = (hash ^ storage.targets[i]) * 16777619u;
+  }
+  return hash;
+}
+
+bool FrozenLexicon::Builder::StateEqual::operator()(StateId lhs, StateId rhs) const {
+  const OwnedStorage& storage = *builder->storage_;
+  const State& l = storage.states[lhs];
+  const State& r = storage.states[rhs];
+  return l.is_word == r.is_word && l.num_edges == r.num_edges &&
+    equal(storage.labels.begin() + l.edges, storage.labels.begin() + l.edges + l.num_edges,
+        storage.labels.begin() + r.edges) &&
+    equal(storage.targets.begin() + l.edges, storage.targets.begin() + l.edges + l.num_edges,
+        storage.targets.begin() + r.edges);
+}
@@ -0,0 +1,531 @@
+#include <JournaledLexicon.h>
+#include <Crc32.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+/* A snapshot is a SnapshotHeader followed by an image of the TrieArena of
+ * the words, which loads with a few sequential copies; a journal is a
+ * JournalHeader followed by a record for every mutation.  A record is the CRC-32 of the rest of the record, a type byte,
+ * the length of the word as a base-128 varint, the weight for weighted adds
+ * and then the letters of the word.  Integers are stored in host byte order,
+ * and the byte order mark rejects files from a host of the other endianness.
+ */
+const char kSnapshotMagic[8] = {'L', 'E', 'X', 'S', 'N', 'A', 'P', '\0'};
+const char kJournalMagic[8] = {'L', 'E', 'X', 'J', 'R', 'N', 'L', '\0'};
+const uint32_t kFileVersion = 1;
+const uint32_t kByteOrderMark = 0x01020304u;
+
+typedef struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  /* the journal that continues from the snapshot */
+  uint64_t generation;
+  uint64_t num_words;
+  /* CRC-32 of the arena image after the header */
+  uint32_t image_checksum;
+  /* CRC-32 of the header with this field set to zero */
+  uint32_t header_checksum;
+} SnapshotHeader;
+
+typedef struct JournalHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t generation;
+  uint32_t reserved;
+  /* CRC-32 of the header with this field set to zero */
+  uint32_t header_checksum;
+} JournalHeader;
+
+static_assert(sizeof(SnapshotHeader) == 40, "SnapshotHeader must have a fixed layout");
+static_assert(sizeof(JournalHeader) == 32, "JournalHeader must have a fixed layout");
+
+/* records are written out once this many bytes are buffered */
+const size_t kBufferBytes = 1 << 16;
+
+/* the most bytes a varint of a 64-bit length takes */
+const size_t kMaxVarintBytes = 10;
+
+template <typename Header>
+uint32_t headerChecksum(Header header) {
+  header.header_checksum = 0;
+  return crc32(&header, sizeof(header));
+}
+
+template <typename Header>
+Header makeHeader(const char (&magic)[8], uint64_t generation) {
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = kFileVersion;
+  header.byte_order = kByteOrderMark;
+  header.generation = generation;
+  return header;
+}
+
+template <typename Header>
+bool validHeader(const Header& header, const char (&magic)[8]) {
+  return memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+    header.version == kFileVersion && header.byte_order == kByteOrderMark &&
+    header.header_checksum == headerChecksum(header);
+}
+
+/* Reads a whole file into memory; returns false if it cannot be opened. */
+bool readFile(const string& path, vector<char>& contents) {
+  ifstream in(path, ios::binary);
+  if (!in)
+    return false;
+  in.seekg(0, ios::end);
+  contents.resize(static_cast<size_t>(in.tellg()));
+  in.seekg(0, ios::beg);
+  in.read(contents.data(), contents.size());
+  return static_cast<bool>(in);
+}
+
+/* Writes as much of a buffer to fd as it can, retrying after short writes,
+ * and returns the number of bytes written; less than length on an error. */
+size_t writeSome(int fd, const char* data, size_t length) {
+  size_t done = 0;
+  while (done < length) {
+    ssize_t written = write(fd, data + done, length - done);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      break;
+    done += static_cast<size_t>(written);
+  }
+  return done;
+}
+
+/* Writes all of a buffer to fd, retrying after short writes. */
+bool writeAll(int fd, const char* data, size_t length) {
+  return writeSome(fd, data, length) == length;
+}
+
+/* Forces the entries of the directory holding path to disk, so that a file
+ * created or renamed there survives a crash. */
+void syncDirectory(const string& path) {
+  size_t slash = path.rfind('/');
+  string directory = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  int fd = open(directory.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+bool fileExists(const string& path) {
+  struct stat file_stat;
+  return stat(path.c_str(), &file_stat) == 0;
+}
+
+}  // namespace
+
+const size_t JournaledLexicon::kDefaultCompactionBytes;
+
+JournaledLexicon::JournaledLexicon(const string& path, size_t compaction_bytes) :
+  path_(path),
+  compaction_bytes_(compaction_bytes),
+  journal_fd_(-1),
+  generation_(0),
+  journal_bytes_(0),
+  recovery_(Recovery{0, 0, 0}),
+  compacting_(false)
+{
+  replayJournals(loadSnapshot());
+}
+
+JournaledLexicon::~JournaledLexicon() {
+  try {
+    flush();
+  } catch (const exception&) {
+    /* a destructor cannot report it; the records are lost like on a crash */
+  }
+  if (compaction_.joinable())
+    compaction_.join();
+  if (journal_fd_ >= 0)
+    close(journal_fd_);
+}
+
+void JournaledLexicon::add(const string& word) {
+  size_t before = lex_.size();
+  lex_.add(word);
+  if (lex_.size() != before)
+    append(kAdd, word.data(), word.size(), 0);
+}
+
+void JournaledLexicon::add(const string& word, uint32_t weight) {
+  size_t before = lex_.size();
+  uint32_t old_weight = lex_.weight(word);
+  lex_.add(word, weight);
+  if (lex_.size() != before || weight != old_weight)
+    append(kAddWeighted, word.data(), word.size(), weight);
+}
+
+void JournaledLexicon::clear() {
+  if (lex_.isEmpty())
+    return;
+  lex_.clear();
+  append(kClear, nullptr, 0, 0);
+}
+
+void JournaledLexicon::compact() {
+  if (compacting_)
+    return;
+  waitForCompaction();
+
+  /* the files up to the new journal hold exactly the words as they are now,
+   * so the snapshot is rebuilt from them rather than from the tree */
+  openNextJournal();
+  uint64_t generation = generation_;
+  compacting_ = true;
+  try {
+    compaction_ = thread([this, generation] {
+      try {
+        writeSnapshot(generation);
+      } catch (...) {
+        compaction_error_ = current_exception();
+      }
+      compacting_ = false;
+    });
+  } catch (...) {
+    compacting_ = false;
+    throw;
+  }
+}
+
+void JournaledLexicon::flush() {
+  if (buffer_.empty())
+    return;
+  /* the bytes that did reach the journal leave the buffer, so that the next
+   * flush completes a record cut by a failed write instead of repeating it */
+  size_t written = writeSome(journal_fd_, buffer_.data(), buffer_.size());
+  journal_bytes_ += written;
+  buffer_.erase(buffer_.begin(), buffer_.begin() + written);
+  if (!buffer_.empty())
+    throw runtime_error("JournaledLexicon: cannot write " + journalPath(generation_));
+}
+
+bool JournaledLexicon::remove(const string& word) {
+  if (!lex_.remove(word))
+    return false;
+  append(kRemove, word.data(), word.size(), 0);
+  return true;
+}
+
+size_t JournaledLexicon::removePrefix(const string& prefix) {
+  size_t removed = lex_.removePrefix(prefix);
+  if (removed)
+    append(kRemovePrefix, prefix.data(), prefix.size(), 0);
+  return removed;
+}
+
+void JournaledLexicon::sync() {
+  flush();
+  if (fsync(journal_fd_) != 0)
+    throw runtime_error("JournaledLexicon: cannot sync " + journalPath(generation_));
+}
+
+void JournaledLexicon::waitForCompaction() {
+  if (compaction_.joinable())
+    compaction_.join();
+  if (compaction_error_) {
+    exception_ptr error = compaction_error_;
+    compaction_error_ = nullptr;
+    rethrow_exception(error);
+  }
+}
+
+string JournaledLexicon::journalPath(uint64_t generation) const {
+  return path_ + ".journal." + to_string(generation);
+}
+
+uint64_t JournaledLexicon::loadSnapshot() {
+  string snapshot_path = path_ + ".snapshot";
+  /* left over from a compaction that did not finish */
+  std::remove((snapshot_path + ".tmp").c_str());
+
+  uint64_t generation = readSnapshot(lex_);
+  recovery_.snapshot_words = lex_.size();
+
+  /* journals the snapshot covers, if a crash kept them from being deleted */
+  for (uint64_t g = generation; g-- > 0 && std::remove(journalPath(g).c_str()) == 0; )
+    ;
+  return generation;
+}
+
+uint64_t JournaledLexicon::readSnapshot(Lexicon& words) const {
+  string snapshot_path = path_ + ".snapshot";
+  ifstream in(snapshot_path, ios::binary);
+  if (!in)
+    return 0;
+  in.seekg(0, ios::end);
+  size_t length = static_cast<size_t>(in.tellg());
+  in.seekg(0, ios::beg);
+  SnapshotHeader header;
+  if (length < sizeof(header) || !in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      !validHeader(header, kSnapshotMagic))
+    throw runtime_error("JournaledLexicon: " + snapshot_path + " is not a snapshot");
+
+  /* the image is read straight into the arrays of the tree.  The snapshot
+   * was complete before it was renamed into place, so any damage is
+   * corruption rather than a torn write */
+  uint32_t checksum = 0;
+  bool loaded = words.trie_.readImage(length - sizeof(header),
+      [&in, &checksum](char* data, size_t size) {
+    if (!in.read(data, size))
+      return false;
+    checksum = crc32(data, size, checksum);
+    return true;
+  });
+  if (!loaded || checksum != header.image_checksum ||
+      words.trie_.wordCount(words.trie_.root()) != header.num_words) {
+    words.clear();
+    throw runtime_error("JournaledLexicon: " + snapshot_path + " is corrupt");
+  }
+  words.size_ = static_cast<size_t>(header.num_words);
+  return header.generation;
+}
+
+void JournaledLexicon::replayJournal(Lexicon& words, uint64_t generation) const {
+  string journal_path = journalPath(generation);
+  ifstream in(journal_path, ios::binary);
+  JournalHeader header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    throw runtime_error("JournaledLexicon: cannot read " + journal_path);
+  if (!validHeader(header, kJournalMagic) || header.generation != generation)
+    throw runtime_error("JournaledLexicon: " + journal_path + " is not a journal");
+
+  /* read in blocks, carrying a record cut at the end of a block over to the
+   * next one */
+  vector<char> block;
+  size_t pending = 0;
+  for (;;) {
+    block.resize(pending + kBufferBytes);
+    in.read(block.data() + pending, kBufferBytes);
+    size_t length = pending + static_cast<size_t>(in.gcount());
+    if (length == pending)
+      break;
+    size_t consumed = forEachRecord(block.data(), length, [&words](RecordType type,
+        const char* word, size_t word_length, uint32_t weight) {
+      apply(words, type, word, word_length, weight);
+    });
+    pending = length - consumed;
+    memmove(block.data(), block.data() + consumed, pending);
+  }
+  if (pending != 0 || in.bad())
+    throw runtime_error("JournaledLexicon: " + journal_path + " is corrupt");
+}
+
+void JournaledLexicon::replayJournals(uint64_t generation) {
+  generation_ = generation;
+  size_t valid_bytes = 0;
+  bool torn = false;
+  for (uint64_t g = generation; fileExists(journalPath(g)); ++g) {
+    string journal_path = journalPath(g);
+    vector<char> contents;
+    if (!readFile(journal_path, contents))
+      throw runtime_error("JournaledLexicon: cannot read " + journal_path);
+    if (torn) {
+      /* nothing after a torn record can be replayed consistently */
+      recovery_.discarded_bytes += contents.size();
+      std::remove(journal_path.c_str());
+      continue;
+    }
+
+    JournalHeader header;
+    size_t valid = 0;
+    if (contents.size() >= sizeof(header)) {
+      memcpy(&header, contents.data(), sizeof(header));
+      if (!validHeader(header, kJournalMagic) || header.generation != g)
+        throw runtime_error("JournaledLexicon: " + journal_path + " is not a journal");
+      valid = sizeof(header) + forEachRecord(contents.data() + sizeof(header),
+          contents.size() - sizeof(header), [this](RecordType type, const char* word,
+              size_t length, uint32_t weight) {
+        apply(lex_, type, word, length, weight);
+        ++recovery_.replayed_records;
+      });
+    }
+    if (valid < contents.size()) {
+      recovery_.discarded_bytes += contents.size() - valid;
+      if (truncate(journal_path.c_str(), static_cast<off_t>(valid)) != 0)
+        throw runtime_error("JournaledLexicon: cannot truncate " + journal_path);
+      torn = true;
+    }
+    generation_ = g;
+    valid_bytes = valid;
+  }
+
+  string journal_path = journalPath(generation_);
+  journal_fd_ = open(journal_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (journal_fd_ < 0)
+    throw runtime_error("JournaledLexicon: cannot open " + journal_path);
+  journal_bytes_ = valid_bytes;
+  if (valid_bytes == 0) {
+    /* a new journal, or one whose header was torn while it was created */
+    JournalHeader header = makeHeader<JournalHeader>(kJournalMagic, generation_);
+    header.header_checksum = headerChecksum(header);
+    if (ftruncate(journal_fd_, 0) != 0 ||
+        !writeAll(journal_fd_, reinterpret_cast<const char*>(&header), sizeof(header))) {
+      close(journal_fd_);
+      throw runtime_error("JournaledLexicon: cannot write " + journal_path);
+    }
+    journal_bytes_ = sizeof(header);
+  }
+}
+
+void JournaledLexicon::encodeRecord(vector<char>& out, RecordType type, const char* word,
+    size_t length, uint32_t weight) {
+  size_t start = out.size();
+  out.resize(start + sizeof(uint32_t));
+  out.push_back(static_cast<char>(type));
+  for (size_t rest = length; ; rest >>= 7) {
+    out.push_back(static_cast<char>((rest & 0x7f) | (rest > 0x7f ? 0x80 : 0)));
+    if (rest <= 0x7f)
+      break;
+  }
+  if (type == kAddWeighted) {
+    const char* bytes = reinterpret_cast<const char*>(&weight);
+    out.insert(out.end(), bytes, bytes + sizeof(weight));
+  }
+  out.insert(out.end(), word, word + length);
+  uint32_t checksum = crc32(out.data() + start + sizeof(uint32_t),
+      out.size() - start - sizeof(uint32_t));
+  memcpy(out.data() + start, &checksum, sizeof(checksum));
+}
+
+template <typename Func>
+size_t JournaledLexicon::forEachRecord(const char* data, size_t length, Func func) {
+  size_t pos = 0;
+  for (;;) {
+    size_t next = pos + sizeof(uint32_t) + 1;
+    if (next > length)
+      return pos;
+    uint32_t checksum;
+    memcpy(&checksum, data + pos, sizeof(checksum));
+    unsigned char type = static_cast<unsigned char>(data[next - 1]);
+    if (type < kAdd || type > kClear)
+      return pos;
+
+    size_t word_length = 0;
+    for (size_t shift = 0; ; shift += 7) {
+      if (next == length || shift == 7 * kMaxVarintBytes)
+        return pos;
+      unsigned char byte = static_cast<unsigned char>(data[next++]);
+      word_length |= size_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        break;
+    }
+    uint32_t weight = 0;
+    if (type == kAddWeighted) {
+      if (length - next < sizeof(weight))
+        return pos;
+      memcpy(&weight, data + next, sizeof(weight));
+      next += sizeof(weight);
+    }
+    if (length - next < word_length)
+      return pos;
+    const char* word = data + next;
+    next += word_length;
+    if (crc32(data + pos + sizeof(uint32_t), next - pos - sizeof(uint32_t)) != checksum)
+      return pos;
+    func(static_cast<RecordType>(type), word, word_length, weight);
+    pos = next;
+  }
+}
+
+void JournaledLexicon::apply(Lexicon& words, RecordType type, const char* word,
+    size_t length, uint32_t weight) {
+  switch (type) {
+    case kAdd:
+      words.add(word, length);
+      break;
+    case kAddWeighted:
+      words.add(word, length, weight);
+      break;
+    case kRemove:
+      words.remove(word, length);
+      break;
+    case kRemovePrefix:
+      words.removePrefix(word, length);
+      break;
+    case kClear:
+      words.clear();
+      break;
+  }
+}
+
+void JournaledLexicon::append(RecordType type, const char* word, size_t length,
+    uint32_t weight) {
+  encodeRecord(buffer_, type, word, length, weight);
+  if (buffer_.size() >= kBufferBytes)
+    flush();
+  if (compaction_bytes_ && journalBytes() >= compaction_bytes_ && !compacting_)
+    compact();
+}
+
+void JournaledLexicon::openNextJournal() {
+  sync();
+  string journal_path = journalPath(generation_ + 1);
+  int fd = open(journal_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd < 0)
+    throw runtime_error("JournaledLexicon: cannot create " + journal_path);
+  JournalHeader header = makeHeader<JournalHeader>(kJournalMagic, generation_ + 1);
+  header.header_checksum = headerChecksum(header);
+  if (!writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header))) {
+    close(fd);
+    std::remove(journal_path.c_str());
+    throw runtime_error("JournaledLexicon: cannot write " + journal_path);
+  }
+  syncDirectory(journal_path);
+  close(journal_fd_);
+  journal_fd_ = fd;
+  ++generation_;
+  journal_bytes_ = sizeof(header);
+}
+
+void JournaledLexicon::writeSnapshot(uint64_t generation) {
+  /* the journals before generation are complete and no longer written to,
+   * and only this thread replaces the snapshot */
+  Lexicon words;
+  for (uint64_t g = readSnapshot(words); g < generation; ++g)
+    replayJournal(words, g);
+
+  string snapshot_path = path_ + ".snapshot";
+  string temp_path = snapshot_path + ".tmp";
+  int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw runtime_error("JournaledLexicon: cannot create " + temp_path);
+
+  /* the header goes in front once the checksum of the image is known */
+  SnapshotHeader header = makeHeader<SnapshotHeader>(kSnapshotMagic, generation);
+  header.num_words = words.size();
+  bool written = lseek(fd, sizeof(header), SEEK_SET) == static_cast<off_t>(sizeof(header));
+  words.trie_.writeImage([&](const char* data, size_t length) {
+    header.image_checksum = crc32(data, length, header.image_checksum);
+    written = written && writeAll(fd, data, length);
+  });
+  header.header_checksum = headerChecksum(header);
+  written = written && pwrite(fd, &header, sizeof(header), 0) ==
+    static_cast<ssize_t>(sizeof(header)) && fsync(fd) == 0;
+  close(fd);
+  if (!written || rename(temp_path.c_str(), snapshot_path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    throw runtime_error("JournaledLexicon: cannot write " + snapshot_path);
+  }
+  syncDirectory(snapshot_path);
+
+  /* the snapshot is durable, so the journals before it can go */
+  for (uint64_t g = generation; g-- > 0 && std::remove(journalPath(g).c_str()) == 0; )
+    ;
+}
@@ -0,0 +1,178 @@
+#include <KeyNormalizer.h>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+/* write codepoint to out as UTF-8
+ * \return the number of bytes written, 0 if codepoint is not a valid one
+ */
+size_t encodeUtf8(uint32_t codepoint, char* out) {
+  if (codepoint < 0x80) {
+    out[0] = static_cast<char>(codepoint);
+    return 1;
+  }
+  if (codepoint < 0x800) {
+    out[0] = static_cast<char>(0xc0 | (codepoint >> 6));
+    out[1] = static_cast<char>(0x80 | (codepoint & 0x3f));
+    return 2;
+  }
+  if (codepoint < 0x10000) {
+    if (codepoint >= 0xd800 && codepoint <= 0xdfff)
+      return 0;
+    out[0] = static_cast<char>(0xe0 | (codepoint >> 12));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+    out[2] = static_cast<char>(0x80 | (codepoint & 0x3f));
+    return 3;
+  }
+  if (codepoint < 0x110000) {
+    out[0] = static_cast<char>(0xf0 | (codepoint >> 18));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f));
+    out[2] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+    out[3] = static_cast<char>(0x80 | (codepoint & 0x3f));
+    return 4;
+  }
+  return 0;
+}
+
+}  // namespace
+
+KeyNormalizer::KeyNormalizer() :
+  folding_(nullptr)
+{
+  for (unsigned byte = 0; byte < 256; ++byte)
+    byte_map_[byte] = static_cast<unsigned char>(byte);
+}
+
+KeyNormalizer KeyNormalizer::asciiCaseFold() {
+  KeyNormalizer normalizer;
+  for (unsigned byte = 'A'; byte <= 'Z'; ++byte)
+    normalizer.byte_map_[byte] = static_cast<unsigned char>(byte - 'A' + 'a');
+  return normalizer;
+}
+
+KeyNormalizer KeyNormalizer::utf8CaseFold() {
+  return utf8(foldCase);
+}
+
+KeyNormalizer KeyNormalizer::utf8(Folding folding) {
+  KeyNormalizer normalizer;
+  /* ASCII never reaches folding, it is looked up in the table */
+  for (uint32_t byte = 0; byte < 0x80; ++byte) {
+    uint32_t folded = folding(byte);
+    if (folded >= 0x80)
+      throw invalid_argument("KeyNormalizer: folding maps ASCII outside ASCII");
+    normalizer.byte_map_[byte] = static_cast<unsigned char>(folded);
+  }
+  normalizer.folding_ = folding;
+  return normalizer;
+}
+
+uint32_t KeyNormalizer::foldCase(uint32_t codepoint) {
+  uint32_t c = codepoint;
+  if (c < 0x80)
+    return c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+  /* Latin-1: U+00C0 to U+00DE, except the multiplication sign */
+  if (c < 0x100)
+    return c >= 0xc0 && c <= 0xde && c != 0xd7 ? c + 0x20 : c;
+  /* Latin Extended-A: mostly pairs of upper and lower case */
+  if (c < 0x180) {
+    /* dotted and dotless i, kra and n preceded by apostrophe have no pair */
+    if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149)
+      return c;
+    if (c == 0x178)
+      return 0xff;
+    if (c == 0x17f)
+      return 's';
+    if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17e))
+      return c & 1 ? c + 1 : c;
+    return c & 1 ? c : c + 1;
+  }
+  /* Greek */
+  if (c >= 0x386 && c <= 0x3ab) {
+    if (c == 0x386)
+      return 0x3ac;
+    if (c >= 0x388 && c <= 0x38a)
+      return c + 0x25;
+    if (c == 0x38c)
+      return 0x3cc;
+    if (c == 0x38e || c == 0x38f)
+      return c + 0x3f;
+    return c >= 0x391 && c != 0x3a2 ? c + 0x20 : c;
+  }
+  if (c == 0x3c2)
+    return 0x3c3;
+  /* Cyrillic */
+  if (c >= 0x400 && c <= 0x40f)
+    return c + 0x50;
+  if (c >= 0x410 && c <= 0x42f)
+    return c + 0x20;
+  return c;
+}
+
+bool KeyNormalizer::isIdentity() const {
+  if (folding_)
+    return false;
+  for (unsigned byte = 0; byte < 256; ++byte)
+    if (byte_map_[byte] != byte)
+      return false;
+  return true;
+}
+
+string KeyNormalizer::normalize(const string& key) const {
+  return normalize(key.data(), key.size());
+}
+
+string KeyNormalizer::normalize(const char* key, size_t length) const {
+  string normal;
+  normal.reserve(length);
+  forEachByte(key, length, [&normal](char byte) {
+    normal.push_back(byte);
+    return true;
+  });
+  return normal;
+}
+
+size_t KeyNormalizer::foldSequence(const char* key, size_t length, char* out,
+    size_t& out_length) const {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(key);
+  /* the length of the sequence and the bits of the code point in its lead */
+  size_t sequence = 0;
+  uint32_t codepoint = 0;
+  if (bytes[0] >= 0xc2 && bytes[0] <= 0xdf) {
+    sequence = 2;
+    codepoint = bytes[0] & 0x1f;
+  }
+  else if (bytes[0] >= 0xe0 && bytes[0] <= 0xef) {
+    sequence = 3;
+    codepoint = bytes[0] & 0x0f;
+  }
+  else if (bytes[0] >= 0xf0 && bytes[0] <= 0xf4) {
+    sequence = 4;
+    codepoint = bytes[0] & 0x07;
+  }
+
+  bool valid = sequence != 0 && sequence <= length;
+  for (size_t i = 1; valid && i < sequence; ++i) {
+    valid = (bytes[i] & 0xc0) == 0x80;
+    codepoint = (codepoint << 6) | (bytes[i] & 0x3f);
+  }
+  /* overlong forms, surrogates and code points past U+10FFFF */
+  if (valid)
+    valid = !(sequence == 3 && codepoint < 0x800) &&
+      !(sequence == 4 && (codepoint < 0x10000 || codepoint > 0x10ffff)) &&
+      !(codepoint >= 0xd800 && codepoint <= 0xdfff);
+  if (!valid) {
+    out[0] = key[0];
+    out_length = 1;
+    return 1;
+  }
+
+  out_length = encodeUtf8(folding_(codepoint), out);
+  if (out_length == 0) {
+    for (size_t i = 0; i < sequence; ++i)
+      out[i] = key[i];
+    out_length = sequence;
+  }
+  return sequence;
+}
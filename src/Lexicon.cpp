@@ -1,24 +1,162 @@
 #include <Lexicon.h>
+#include <algorithm>
 #include <fstream>
+#include <future>
+#include <queue>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
 using namespace std;
 
+namespace {
+
+/* number of lookups lookupBatch keeps in flight */
+const size_t kBatchLanes = 16;
+
+/* size of the blocks bulkLoad reads its input in */
+const size_t kLoadBlockSize = 1 << 20;
+
+/* Returns the position of the first of count labels, sorted by unsigned
+ * byte, that is not less than letter. */
+size_t labelPosition(const char* labels, size_t count, char letter) {
+  const unsigned char* begin = reinterpret_cast<const unsigned char*>(labels);
+  return lower_bound(begin, begin + count, static_cast<unsigned char>(letter)) - begin;
+}
+
+/* Calls func(word, length) for every line of an in-memory buffer.  Like
+ * getline, a final line without a new line is still reported but an empty
+ * remainder after the last new line is not.
+ */
+template <typename Func>
+size_t forEachLine(const char* data, size_t length, bool final_block, Func func) {
+  const char* begin = data;
+  const char* end = data + length;
+  while (begin != end) {
+    const char* newline = static_cast<const char*>(memchr(begin, '\n', end - begin));
+    if (!newline) {
+      if (!final_block)
+        break;
+      newline = end;
+    }
+    func(begin, static_cast<size_t>(newline - begin));
+    begin = newline == end ? end : newline + 1;
+  }
+  /* number of bytes consumed; the rest is an incomplete line */
+  return begin - data;
+}
+
+/* Calls func(word, length) for every line of input, reading it in large
+ * blocks.  A line that straddles two blocks is moved to the front of the
+ * buffer before the next block is read behind it.
+ */
+template <typename Func>
+void forEachLine(istream& input, Func func) {
+  vector<char> buffer(kLoadBlockSize);
+  size_t filled = 0;
+  while (input) {
+    if (filled == buffer.size())
+      buffer.resize(buffer.size() * 2);
+    input.read(buffer.data() + filled, buffer.size() - filled);
+    filled += static_cast<size_t>(input.gcount());
+    size_t consumed = forEachLine(buffer.data(), filled, !input, func);
+    memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+    filled -= consumed;
+  }
+}
+
+/* Hands out items, the biggest first, each to the thread with the least load
+ * so far.  loads[item] is the size of an item; returns the items of each of
+ * at most num_threads threads.
+ */
+vector<vector<unsigned>> assignLoads(vector<unsigned> items, const vector<size_t>& loads,
+    unsigned num_threads) {
+  sort(items.begin(), items.end(), [&loads](unsigned l, unsigned r) {
+    return loads[l] > loads[r];
+  });
+  num_threads = min<unsigned>(num_threads, max<size_t>(items.size(), 1));
+  vector<vector<unsigned>> assignment(num_threads);
+  vector<size_t> load(num_threads, 0);
+  for (unsigned item : items) {
+    size_t least = min_element(load.begin(), load.end()) - load.begin();
+    assignment[least].push_back(item);
+    load[least] += loads[item];
+  }
+  return assignment;
+}
+
+/* a pair of nodes walked in lockstep by combineBranch, the position of the
+ * next child to visit, the label of the edge into node, and the words and
+ * highest weight of the copies below node that were deferred */
+typedef struct CombineElement {
+  TrieArena::NodeId node;
+  TrieArena::NodeId other;
+  size_t next_child;
+  char label;
+  size_t deferred_words;
+  uint32_t deferred_weight;
+} CombineElement;
+
+/* Reads all of input into memory. */
+vector<char> readAll(istream& input) {
+  vector<char> text;
+  size_t filled = 0;
+  while (input) {
+    text.resize(filled + kLoadBlockSize);
+    input.read(text.data() + filled, kLoadBlockSize);
+    filled += static_cast<size_t>(input.gcount());
+  }
+  text.resize(filled);
+  return text;
+}
+
+}
+
+const Lexicon::WordId Lexicon::kNoWord;
+
 Lexicon::Lexicon() :
   size_(0)
 {}
 
+Lexicon::Lexicon(istream& input) :
+  size_(0)
+{
+  addWordsFromFile(input);
+}
+
+Lexicon::Lexicon(const string& filename) :
+  size_(0)
+{
+  addWordsFromFile(filename);
+}
+
 void Lexicon::add(const string& word) {
- ensureNodeExists(word)->isWord = true;
- word_set_.insert(word);
- ++size_;
+  add(word.data(), word.size());
+}
+
+void Lexicon::add(const char* word, size_t length) {
+  NodeId node = ensureNodeExists(word, length);
+  if (!trie_.isWord(node)) {
+    trie_.setWord(node, true);
+    for (NodeId n : path_)
+      trie_.setWordCount(n, trie_.wordCount(n) + 1);
+    ++size_;
+  }
 }
  
+void Lexicon::add(const string& word, uint32_t weight) {
+  add(word.data(), word.size(), weight);
+}
+
+void Lexicon::add(const char* word, size_t length, uint32_t weight) {
+  trie_.enableWeights();
+  add(word, length);
+  trie_.setWeight(findNode(word, length), weight);
+  updateMaxWeights(word, length);
+}
+
 void Lexicon::addWordsFromFile (std::istream& input) {
-  string word;
-  while(getline(input,word)) {
-    add(word);
-  }
+  bulkLoad(input, 1);
 }
 
 void Lexicon::addWordsFromFile (const std::string& filename) {
@@ -28,52 +166,574 @@ void Lexicon::addWordsFromFile (const std::string& filename) {
   file.close();
 }
 
+void Lexicon::bulkLoad (istream& input, unsigned num_threads) {
+  if (num_threads == 0)
+    num_threads = max(thread::hardware_concurrency(), 1u);
+
+  if (num_threads > 1 && isEmpty() && trie_.isLeaf(trie_.root())) {
+    parallelLoad(readAll(input), num_threads);
+    return;
+  }
+
+  vector<NodeId> path(1, trie_.root());
+  string previous;
+  forEachLine(input, [&](const char* word, size_t length) {
+    addAlongPath(word, length, path, previous);
+  });
+}
+
+void Lexicon::bulkLoad (const string& filename, unsigned num_threads) {
+  ifstream file(filename, ios::binary);
+  if (file)
+    bulkLoad(file, num_threads);
+}
+
 void Lexicon::clear() {
-  root_.reset(nullptr);
-  word_set_.clear();
+  trie_.clear();
   size_ = 0;
 } 
  
 bool Lexicon::containsPrefix(const string& prefix) const {
-  return findNode(prefix) != nullptr;
+  return containsPrefix(prefix.data(), prefix.size());
+}
+
+bool Lexicon::containsPrefix(const char* prefix, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  /* the root always exists, but is only a prefix once some word was added */
+  if (length == 0)
+    return !isEmpty();
+  return findNode(prefix, length) != TrieArena::kNoNode;
 }
  
 bool Lexicon::contains(const string& word) const {
- const TrieNode* found = findNode(word);
- return found != nullptr && found->isWord;
+  return contains(word.data(), word.size());
+}
+
+bool Lexicon::contains(const char* word, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  NodeId found = findNode(word, length);
+  return found != TrieArena::kNoNode && trie_.isWord(found);
+}
+
+bool Lexicon::contains(const char* word, size_t length,
+    const KeyNormalizer& normalizer) const {
+  LEXICON_COUNT(kLookups, 1);
+  NodeId found = findNode(word, length, normalizer);
+  return found != TrieArena::kNoNode && trie_.isWord(found);
+}
+
+bool Lexicon::containsPrefix(const char* prefix, size_t length,
+    const KeyNormalizer& normalizer) const {
+  LEXICON_COUNT(kLookups, 1);
+  return !isEmpty() && findNode(prefix, length, normalizer) != TrieArena::kNoNode;
+}
+
+Lexicon::Cursor Lexicon::cursor() const {
+  return Cursor(&trie_);
+}
+
+void Lexicon::containsBatch(const string* words, size_t count, bool* results) const {
+  lookupBatch(words, count, results, true);
+}
+
+vector<bool> Lexicon::containsBatch(const vector<string>& words) const {
+  unique_ptr<bool[]> results(new bool[words.size()]);
+  lookupBatch(words.data(), words.size(), results.get(), true);
+  return vector<bool>(results.get(), results.get() + words.size());
+}
+
+void Lexicon::containsPrefixBatch(const string* prefixes, size_t count,
+    bool* results) const {
+  lookupBatch(prefixes, count, results, false);
+}
+
+vector<bool> Lexicon::containsPrefixBatch(const vector<string>& prefixes) const {
+  unique_ptr<bool[]> results(new bool[prefixes.size()]);
+  lookupBatch(prefixes.data(), prefixes.size(), results.get(), false);
+  return vector<bool>(results.get(), results.get() + prefixes.size());
+}
+
+size_t Lexicon::countWithPrefix(const string& prefix) const {
+  NodeId found = findNode(prefix.data(), prefix.size());
+  return found == TrieArena::kNoNode ? 0 : trie_.wordCount(found);
+}
+
+void Lexicon::decode(const WordId* ids, size_t count, string* words) const {
+  for (size_t i = 0; i < count; ++i)
+    words[i] = select(ids[i]);
+}
+
+vector<string> Lexicon::decode(const vector<WordId>& ids) const {
+  vector<string> words(ids.size());
+  decode(ids.data(), ids.size(), words.data());
+  return words;
+}
+
+void Lexicon::encode(const string* tokens, size_t count, WordId* ids) const {
+  for (size_t i = 0; i < count; ++i) {
+    /* runs of the same token, common in real text, are looked up once */
+    if (i > 0 && tokens[i] == tokens[i - 1]) {
+      ids[i] = ids[i - 1];
+      continue;
+    }
+    bool found;
+    size_t before = countBefore(tokens[i].data(), tokens[i].size(), found);
+    ids[i] = found ? static_cast<WordId>(before) : kNoWord;
+  }
+}
+
+vector<Lexicon::WordId> Lexicon::encode(const vector<string>& tokens) const {
+  vector<WordId> ids(tokens.size());
+  encode(tokens.data(), tokens.size(), ids.data());
+  return ids;
+}
+
+FrozenLexicon Lexicon::freeze() const {
+  /* the walk produces words in sorted order, as the builder requires */
+  FrozenLexicon::Builder builder;
+  string prefix;
+  walkWords(trie_.root(), prefix, [&builder](const string& word) {
+    builder.add(word);
+  });
+  return builder.finish();
+}
+
+vector<Lexicon::FuzzyMatch> Lexicon::fuzzyMatches(const string& query,
+    size_t max_distance) const {
+  vector<FuzzyMatch> matches;
+  size_t columns = query.size() + 1;
+  /* distances are capped here, anything above max_distance is equally bad */
+  size_t cap = max_distance + 1;
+
+  /* rows[d * columns + j] is the distance between the first j letters of
+   * query and the d letters on the path to the node at depth d of the stack */
+  vector<size_t> rows(columns);
+  for (size_t j = 0; j < columns; ++j)
+    rows[j] = min(j, cap);
+  if (trie_.isWord(trie_.root()) && rows[query.size()] <= max_distance)
+    matches.push_back(FuzzyMatch{string(), rows[query.size()]});
+
+  vector<StackElement> stack(1, StackElement{trie_.root(), 0});
+  string prefix;
+  while (!stack.empty()) {
+    StackElement& top = stack.back();
+    if (top.next_child == trie_.numChildren(top.node)) {
+      stack.pop_back();
+      if (!prefix.empty())
+        prefix.pop_back();
+      continue;
+    }
+    size_t i = top.next_child++;
+    char letter = trie_.labels(top.node)[i];
+    NodeId child = trie_.children(top.node)[i];
+
+    size_t depth = stack.size();
+    rows.resize((depth + 1) * columns);
+    const size_t* above = rows.data() + (depth - 1) * columns;
+    size_t* row = rows.data() + depth * columns;
+    row[0] = min(depth, cap);
+    size_t lowest = row[0];
+    for (size_t j = 1; j < columns; ++j) {
+      size_t substitute = above[j - 1] + (query[j - 1] == letter ? 0 : 1);
+      row[j] = min(min(substitute, min(above[j], row[j - 1]) + 1), cap);
+      lowest = min(lowest, row[j]);
+    }
+    /* rows never decrease further down, so nothing below can match */
+    if (lowest > max_distance)
+      continue;
+
+    prefix.push_back(letter);
+    if (trie_.isWord(child) && row[query.size()] <= max_distance)
+      matches.push_back(FuzzyMatch{prefix, row[query.size()]});
+    stack.push_back(StackElement{child, 0});
+  }
+  return matches;
+}
+
+Lexicon::WordId Lexicon::idOf(const string& word) const {
+  bool found;
+  size_t before = countBefore(word.data(), word.size(), found);
+  return found ? static_cast<WordId>(before) : kNoWord;
+}
+
+void Lexicon::intersect(const Lexicon& other, unsigned num_threads) {
+  combine(other, kIntersect, num_threads);
+}
+
+Lexicon Lexicon::intersect(const Lexicon& lhs, const Lexicon& rhs, unsigned num_threads) {
+  Lexicon result(lhs);
+  result.intersect(rhs, num_threads);
+  return result;
 }
 
 bool Lexicon::isEmpty() const {
   return (size() == 0);
 }
 
-void Lexicon::mapAll(function<void (string)> func) const {
-  for (string word : word_set_)
-    func(word);
+void Lexicon::mapAll(const function<void (const string&)>& func) const {
+  string prefix;
+  walkWords(trie_.root(), prefix, func);
+}
+
+/* The pattern runs as a nondeterministic automaton whose states are positions
+ * in the pattern; states[d * positions + p] says whether the path to the node
+ * at depth d of the stack can end at position p.  A frame visits the children
+ * in [next_child, end_child), which is a single child when every live
+ * position expects the same literal letter.
+ */
+void Lexicon::matchPattern(const string& pattern,
+    const function<void (const string&)>& func, size_t min_length,
+    size_t max_length) const {
+  typedef struct PatternFrame {
+    NodeId node;
+    size_t next_child;
+    size_t end_child;
+  } PatternFrame;
+  size_t positions = pattern.size() + 1;
+  vector<char> states(positions, 0);
+  vector<PatternFrame> stack;
+  string prefix;
+
+  /* a '*' may match nothing, so reaching it also reaches what follows it */
+  auto close = [&pattern](char* live) {
+    for (size_t p = 0; p < pattern.size(); ++p)
+      if (live[p] && pattern[p] == '*')
+        live[p + 1] = 1;
+  };
+  /* report the node on top of the path and decide which children to visit */
+  auto enter = [&](NodeId node) {
+    const char* live = states.data() + prefix.size() * positions;
+    if (live[pattern.size()] && trie_.isWord(node) && prefix.size() >= min_length)
+      func(prefix);
+    PatternFrame frame{node, 0, trie_.numChildren(node)};
+    if (prefix.size() == max_length)
+      frame.end_child = 0;
+    /* -1 while no position is live, -2 once the letters differ */
+    int letter = -1;
+    for (size_t p = 0; p < pattern.size() && letter != -2; ++p) {
+      if (!live[p])
+        continue;
+      int literal = static_cast<unsigned char>(pattern[p]);
+      if (pattern[p] == '?' || pattern[p] == '*' || (letter >= 0 && literal != letter))
+        letter = -2;
+      else
+        letter = literal;
+    }
+    if (letter == -1) {
+      frame.end_child = 0;
+    }
+    else if (letter >= 0 && frame.end_child) {
+      const char* labels = trie_.labels(node);
+      frame.next_child = find(labels, labels + frame.end_child,
+          static_cast<char>(letter)) - labels;
+      frame.end_child = min(frame.end_child, frame.next_child + 1);
+    }
+    stack.push_back(frame);
+  };
+
+  states[0] = 1;
+  close(states.data());
+  enter(trie_.root());
+  while (!stack.empty()) {
+    PatternFrame& top = stack.back();
+    if (top.next_child >= top.end_child) {
+      stack.pop_back();
+      if (!prefix.empty())
+        prefix.pop_back();
+      continue;
+    }
+    size_t i = top.next_child++;
+    char letter = trie_.labels(top.node)[i];
+    NodeId child = trie_.children(top.node)[i];
+
+    size_t depth = prefix.size() + 1;
+    states.resize((depth + 1) * positions);
+    const char* live = states.data() + (depth - 1) * positions;
+    char* next = states.data() + depth * positions;
+    fill(next, next + positions, 0);
+    bool any = false;
+    for (size_t p = 0; p < pattern.size(); ++p) {
+      if (!live[p])
+        continue;
+      if (pattern[p] == '*')
+        next[p] = any = true;
+      else if (pattern[p] == '?' || pattern[p] == letter)
+        next[p + 1] = any = true;
+    }
+    if (!any)
+      continue;
+    close(next);
+    prefix.push_back(letter);
+    enter(child);
+  }
+}
+
+FrozenLexicon Lexicon::mapFile(const string& filename) {
+  return FrozenLexicon::mapFile(filename);
+}
+
+size_t Lexicon::rank(const string& word) const {
+  bool found;
+  return countBefore(word.data(), word.size(), found);
 }
 
 bool Lexicon::remove (const string& word) {
-  return removePrefixHelper(word, 0, root_.get(), false);
+  return remove(word.data(), word.size());
+}
+
+bool Lexicon::remove (const char* word, size_t length) {
+  if (!findPath(word, length) || !trie_.isWord(path_.back()))
+    return false;
+  /* a word that is also a prefix keeps its node, but not its weight */
+  NodeId node = path_.back();
+  trie_.setWord(node, false);
+  if (trie_.hasWeights())
+    trie_.setWeight(node, 0);
+  uncountWords(word, 1);
+  --size_;
+  if (trie_.hasWeights())
+    updateMaxWeights(word, length);
+  LEXICON_COUNT(kRemovals, 1);
+  return true;
 }
 
-bool Lexicon::removePrefix (const string& prefix) {
-  return removePrefixHelper(prefix, 0, root_.get(), true);
+size_t Lexicon::removePrefix (const string& prefix) {
+  return removePrefix(prefix.data(), prefix.size());
+}
+
+size_t Lexicon::removePrefix (const char* prefix, size_t length) {
+  size_t removed = size_;
+  /* every word starts with the empty prefix */
+  if (length == 0) {
+    if (isEmpty())
+      return 0;
+    LEXICON_COUNT(kRemovals, 1);
+    LEXICON_COUNT(kNodesReleased, trie_.nodeCount() - 1);
+    clear();
+    return removed;
+  }
+  if (!findPath(prefix, length))
+    return 0;
+  /* only the root may be without words, so the prefix always covers some */
+  removed = trie_.wordCount(path_.back());
+  uncountWords(prefix, removed);
+  size_ -= removed;
+  if (trie_.hasWeights())
+    updateMaxWeights(prefix, length);
+  LEXICON_COUNT(kRemovals, 1);
+  return removed;
+}
+
+bool Lexicon::save(const string& filename) const {
+  return freeze().save(filename);
+}
+
+string Lexicon::select(size_t index) const {
+  if (index >= size_)
+    throw out_of_range("Lexicon::select: index out of range");
+  string word;
+  NodeId node = trie_.root();
+  while (true) {
+    if (trie_.isWord(node)) {
+      if (index == 0)
+        return word;
+      --index;
+    }
+    /* skip the children whose words all come before the one we want */
+    const NodeId* children = trie_.children(node);
+    size_t i = 0;
+    while (index >= trie_.wordCount(children[i]))
+      index -= trie_.wordCount(children[i++]);
+    word.push_back(trie_.labels(node)[i]);
+    node = children[i];
+  }
 }
 
 size_t Lexicon::size() const {
   return size_;
 }
 
+Lexicon::Stats Lexicon::stats() const {
+  Stats stats;
+  stats.words = size_;
+  stats.nodes = 0;
+  stats.edges = 0;
+  stats.bytes = trie_.usage();
+
+  vector<StackElement> stack(1, StackElement{trie_.root(), 0});
+  string prefix;
+  while (!stack.empty()) {
+    StackElement& top = stack.back();
+    if (top.next_child == 0) {
+      /* first visit of the node on top */
+      size_t fanout = trie_.numChildren(top.node);
+      ++stats.nodes;
+      stats.edges += fanout;
+      if (stats.depth_histogram.size() <= prefix.size())
+        stats.depth_histogram.resize(prefix.size() + 1, 0);
+      ++stats.depth_histogram[prefix.size()];
+      if (stats.fanout_histogram.size() <= fanout)
+        stats.fanout_histogram.resize(fanout + 1, 0);
+      ++stats.fanout_histogram[fanout];
+      if (trie_.isWord(top.node) && prefix.size() > stats.longest_word.size())
+        stats.longest_word = prefix;
+    }
+    if (top.next_child == trie_.numChildren(top.node)) {
+      stack.pop_back();
+      if (!prefix.empty())
+        prefix.pop_back();
+      continue;
+    }
+    size_t i = top.next_child++;
+    prefix.push_back(trie_.labels(top.node)[i]);
+    stack.push_back(StackElement{trie_.children(top.node)[i], 0});
+  }
+  return stats;
+}
+
+void Lexicon::subtract(const Lexicon& other, unsigned num_threads) {
+  combine(other, kSubtract, num_threads);
+}
+
+Lexicon Lexicon::subtract(const Lexicon& lhs, const Lexicon& rhs, unsigned num_threads) {
+  Lexicon result(lhs);
+  result.subtract(rhs, num_threads);
+  return result;
+}
+
 set<string> Lexicon::toSTLSet() {
-  return word_set_;
+  /* words come out of the walk in sorted order, so each insert is at the end */
+  set<string> word_set;
+  string prefix;
+  walkWords(trie_.root(), prefix, [&word_set](const string& word) {
+    word_set.insert(word_set.end(), word);
+  });
+  return word_set;
+}
+
+vector<string> Lexicon::topCompletions(const string& prefix, size_t k) const {
+  vector<string> completions;
+  NodeId start = findNode(prefix.data(), prefix.size());
+  if (start == TrieArena::kNoNode || k == 0)
+    return completions;
+
+  /* a candidate is either a finished word or a whole subtree, ranked by the
+   * best weight it can still yield.  Ties go to the smaller string, and a
+   * word to its own subtree, so equal weights come out in sorted order */
+  typedef struct Candidate {
+    uint32_t weight;
+    bool is_word;
+    NodeId node;
+    string text;
+  } Candidate;
+  auto later = [](const Candidate& l, const Candidate& r) {
+    if (l.weight != r.weight)
+      return l.weight < r.weight;
+    int order = l.text.compare(r.text);
+    return order != 0 ? order > 0 : !l.is_word && r.is_word;
+  };
+  vector<Candidate> heap;
+  heap.push_back(Candidate{trie_.maxWeight(start), false, start, prefix});
+
+  while (!heap.empty() && completions.size() < k) {
+    pop_heap(heap.begin(), heap.end(), later);
+    Candidate best = move(heap.back());
+    heap.pop_back();
+    if (best.is_word) {
+      completions.push_back(move(best.text));
+      continue;
+    }
+    NodeId node = best.node;
+    if (trie_.isWord(node)) {
+      heap.push_back(Candidate{trie_.weight(node), true, node, best.text});
+      push_heap(heap.begin(), heap.end(), later);
+    }
+    const char* labels = trie_.labels(node);
+    const NodeId* children = trie_.children(node);
+    for (size_t i = 0; i < trie_.numChildren(node); ++i) {
+      heap.push_back(Candidate{trie_.maxWeight(children[i]), false, children[i],
+          best.text + labels[i]});
+      push_heap(heap.begin(), heap.end(), later);
+    }
+  }
+  return completions;
 }
 
 string Lexicon::toString() const {
   string lexicon_str;
-  for (auto& word:word_set_) {
-    lexicon_str += "{" + word + "}, ";
+  string prefix;
+  walkWords(trie_.root(), prefix, [&lexicon_str](const string& word) {
+    lexicon_str.append("{").append(word).append("}, ");
+  });
+  if (!lexicon_str.empty())
+    lexicon_str.resize(lexicon_str.length() - 2);
+  return lexicon_str;
+}
+
+void Lexicon::unite(const Lexicon& other, unsigned num_threads) {
+  combine(other, kUnite, num_threads);
+}
+
+Lexicon Lexicon::unite(const Lexicon& lhs, const Lexicon& rhs, unsigned num_threads) {
+  Lexicon result(lhs);
+  result.unite(rhs, num_threads);
+  return result;
+}
+
+uint32_t Lexicon::weight(const string& word) const {
+  NodeId found = findNode(word.data(), word.size());
+  return found != TrieArena::kNoNode && trie_.isWord(found) ? trie_.weight(found) : 0;
+}
+
+vector<string> Lexicon::wordsBetween(const string& lo, const string& hi) const {
+  vector<string> words;
+  if (!(lo < hi))
+    return words;
+  if (lo.empty() && trie_.isWord(trie_.root()))
+    words.push_back(lo);
+
+  /* set up the walk as if it had just reached lo: every node on the path of lo
+   * continues with its first child past the letter of lo */
+  vector<StackElement> walk_stack(1, StackElement{trie_.root(), 0});
+  string prefix;
+  for (size_t i = 0; i < lo.size(); ++i) {
+    StackElement& top = walk_stack.back();
+    const char* labels = trie_.labels(top.node);
+    size_t pos = labelPosition(labels, trie_.numChildren(top.node), lo[i]);
+    top.next_child = pos;
+    if (pos == trie_.numChildren(top.node) || labels[pos] != lo[i])
+      break;
+    ++top.next_child;
+    NodeId child = trie_.children(top.node)[pos];
+    prefix.push_back(lo[i]);
+    if (i + 1 == lo.size() && trie_.isWord(child))
+      words.push_back(prefix);
+    walk_stack.push_back(StackElement{child, 0});
+  }
+
+  while (!walk_stack.empty()) {
+    StackElement& top = walk_stack.back();
+    if (top.next_child == trie_.numChildren(top.node)) {
+      walk_stack.pop_back();
+      if (!walk_stack.empty())
+        prefix.pop_back();
+      continue;
+    }
+    size_t i = top.next_child++;
+    NodeId child = trie_.children(top.node)[i];
+    prefix.push_back(trie_.labels(top.node)[i]);
+    /* every word below a node at or past hi is also past hi */
+    if (!(prefix < hi))
+      break;
+    if (trie_.isWord(child))
+      words.push_back(prefix);
+    walk_stack.push_back(StackElement{child, 0});
   }
-  return lexicon_str.substr(0,lexicon_str.length()-2);
+  return words;
+}
+
+string Lexicon::wordOf(WordId id) const {
+  return select(id);
 }
 
 ostream& operator <<(ostream& out, const Lexicon& lex) {
@@ -82,129 +742,479 @@ ostream& operator <<(ostream& out, const Lexicon& lex) {
   return out;
 }
 
-bool Lexicon::removePrefixHelper(const string& prefix, int prefix_index, 
-    TrieNode* curr, bool isPrefix) {
-  /* curr only becomes null when we cannot find the prefix */
-  if (curr != nullptr) {
-    SuffixesTItr suffixes_itr = curr->suffixes.find(prefix[prefix_index]);
-    /* if current prefix letter is not found then quit recursion and return false */
-    if (suffixes_itr != curr->suffixes.end()) {
-      /* base case: we have matched the prefix or word to remove */
-      /* curr is now at the node that contains the last letter in the prefix */
-      if (prefix_index == prefix.size() - 1) {
-        /* if..else logic only removes the word from the tree if it is not a prefix
-         * when it is a prefix the entire substree of the prefix is removed */
-        if (!isPrefix) {
-          /* if word is a leaf then remove it, otherwise simply mark it as not a word.
-           * When not a leaf it means that it is also a prefix
-           * for bigger words (e.g cat is a prefix for catepillar). */
-          if (suffixes_itr->second->suffixes.empty())
-            curr->suffixes.erase(suffixes_itr);
-          else
-            suffixes_itr->second->isWord = false;
-          /* in both cases the word needs to be removed from the word set */
-          word_set_.erase(prefix);
-          --size_;
-        }
-        else { /* isPrefix */
-          /* store info on first element to remove and put it on the delete stack */
-          stack<StackElement> delete_stack;;
-          char first_suffix = suffixes_itr->second->suffixes.begin()->first;
-          delete_stack.push({suffixes_itr->second.get(), 
-              prefix + first_suffix,
-              suffixes_itr->second->suffixes.begin()});
-          /* Remove subtree of current suffix (this updates size and word_set_) */
-          removeSubtree(&delete_stack);
-          /* After removeSubstree the node of the last suffix of prefix is empty.
-           * Therefore the last suffix of the prefix must also be removed
-           * from the tree */
-          curr->suffixes.erase(suffixes_itr);
-        }
-        return true;
+size_t Lexicon::countBefore(const char* word, size_t length, bool& found) const {
+  size_t before = 0;
+  NodeId node = trie_.root();
+  found = false;
+  for (size_t l = 0; l < length; ++l) {
+    /* the word of this node is a proper prefix of word, so it sorts first,
+     * and so does everything below the children with smaller labels */
+    if (trie_.isWord(node))
+      ++before;
+    const char* labels = trie_.labels(node);
+    const NodeId* children = trie_.children(node);
+    size_t pos = labelPosition(labels, trie_.numChildren(node), word[l]);
+    for (size_t i = 0; i < pos; ++i)
+      before += trie_.wordCount(children[i]);
+    if (pos == trie_.numChildren(node) || labels[pos] != word[l])
+      return before;
+    node = children[pos];
+  }
+  found = trie_.isWord(node);
+  return before;
+}
+
+bool Lexicon::findPath(const char* key, size_t length) {
+  path_.assign(1, trie_.root());
+  for (size_t i = 0; i < length; ++i) {
+    NodeId next = trie_.child(path_.back(), key[i]);
+    if (next == TrieArena::kNoNode)
+      return false;
+    path_.push_back(next);
+  }
+  return true;
+}
+
+void Lexicon::uncountWords(const char* key, size_t count) {
+  trie_.setWordCount(path_[0], trie_.wordCount(path_[0]) - count);
+  for (size_t depth = 1; depth < path_.size(); ++depth) {
+    NodeId node = path_[depth];
+    uint32_t left = trie_.wordCount(node) - static_cast<uint32_t>(count);
+    if (left == 0) {
+      /* nothing below here leads to a word any more: drop the dead branch
+       * with a single cut, whatever its depth */
+      trie_.removeChild(path_[depth - 1], key[depth - 1]);
+      path_.resize(depth);
+      return;
+    }
+    trie_.setWordCount(node, left);
+  }
+}
+
+/* Each lane walks one key.  A step of a lane alternates between two stages so
+ * that no lane ever waits on memory it has not prefetched a round earlier:
+ * first the record of the current node is read and its child block is
+ * prefetched, then the child block is searched and the record of the next
+ * node is prefetched.  With kBatchLanes lanes, up to that many misses are in
+ * flight at once.
+ */
+void Lexicon::lookupBatch(const string* keys, size_t count, bool* results,
+    bool whole_word) const {
+  LEXICON_COUNT(kLookups, count);
+  typedef struct Lane {
+    size_t key;
+    size_t position;
+    NodeId node;
+    bool children_loaded;
+  } Lane;
+  Lane lanes[kBatchLanes];
+  size_t active = 0;
+  size_t next_key = 0;
+
+  /* start a lane on the next key, answering keys that need no walk at once */
+  auto refill = [&](Lane& lane) -> bool {
+    while (next_key < count) {
+      size_t key = next_key++;
+      if (keys[key].empty()) {
+        results[key] = whole_word ? trie_.isWord(trie_.root()) : !isEmpty();
+        continue;
+      }
+      lane.key = key;
+      lane.position = 0;
+      lane.node = trie_.root();
+      lane.children_loaded = false;
+      return true;
+    }
+    return false;
+  };
+
+  while (active < kBatchLanes && refill(lanes[active]))
+    ++active;
+
+  while (active > 0) {
+    for (size_t i = 0; i < active; ) {
+      Lane& lane = lanes[i];
+      if (!lane.children_loaded) {
+        trie_.prefetchChildren(lane.node);
+        lane.children_loaded = true;
+        ++i;
+        continue;
       }
-      /* recursive case: advance prefix position and traverse deeper into the tree */
-      if (removePrefixHelper(prefix, ++prefix_index, suffixes_itr->second.get(),
-          isPrefix)) {
-        /* if this node is now a empty then we can remove its associated suffix */
-        if (suffixes_itr->second->suffixes.empty())
-          curr->suffixes.erase(suffixes_itr);
-        return true;
+      const string& key = keys[lane.key];
+      lane.node = trie_.child(lane.node, key[lane.position++]);
+      lane.children_loaded = false;
+      bool done = lane.node == TrieArena::kNoNode || lane.position == key.size();
+      if (!done) {
+        trie_.prefetchNode(lane.node);
+        ++i;
+        continue;
       }
+      results[lane.key] = lane.node != TrieArena::kNoNode &&
+        (!whole_word || trie_.isWord(lane.node));
+      /* reuse the lane, or close the gap with the last active lane */
+      if (!refill(lane))
+        lane = lanes[--active];
     }
   }
-  return false;
 }
 
-/* Just for fun: this function is implemented using tail recursion by using 
- * an explicit stack.  This allows the compiler to optimize out the implicit 
- * function call stack 
- */
-void Lexicon::removeSubtree (stack<StackElement>* delete_stack_ptr) {
-  /* it's easier to work with a reference */
-  stack<StackElement>& delete_stack = *delete_stack_ptr;
-  /* when the delete stack is empty we are done */
-  if (!delete_stack.empty()) {
-
-    StackElement stack_top = delete_stack.top();
-
-    /* Base case: TrieNode of current suffix is empty */
-    if (stack_top.suffix->second->suffixes.empty()) {
-      /* if this prefix was a word then delete it */
-      if (stack_top.suffix->second->isWord) {
-        word_set_.erase(stack_top.prefix);
-        --size_;
+void Lexicon::addAlongPath(const char* word, size_t length, vector<NodeId>& path,
+    string& previous) {
+  /* nodes are only ever added while loading, so the path of the previous
+   * word is still valid up to the letters both words share */
+  size_t common = 0;
+  size_t limit = min(length, previous.size());
+  while (common < limit && word[common] == previous[common])
+    ++common;
+  path.resize(common + 1);
+  for (size_t i = common; i < length; ++i)
+    path.push_back(trie_.addChild(path.back(), word[i]));
+
+  NodeId node = path.back();
+  if (!trie_.isWord(node)) {
+    trie_.setWord(node, true);
+    for (NodeId n : path)
+      trie_.setWordCount(n, trie_.wordCount(n) + 1);
+    ++size_;
+  }
+  previous.assign(word, length);
+}
+
+void Lexicon::parallelLoad(const vector<char>& text, unsigned num_threads) {
+  /* partition the lines by leading byte */
+  typedef pair<const char*, size_t> Line;
+  vector<vector<Line>> buckets(256);
+  vector<size_t> bucket_bytes(256, 0);
+  bool has_empty_word = false;
+  forEachLine(text.data(), text.size(), true, [&](const char* word, size_t length) {
+    if (length == 0) {
+      has_empty_word = true;
+      return;
+    }
+    unsigned char first = static_cast<unsigned char>(word[0]);
+    buckets[first].push_back(Line(word, length));
+    bucket_bytes[first] += length;
+  });
+
+  /* hand the biggest buckets out first, each to the least loaded thread */
+  vector<unsigned> order;
+  for (unsigned b = 0; b < 256; ++b)
+    if (!buckets[b].empty())
+      order.push_back(b);
+  vector<vector<unsigned>> assignment = assignLoads(order, bucket_bytes, num_threads);
+  num_threads = static_cast<unsigned>(assignment.size());
+
+  /* each thread builds its buckets into a private lexicon */
+  vector<future<Lexicon>> parts;
+  for (unsigned t = 0; t < num_threads; ++t) {
+    const vector<unsigned>& mine = assignment[t];
+    parts.push_back(async(launch::async, [&buckets, &mine] {
+      Lexicon part;
+      vector<NodeId> path(1, part.trie_.root());
+      string previous;
+      for (unsigned b : mine)
+        for (const Line& line : buckets[b])
+          part.addAlongPath(line.first, line.second, path, previous);
+      return part;
+    }));
+  }
+
+  /* the partitions are disjoint, so their subtrees splice under the root */
+  for (future<Lexicon>& future_part : parts) {
+    Lexicon part = future_part.get();
+    trie_.splice(trie_.root(), part.trie_);
+    size_ += part.size_;
+  }
+  if (has_empty_word) {
+    trie_.setWord(trie_.root(), true);
+    ++size_;
+  }
+  trie_.setWordCount(trie_.root(), static_cast<uint32_t>(size_));
+}
+
+void Lexicon::combine(const Lexicon& other, SetOperation operation, unsigned num_threads) {
+  if (&other == this) {
+    if (operation == kSubtract)
+      clear();
+    return;
+  }
+  if (num_threads == 0)
+    num_threads = max(thread::hardware_concurrency(), 1u);
+  if (operation == kUnite && other.trie_.hasWeights())
+    trie_.enableWeights();
+  const TrieArena& rhs = other.trie_;
+  NodeId root = trie_.root();
+
+  /* the branches below the root that need work, and how many words they hold */
+  vector<unsigned> branches;
+  vector<size_t> loads(256, 0);
+  for (size_t i = 0; i < rhs.numChildren(rhs.root()); ++i) {
+    char label = rhs.labels(rhs.root())[i];
+    NodeId child = trie_.child(root, label);
+    if (child == TrieArena::kNoNode && operation != kUnite)
+      continue;
+    unsigned letter = static_cast<unsigned char>(label);
+    branches.push_back(letter);
+    loads[letter] = rhs.wordCount(rhs.children(rhs.root())[i]) +
+      (child == TrieArena::kNoNode ? 0 : trie_.wordCount(child));
+  }
+  if (operation == kIntersect) {
+    /* branches the other side does not have go as a whole */
+    for (size_t i = trie_.numChildren(root); i-- > 0; ) {
+      char label = trie_.labels(root)[i];
+      if (rhs.child(rhs.root(), label) == TrieArena::kNoNode)
+        trie_.removeChild(root, label);
+    }
+  }
+
+  if (num_threads == 1 || branches.size() < 2) {
+    for (unsigned letter : branches) {
+      char label = static_cast<char>(letter);
+      NodeId child = trie_.child(root, label);
+      NodeId other_child = rhs.child(rhs.root(), label);
+      if (child == TrieArena::kNoNode)
+        copyBranch(root, label, rhs, other_child);
+      else if (combineBranch(child, rhs, other_child, operation) == 0)
+        trie_.removeChild(root, label);
+    }
+  }
+  else {
+    /* the branches are disjoint, so each thread combines its shared branches
+     * in place.  Nothing is added to or released from the tree meanwhile;
+     * the cuts and copies below the root are done here afterwards, and only
+     * the branches other alone has are copied, into a private lexicon */
+    vector<vector<unsigned>> assignment = assignLoads(branches, loads, num_threads);
+    typedef struct Work {
+      vector<NodeId> children;
+      vector<NodeId> other_children;
+      vector<char> labels;
+      vector<size_t> counts;
+      vector<DeferredEdit> deferred;
+      Lexicon part;
+    } Work;
+    vector<Work> work(assignment.size());
+    for (size_t t = 0; t < assignment.size(); ++t) {
+      for (unsigned letter : assignment[t]) {
+        char label = static_cast<char>(letter);
+        work[t].labels.push_back(label);
+        work[t].children.push_back(trie_.child(root, label));
+        work[t].other_children.push_back(rhs.child(rhs.root(), label));
       }
-      /* delete this suffix from current node. */
-      SuffixesTItr next_suffix = stack_top.node->suffixes.erase(stack_top.suffix);
-      /* once an element is deleted we can pop its info from the stack */
-      delete_stack.pop();
-      /* if there is a next suffix in current node, push it onto the stack */
-      if (next_suffix != stack_top.node->suffixes.end()) {
-        string next_prefix = stack_top.prefix.substr(0,stack_top.prefix.length()-1)
-          + next_suffix->first;
-        delete_stack.push({stack_top.node, next_prefix, next_suffix});
+      if (trie_.hasWeights())
+        work[t].part.trie_.enableWeights();
+    }
+    vector<future<void>> done;
+    for (Work& mine : work) {
+      done.push_back(async(launch::async, [this, &rhs, &mine, operation] {
+        for (size_t i = 0; i < mine.labels.size(); ++i) {
+          if (mine.children[i] == TrieArena::kNoNode)
+            mine.part.copyBranch(mine.part.trie_.root(), mine.labels[i], rhs,
+                mine.other_children[i]);
+          else
+            mine.counts.push_back(combineBranch(mine.children[i], rhs,
+                mine.other_children[i], operation, &mine.deferred));
+        }
+      }));
+    }
+    for (future<void>& worker : done)
+      worker.get();
+
+    for (Work& mine : work) {
+      for (const DeferredEdit& edit : mine.deferred) {
+        if (edit.other == TrieArena::kNoNode)
+          trie_.removeChild(edit.node, edit.label);
+        else
+          copyBranch(edit.node, edit.label, rhs, edit.other);
+      }
+      size_t next_count = 0;
+      for (size_t i = 0; i < mine.labels.size(); ++i)
+        if (mine.children[i] != TrieArena::kNoNode && mine.counts[next_count++] == 0)
+          trie_.removeChild(root, mine.labels[i]);
+      trie_.splice(root, mine.part.trie_);
+    }
+  }
+
+  /* the empty word lives in the root */
+  combineWord(root, rhs, rhs.root(), operation);
+  size_ = recount(root);
+}
+
+size_t Lexicon::combineBranch(NodeId node, const TrieArena& other, NodeId other_node,
+    SetOperation operation, vector<DeferredEdit>* deferred) {
+  vector<CombineElement> stack(1, CombineElement{node, other_node, 0, '\0', 0, 0});
+  bool first_visit = true;
+  size_t count = 0;
+  /* a deferred cut leaves the child in place, emptied for recount */
+  auto cut = [this, deferred](NodeId parent, char label, NodeId child) {
+    if (!deferred) {
+      trie_.removeChild(parent, label);
+      return;
+    }
+    deferred->push_back(DeferredEdit{parent, label, TrieArena::kNoNode});
+    trie_.setWordCount(child, 0);
+    if (trie_.hasWeights())
+      trie_.setMaxWeight(child, 0);
+  };
+  while (!stack.empty()) {
+    CombineElement& top = stack.back();
+    if (first_visit) {
+      /* intersect walks the children from the back, so that cutting one off
+       * does not move those still to come */
+      combineWord(top.node, other, top.other, operation);
+      if (operation == kIntersect)
+        top.next_child = trie_.numChildren(top.node);
+      first_visit = false;
+    }
+
+    NodeId child = TrieArena::kNoNode;
+    NodeId other_child = TrieArena::kNoNode;
+    char label = '\0';
+    if (operation == kIntersect) {
+      while (top.next_child > 0 && child == TrieArena::kNoNode) {
+        size_t i = --top.next_child;
+        label = trie_.labels(top.node)[i];
+        other_child = other.child(top.other, label);
+        if (other_child == TrieArena::kNoNode)
+          cut(top.node, label, trie_.children(top.node)[i]);
+        else
+          child = trie_.children(top.node)[i];
       }
     }
-    /* Recusive case: TrieNode of current suffix has suffixes of its own */
     else {
-      /* push child info onto the stack to move deeper into the prefix tree */
-      TrieNode* next_node = stack_top.suffix->second.get();
-      SuffixesTItr next_suffix = next_node->suffixes.begin();
-      string next_prefix = stack_top.prefix + next_suffix->first;
-      delete_stack.push({next_node, next_prefix, next_suffix});
+      /* only the branches of other can change anything */
+      while (top.next_child < other.numChildren(top.other) && child == TrieArena::kNoNode) {
+        size_t i = top.next_child++;
+        label = other.labels(top.other)[i];
+        other_child = other.children(top.other)[i];
+        child = trie_.child(top.node, label);
+        if (child != TrieArena::kNoNode || operation != kUnite)
+          continue;
+        if (!deferred) {
+          copyBranch(top.node, label, other, other_child);
+          continue;
+        }
+        deferred->push_back(DeferredEdit{top.node, label, other_child});
+        top.deferred_words += other.wordCount(other_child);
+        top.deferred_weight = max(top.deferred_weight, other.maxWeight(other_child));
+      }
+    }
+
+    if (child != TrieArena::kNoNode) {
+      stack.push_back(CombineElement{child, other_child, 0, label, 0, 0});
+      first_visit = true;
+      continue;
     }
 
-    /* tail recursive call to remove subtree */
-    removeSubtree(&delete_stack);
+    /* all children are done */
+    CombineElement done = top;
+    stack.pop_back();
+    count = recount(done.node);
+    if (done.deferred_words) {
+      count += done.deferred_words;
+      trie_.setWordCount(done.node, static_cast<uint32_t>(count));
+      if (trie_.hasWeights())
+        trie_.setMaxWeight(done.node, max(trie_.maxWeight(done.node), done.deferred_weight));
+    }
+    if (count == 0 && !stack.empty())
+      cut(stack.back().node, done.label, done.node);
+  }
+  return count;
+}
+
+void Lexicon::combineWord(NodeId node, const TrieArena& other, NodeId other_node,
+    SetOperation operation) {
+  bool word = trie_.isWord(node);
+  bool other_word = other.isWord(other_node);
+  bool keep = operation == kUnite ? word || other_word :
+    operation == kIntersect ? word && other_word : word && !other_word;
+  if (keep == word)
+    return;
+  trie_.setWord(node, keep);
+  /* a word that is also a prefix keeps its node, but not its weight */
+  if (trie_.hasWeights())
+    trie_.setWeight(node, keep ? other.weight(other_node) : 0);
+}
+
+void Lexicon::copyBranch(NodeId node, char label, const TrieArena& source, NodeId source_node) {
+  typedef pair<NodeId, NodeId> Copy;
+  vector<Copy> stack(1, Copy(source_node, trie_.addChild(node, label)));
+  bool weights = trie_.hasWeights() && source.hasWeights();
+  while (!stack.empty()) {
+    Copy top = stack.back();
+    stack.pop_back();
+    trie_.setWord(top.second, source.isWord(top.first));
+    trie_.setWordCount(top.second, source.wordCount(top.first));
+    if (weights) {
+      trie_.setWeight(top.second, source.weight(top.first));
+      trie_.setMaxWeight(top.second, source.maxWeight(top.first));
+    }
+    for (size_t i = 0; i < source.numChildren(top.first); ++i) {
+      NodeId copy = trie_.addChild(top.second, source.labels(top.first)[i]);
+      stack.push_back(Copy(source.children(top.first)[i], copy));
+    }
   }
 }
 
-const Lexicon::TrieNode* Lexicon::findNode(const std::string& str) const {
-  TrieNode* curr = root_.get();
-  for (int i = 0; i < str.size() && curr; ++i) {
-    char c = str[i];
-    SuffixesTConstItr suffixes_itr = curr->suffixes.find(c);    
-    curr = suffixes_itr != curr->suffixes.end() ? suffixes_itr->second.get() : nullptr;
+size_t Lexicon::recount(NodeId node) {
+  size_t count = trie_.isWord(node) ? 1 : 0;
+  uint32_t best = trie_.isWord(node) ? trie_.weight(node) : 0;
+  const NodeId* children = trie_.children(node);
+  for (size_t i = 0; i < trie_.numChildren(node); ++i) {
+    count += trie_.wordCount(children[i]);
+    best = max(best, trie_.maxWeight(children[i]));
   }
+  trie_.setWordCount(node, static_cast<uint32_t>(count));
+  if (trie_.hasWeights())
+    trie_.setMaxWeight(node, best);
+  return count;
+}
+
+Lexicon::NodeId Lexicon::findNode(const char* str, size_t length) const {
+  NodeId curr = trie_.root();
+  for (size_t i = 0; i < length && curr != TrieArena::kNoNode; ++i)
+    curr = trie_.child(curr, str[i]);
   return curr;
 }
 
-Lexicon::TrieNode* Lexicon::ensureNodeExists(const std::string& str) {
-  if (!root_)
-    root_.reset(new TrieNode);
- 
-  TrieNode* curr = root_.get();
-  for (char c: str) {
-    /* if current character is not found in the node, add the character to this node
-     * and create a child node for this character */
-    SuffixesTItr  map_itr = curr->suffixes.find(c);
-    if (map_itr == curr->suffixes.end()) 
-      curr->suffixes[c] = unique_ptr<TrieNode> (new TrieNode);
-    
-    /* move down the tree */
-    curr = curr->suffixes.at(c).get();
-  }
+Lexicon::NodeId Lexicon::findNode(const char* str, size_t length,
+    const KeyNormalizer& normalizer) const {
+  NodeId curr = trie_.root();
+  normalizer.forEachByte(str, length, [this, &curr](char letter) {
+    curr = trie_.child(curr, letter);
+    return curr != TrieArena::kNoNode;
+  });
   return curr;
 }
 
+void Lexicon::updateMaxWeights(const char* key, size_t length) {
+  /* removals may have pruned the end of the path */
+  vector<NodeId>& path = path_;
+  path.assign(1, trie_.root());
+  for (size_t i = 0; i < length; ++i) {
+    NodeId next = trie_.child(path.back(), key[i]);
+    if (next == TrieArena::kNoNode)
+      break;
+    path.push_back(next);
+  }
 
+  while (!path.empty()) {
+    NodeId node = path.back();
+    path.pop_back();
+    uint32_t best = trie_.isWord(node) ? trie_.weight(node) : 0;
+    const NodeId* children = trie_.children(node);
+    for (size_t i = 0; i < trie_.numChildren(node); ++i)
+      best = max(best, trie_.maxWeight(children[i]));
+    if (best == trie_.maxWeight(node))
+      break;
+    trie_.setMaxWeight(node, best);
+  }
+}
+
+Lexicon::NodeId Lexicon::ensureNodeExists(const char* str, size_t length) {
+  path_.assign(1, trie_.root());
+  /* add a child node for every character that is not found yet and move down
+   * the tree */
+  for (size_t i = 0; i < length; ++i)
+    path_.push_back(trie_.addChild(path_.back(), str[i]));
+  return path_.back();
+}
@@ -0,0 +1,15 @@
+#include <LexiconCounters.h>
+using namespace std;
+
+#if defined(LEXICON_ENABLE_COUNTERS)
+const bool LexiconCounters::kEnabled = true;
+#else
+const bool LexiconCounters::kEnabled = false;
+#endif
+
+atomic<uint64_t> LexiconCounters::counts_[kNumCounters];
+
+void LexiconCounters::reset() {
+  for (atomic<uint64_t>& count : counts_)
+    count.store(0);
+}
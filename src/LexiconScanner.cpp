@@ -0,0 +1,118 @@
+#include <LexiconScanner.h>
+#include <Lexicon.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+const uint32_t LexiconScanner::kMatchBit;
+const uint32_t LexiconScanner::kNoState;
+
+LexiconScanner::LexiconScanner(const Lexicon& lex) {
+  const TrieArena& trie = lex.trie_;
+
+  /* number the prefixes breadth first, so that a state's failure target,
+   * being shorter, always comes before it */
+  vector<TrieArena::NodeId> nodes(1, trie.root());
+  vector<uint32_t> depths(1, 0);
+  bool used[256] = {false};
+  for (size_t s = 0; s < nodes.size(); ++s) {
+    const char* labels = trie.labels(nodes[s]);
+    const TrieArena::NodeId* children = trie.children(nodes[s]);
+    for (size_t i = 0; i < trie.numChildren(nodes[s]); ++i) {
+      used[static_cast<unsigned char>(labels[i])] = true;
+      nodes.push_back(children[i]);
+      depths.push_back(depths[s] + 1);
+    }
+  }
+
+  /* bytes that start no edge all behave the same and share column 0 */
+  num_classes_ = 1;
+  for (unsigned b = 0; b < 256; ++b)
+    byte_classes_[b] = used[b] ? static_cast<uint8_t>(num_classes_++) : 0;
+  if (static_cast<double>(nodes.size()) * num_classes_ >= kMatchBit)
+    throw length_error("LexiconScanner: lexicon is too large");
+
+  uint32_t num_states = static_cast<uint32_t>(nodes.size());
+  uint32_t num_classes = static_cast<uint32_t>(num_classes_);
+  transitions_.assign(num_states * num_classes_, 0);
+  word_lengths_.assign(num_states, 0);
+  output_links_.assign(num_states, kNoState);
+  vector<uint32_t> failure(num_states, 0);
+
+  /* a state starts as a copy of the row of its failure target, then its own
+   * edges override it.  Children are numbered in the order of the walk above */
+  uint32_t next_state = 1;
+  for (uint32_t s = 0; s < num_states; ++s) {
+    uint32_t* row = transitions_.data() + s * num_classes_;
+    if (s != 0) {
+      const uint32_t* inherited = transitions_.data() + failure[s] * num_classes_;
+      copy(inherited, inherited + num_classes_, row);
+      word_lengths_[s] = trie.isWord(nodes[s]) ? depths[s] : 0;
+      output_links_[s] = word_lengths_[failure[s]] ? failure[s] : output_links_[failure[s]];
+    }
+    const char* labels = trie.labels(nodes[s]);
+    for (size_t i = 0; i < trie.numChildren(nodes[s]); ++i) {
+      uint32_t child = next_state++;
+      uint8_t c = byte_classes_[static_cast<unsigned char>(labels[i])];
+      /* the children of the root fail back to the root */
+      failure[child] = s == 0 ? 0 : row[c] / num_classes;
+      row[c] = child * num_classes;
+    }
+  }
+
+  /* tag every transition into a state where some word ends */
+  for (uint32_t& target : transitions_) {
+    uint32_t s = target / num_classes;
+    if (word_lengths_[s] || output_links_[s] != kNoState)
+      target |= kMatchBit;
+  }
+}
+
+void LexiconScanner::scan(const char* data, size_t length, const MatchFunc& func) const {
+  run(0, data, length, 0, func);
+}
+
+size_t LexiconScanner::memoryUsage() const {
+  return sizeof(*this) + transitions_.capacity() * sizeof(uint32_t) +
+    word_lengths_.capacity() * sizeof(uint32_t) +
+    output_links_.capacity() * sizeof(uint32_t);
+}
+
+uint32_t LexiconScanner::run(uint32_t state, const char* data, size_t length,
+    size_t base, const MatchFunc& func) const {
+  const uint32_t* transitions = transitions_.data();
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  /* state is kept pre-multiplied, so a step is one add and one load */
+  uint32_t row = state * static_cast<uint32_t>(num_classes_);
+  for (size_t i = 0; i < length; ++i) {
+    uint32_t target = transitions[row + byte_classes_[bytes[i]]];
+    row = target & ~kMatchBit;
+    if (target & kMatchBit)
+      report(row / static_cast<uint32_t>(num_classes_), base + i + 1, func);
+  }
+  return row / static_cast<uint32_t>(num_classes_);
+}
+
+void LexiconScanner::report(uint32_t state, size_t end, const MatchFunc& func) const {
+  if (!word_lengths_[state])
+    state = output_links_[state];
+  for (; state != kNoState; state = output_links_[state])
+    func(end - word_lengths_[state], word_lengths_[state]);
+}
+
+LexiconScanner::Stream::Stream(const LexiconScanner& scanner) :
+  scanner_(&scanner),
+  state_(0),
+  position_(0)
+{}
+
+void LexiconScanner::Stream::scan(const char* data, size_t length, const MatchFunc& func) {
+  state_ = scanner_->run(state_, data, length, position_, func);
+  position_ += length;
+}
+
+void LexiconScanner::Stream::reset() {
+  state_ = 0;
+  position_ = 0;
+}
@@ -0,0 +1,335 @@
+#include <RadixLexicon.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+/* the pool is not compacted while its garbage is smaller than this */
+const size_t kMinCompactionBytes = 4096;
+
+/* tail offsets and lengths are 32 bits, so the pool may not grow past this */
+const size_t kMaxTailBytes = 0xffffffffu;
+
+/* a node of the walk in mapAll, which children it visits next and the length
+ * of the word at the node */
+typedef struct WalkElement {
+  TrieArena::NodeId node;
+  size_t next_child;
+  size_t length;
+} WalkElement;
+
+}  // namespace
+
+RadixLexicon::RadixLexicon() {
+  clear();
+}
+
+void RadixLexicon::add(const string& word) {
+  add(word.data(), word.size());
+}
+
+void RadixLexicon::add(const char* word, size_t length) {
+  NodeId node = trie_.root();
+  size_t i = 0;
+  while (i < length) {
+    NodeId next = trie_.child(node, word[i]);
+    if (next == TrieArena::kNoNode) {
+      /* the rest of the word becomes one new edge */
+      Tail tail = appendTail(word + i + 1, length - i - 1);
+      next = trie_.addChild(node, word[i]);
+      setTail(next, tail);
+      node = next;
+      break;
+    }
+
+    Tail tail = tails_[next];
+    const char* letters = tail_bytes_.data() + tail.offset;
+    size_t rest = length - i - 1;
+    size_t common = 0;
+    if (rest >= tail.length &&
+        (tail.length == 0 || memcmp(word + i + 1, letters, tail.length) == 0)) {
+      common = tail.length;
+    }
+    else {
+      size_t limit = min<size_t>(rest, tail.length);
+      while (common < limit && word[i + 1 + common] == letters[common])
+        ++common;
+    }
+    if (common < tail.length) {
+      /* the word ends or branches off inside the edge: split it there */
+      NodeId middle = trie_.interpose(node, word[i], letters[common]);
+      setTail(middle, Tail{tail.offset, static_cast<uint32_t>(common)});
+      setTail(next, Tail{static_cast<uint32_t>(tail.offset + common + 1),
+          static_cast<uint32_t>(tail.length - common - 1)});
+      /* the letter at the split is now the label of the lower edge */
+      --live_tail_bytes_;
+      next = middle;
+    }
+    node = next;
+    i += 1 + common;
+  }
+
+  if (!trie_.isWord(node)) {
+    trie_.setWord(node, true);
+    ++size_;
+  }
+}
+
+void RadixLexicon::clear() {
+  trie_.clear();
+  tails_.assign(1, Tail{0, 0});
+  vector<char>().swap(tail_bytes_);
+  live_tail_bytes_ = 0;
+  size_ = 0;
+}
+
+bool RadixLexicon::contains(const string& word) const {
+  return contains(word.data(), word.size());
+}
+
+bool RadixLexicon::contains(const char* word, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  Position found = locate(word, length, nullptr);
+  return found.node != TrieArena::kNoNode && found.unmatched == 0 &&
+    trie_.isWord(found.node);
+}
+
+bool RadixLexicon::containsPrefix(const string& prefix) const {
+  return containsPrefix(prefix.data(), prefix.size());
+}
+
+bool RadixLexicon::containsPrefix(const char* prefix, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  /* the root always exists, but is only a prefix once some word was added */
+  if (length == 0)
+    return !isEmpty();
+  /* every edge leads to a word, so reaching any point of one is enough */
+  return locate(prefix, length, nullptr).node != TrieArena::kNoNode;
+}
+
+bool RadixLexicon::isEmpty() const {
+  return size_ == 0;
+}
+
+void RadixLexicon::mapAll(const function<void (const string&)>& func) const {
+  string word;
+  if (trie_.isWord(trie_.root()))
+    func(word);
+
+  vector<WalkElement> walk_stack(1, WalkElement{trie_.root(), 0, 0});
+  while (!walk_stack.empty()) {
+    WalkElement& top = walk_stack.back();
+    if (top.next_child == trie_.numChildren(top.node)) {
+      walk_stack.pop_back();
+      continue;
+    }
+    size_t i = top.next_child++;
+    NodeId child = trie_.children(top.node)[i];
+    word.resize(top.length);
+    word.push_back(trie_.labels(top.node)[i]);
+    const Tail& tail = tails_[child];
+    word.append(tail_bytes_.data() + tail.offset, tail.length);
+    if (trie_.isWord(child))
+      func(static_cast<const string&>(word));
+    walk_stack.push_back(WalkElement{child, 0, word.size()});
+  }
+}
+
+size_t RadixLexicon::memoryUsage() const {
+  return trie_.memoryUsage() + tails_.capacity() * sizeof(Tail) +
+    tail_bytes_.capacity() + path_.capacity() * sizeof(PathElement);
+}
+
+bool RadixLexicon::remove(const string& word) {
+  return remove(word.data(), word.size());
+}
+
+bool RadixLexicon::remove(const char* word, size_t length) {
+  Position found = locate(word, length, &path_);
+  if (found.node == TrieArena::kNoNode || found.unmatched != 0 ||
+      !trie_.isWord(found.node))
+    return false;
+  trie_.setWord(found.node, false);
+  --size_;
+  compressPath(word);
+  LEXICON_COUNT(kRemovals, 1);
+  return true;
+}
+
+size_t RadixLexicon::removePrefix(const string& prefix) {
+  return removePrefix(prefix.data(), prefix.size());
+}
+
+size_t RadixLexicon::removePrefix(const char* prefix, size_t length) {
+  size_t removed = size_;
+  /* every word starts with the empty prefix */
+  if (length == 0) {
+    if (isEmpty())
+      return 0;
+    LEXICON_COUNT(kRemovals, 1);
+    clear();
+    return removed;
+  }
+  Position found = locate(prefix, length, &path_);
+  if (found.node == TrieArena::kNoNode)
+    return 0;
+
+  /* cut the edge the prefix ends on, with everything below it */
+  char label = prefix[path_.back().begin];
+  path_.pop_back();
+  live_tail_bytes_ -= subtreeTailBytes(found.node);
+  removed = trie_.removeChild(path_.back().node, label);
+  size_ -= removed;
+  compressPath(prefix);
+  LEXICON_COUNT(kRemovals, 1);
+  return removed;
+}
+
+set<string> RadixLexicon::toSTLSet() const {
+  /* words come out of the walk in sorted order, so each insert is at the end */
+  set<string> word_set;
+  mapAll([&word_set](const string& word) {
+    word_set.insert(word_set.end(), word);
+  });
+  return word_set;
+}
+
+RadixLexicon::Position RadixLexicon::locate(const char* key, size_t length,
+    vector<PathElement>* path) const {
+  NodeId node = trie_.root();
+  if (path) {
+    path->clear();
+    path->push_back(PathElement{node, 0});
+  }
+  size_t i = 0;
+  while (i < length) {
+    NodeId next = trie_.child(node, key[i]);
+    if (next == TrieArena::kNoNode)
+      return Position{TrieArena::kNoNode, 0};
+    const Tail& tail = tails_[next];
+    size_t rest = length - i - 1;
+    size_t compared = min<size_t>(rest, tail.length);
+    if (compared && memcmp(key + i + 1, tail_bytes_.data() + tail.offset, compared) != 0)
+      return Position{TrieArena::kNoNode, 0};
+    if (path)
+      path->push_back(PathElement{next, i});
+    if (rest < tail.length)
+      return Position{next, tail.length - rest};
+    node = next;
+    i += 1 + tail.length;
+  }
+  return Position{node, 0};
+}
+
+RadixLexicon::Tail RadixLexicon::appendTail(const char* letters, size_t length) {
+  if (length == 0)
+    return Tail{0, 0};
+  reserveTails(length);
+  Tail tail{static_cast<uint32_t>(tail_bytes_.size()), static_cast<uint32_t>(length)};
+  tail_bytes_.insert(tail_bytes_.end(), letters, letters + length);
+  live_tail_bytes_ += length;
+  return tail;
+}
+
+void RadixLexicon::reserveTails(size_t length) {
+  if (length > kMaxTailBytes - live_tail_bytes_)
+    throw length_error("RadixLexicon: tails exceed 4 GiB");
+  /* the garbage may still be below the compaction threshold; reclaim it
+   * rather than give up on a pool that would fit */
+  if (length > kMaxTailBytes - tail_bytes_.size())
+    compactTails();
+}
+
+void RadixLexicon::setTail(NodeId node, Tail tail) {
+  if (node >= tails_.size())
+    tails_.resize(node + 1, Tail{0, 0});
+  tails_[node] = tail;
+}
+
+void RadixLexicon::compressPath(const char* key) {
+  while (path_.size() > 1) {
+    PathElement last = path_.back();
+    size_t num_children = trie_.numChildren(last.node);
+    if (trie_.isWord(last.node) || num_children > 1)
+      break;
+    NodeId parent = path_[path_.size() - 2].node;
+    if (num_children == 1) {
+      mergeChild(parent, key[last.begin]);
+      break;
+    }
+    /* a leaf without a word: drop it, its parent may now need merging */
+    live_tail_bytes_ -= tails_[last.node].length;
+    trie_.removeChild(parent, key[last.begin]);
+    path_.pop_back();
+  }
+  if (tail_bytes_.size() > live_tail_bytes_ + max(live_tail_bytes_, kMinCompactionBytes))
+    compactTails();
+}
+
+void RadixLexicon::mergeChild(NodeId node, char label) {
+  NodeId middle = trie_.child(node, label);
+  char letter = trie_.labels(middle)[0];
+  NodeId grandchild = trie_.children(middle)[0];
+  Tail upper = tails_[middle];
+  Tail lower = tails_[grandchild];
+  size_t length = upper.length + 1 + lower.length;
+  size_t gap = size_t(upper.offset) + upper.length;
+
+  Tail merged;
+  if (lower.offset == gap + 1 && gap < tail_bytes_.size() && tail_bytes_[gap] == letter) {
+    /* undoing a split: the letters are still in place in the pool */
+    merged = Tail{upper.offset, static_cast<uint32_t>(length)};
+  }
+  else {
+    reserveTails(length);
+    /* compaction moves the tails being merged */
+    upper = tails_[middle];
+    lower = tails_[grandchild];
+    merged = Tail{static_cast<uint32_t>(tail_bytes_.size()), static_cast<uint32_t>(length)};
+    tail_bytes_.resize(tail_bytes_.size() + length);
+    char* letters = tail_bytes_.data() + merged.offset;
+    memcpy(letters, tail_bytes_.data() + upper.offset, upper.length);
+    letters[upper.length] = letter;
+    memcpy(letters + upper.length + 1, tail_bytes_.data() + lower.offset, lower.length);
+  }
+  /* the label of the lower edge moves into the merged tail */
+  ++live_tail_bytes_;
+  trie_.contract(node, label);
+  tails_[grandchild] = merged;
+}
+
+size_t RadixLexicon::subtreeTailBytes(NodeId node) const {
+  size_t bytes = 0;
+  vector<NodeId> stack(1, node);
+  while (!stack.empty()) {
+    NodeId curr = stack.back();
+    stack.pop_back();
+    bytes += tails_[curr].length;
+    const NodeId* children = trie_.children(curr);
+    stack.insert(stack.end(), children, children + trie_.numChildren(curr));
+  }
+  return bytes;
+}
+
+void RadixLexicon::compactTails() {
+  vector<char> bytes;
+  bytes.reserve(live_tail_bytes_);
+  vector<NodeId> stack(1, trie_.root());
+  while (!stack.empty()) {
+    NodeId node = stack.back();
+    stack.pop_back();
+    const NodeId* children = trie_.children(node);
+    for (size_t i = 0; i < trie_.numChildren(node); ++i) {
+      Tail& tail = tails_[children[i]];
+      const char* letters = tail_bytes_.data() + tail.offset;
+      /* bytes never outgrows the pool, which reserveTails keeps in range */
+      tail.offset = static_cast<uint32_t>(bytes.size());
+      bytes.insert(bytes.end(), letters, letters + tail.length);
+      stack.push_back(children[i]);
+    }
+  }
+  tail_bytes_.swap(bytes);
+  live_tail_bytes_ = tail_bytes_.size();
+}
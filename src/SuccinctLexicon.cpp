@@ -0,0 +1,224 @@
+#include <SuccinctLexicon.h>
+#include <Lexicon.h>
+#include <LexiconCounters.h>
+#include <cstring>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+/* child lists up to this length are scanned rather than searched with memchr */
+const uint32_t kLinearScanLimit = 16;
+
+/* a level of the walk in mapAll, the children it still has to visit */
+typedef struct WalkElement {
+  uint32_t next;
+  uint32_t end;
+} WalkElement;
+
+/* returns the number of set bits of word */
+size_t popCount(uint64_t word) {
+#if defined(__GNUC__)
+  return __builtin_popcountll(word);
+#else
+  size_t count = 0;
+  for (; word; word &= word - 1)
+    ++count;
+  return count;
+#endif
+}
+
+/* returns the position of the lowest set bit of word, which must not be 0 */
+size_t lowestBit(uint64_t word) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(word);
+#else
+  size_t pos = 0;
+  for (; !(word & 1); word >>= 1)
+    ++pos;
+  return pos;
+#endif
+}
+
+/* sets bit pos of bits, growing it as needed */
+void setBit(vector<uint64_t>& bits, size_t pos) {
+  if ((pos >> 6) >= bits.size())
+    bits.resize((pos >> 6) + 1, 0);
+  bits[pos >> 6] |= uint64_t(1) << (pos & 63);
+}
+
+/* returns the position of the set bit of word with the given index */
+size_t selectInWord(uint64_t word, size_t index) {
+  /* skip whole bytes first, then clear the set bits below the one wanted */
+  size_t shift = 0;
+  for (size_t count; index >= (count = popCount(word & 0xff)); index -= count) {
+    word >>= 8;
+    shift += 8;
+  }
+  for (size_t i = 0; i < index; ++i)
+    word &= word - 1;
+  return shift + lowestBit(word);
+}
+
+}  // namespace
+
+SuccinctLexicon::SuccinctLexicon(const Lexicon& lex) : size_(lex.size()) {
+  const TrieArena& trie = lex.trie_;
+
+  /* the nodes in breadth first order, which is the order of their numbers */
+  vector<TrieArena::NodeId> order(1, trie.root());
+  labels_.push_back('\0');
+  /* the edge into the root */
+  size_t pos = 0;
+  setBit(louds_, pos++);
+  size_t zeros = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    TrieArena::NodeId node = order[i];
+    if (trie.isWord(node))
+      setBit(words_, i);
+    /* the 0 that ends the children of the previous node */
+    if (zeros % kSelectSample == 0)
+      select_samples_.push_back(static_cast<uint32_t>(pos));
+    ++pos;
+    ++zeros;
+
+    size_t count = trie.numChildren(node);
+    if (order.size() + count >= (size_t(1) << 31))
+      throw length_error("SuccinctLexicon: too many nodes");
+    const char* labels = trie.labels(node);
+    const TrieArena::NodeId* children = trie.children(node);
+    for (size_t j = 0; j < count; ++j) {
+      setBit(louds_, pos++);
+      labels_.push_back(labels[j]);
+      order.push_back(children[j]);
+    }
+  }
+  /* the 0 after the last node */
+  if (zeros % kSelectSample == 0)
+    select_samples_.push_back(static_cast<uint32_t>(pos));
+  ++pos;
+
+  louds_.resize((pos + 63) >> 6, 0);
+  words_.resize((labels_.size() + 63) >> 6, 0);
+  louds_.shrink_to_fit();
+  words_.shrink_to_fit();
+  labels_.shrink_to_fit();
+  select_samples_.shrink_to_fit();
+}
+
+bool SuccinctLexicon::contains(const string& word) const {
+  return contains(word.data(), word.size());
+}
+
+bool SuccinctLexicon::contains(const char* word, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  uint32_t node = findNode(word, length);
+  return node != kNoNode && isWord(node);
+}
+
+bool SuccinctLexicon::containsPrefix(const string& prefix) const {
+  return containsPrefix(prefix.data(), prefix.size());
+}
+
+bool SuccinctLexicon::containsPrefix(const char* prefix, size_t length) const {
+  LEXICON_COUNT(kLookups, 1);
+  /* the root always exists, but is only a prefix once some word was added */
+  if (length == 0)
+    return !isEmpty();
+  /* every node below the root leads to a word */
+  return findNode(prefix, length) != kNoNode;
+}
+
+void SuccinctLexicon::mapAll(const function<void (const string&)>& func) const {
+  string word;
+  if (isWord(0))
+    func(word);
+
+  Children root = children(0);
+  vector<WalkElement> walk_stack(1, WalkElement{root.first, root.first + root.count});
+  while (!walk_stack.empty()) {
+    WalkElement& top = walk_stack.back();
+    if (top.next == top.end) {
+      walk_stack.pop_back();
+      continue;
+    }
+    uint32_t node = top.next++;
+    /* the stack holds one level per letter of the word */
+    word.resize(walk_stack.size() - 1);
+    word.push_back(labels_[node]);
+    if (isWord(node))
+      func(static_cast<const string&>(word));
+    Children below = children(node);
+    if (below.count)
+      walk_stack.push_back(WalkElement{below.first, below.first + below.count});
+  }
+}
+
+size_t SuccinctLexicon::memoryUsage() const {
+  return louds_.capacity() * sizeof(uint64_t) +
+    select_samples_.capacity() * sizeof(uint32_t) + labels_.capacity() +
+    words_.capacity() * sizeof(uint64_t);
+}
+
+size_t SuccinctLexicon::selectZero(size_t index) const {
+  size_t pos = select_samples_[index / kSelectSample];
+  size_t remaining = index % kSelectSample;
+  if (remaining == 0)
+    return pos;
+
+  /* count the 0s after the sample a word at a time, as 1s of the complement */
+  ++pos;
+  size_t word = pos >> 6;
+  uint64_t zeros = ~louds_[word] & (~uint64_t(0) << (pos & 63));
+  for (;;) {
+    size_t count = popCount(zeros);
+    if (remaining <= count)
+      return (word << 6) + selectInWord(zeros, remaining - 1);
+    remaining -= count;
+    zeros = ~louds_[++word];
+  }
+}
+
+SuccinctLexicon::Children SuccinctLexicon::children(uint32_t node) const {
+  /* the children of node are the 1s after its 0; node + 1 0s come before them */
+  size_t pos = selectZero(node) + 1;
+  uint32_t first = static_cast<uint32_t>(pos - node - 1);
+  uint32_t count = 0;
+  size_t word = pos >> 6;
+  uint64_t ones = louds_[word] >> (pos & 63);
+  size_t available = 64 - (pos & 63);
+  /* a run of 1s may continue into the following words */
+  while (ones == (~uint64_t(0) >> (64 - available))) {
+    count += available;
+    ones = louds_[++word];
+    available = 64;
+  }
+  count += lowestBit(~ones);
+  return Children{first, count};
+}
+
+uint32_t SuccinctLexicon::findNode(const char* key, size_t length) const {
+  uint32_t node = 0;
+  for (size_t i = 0; i < length; ++i) {
+    Children below = children(node);
+    const char* base = labels_.data() + below.first;
+    if (below.count <= kLinearScanLimit) {
+      node = kNoNode;
+      for (uint32_t j = 0; j < below.count; ++j) {
+        if (base[j] == key[i]) {
+          node = below.first + j;
+          break;
+        }
+      }
+      if (node == kNoNode)
+        return kNoNode;
+    }
+    else {
+      const void* hit = memchr(base, key[i], below.count);
+      if (!hit)
+        return kNoNode;
+      node = below.first + static_cast<uint32_t>(static_cast<const char*>(hit) - base);
+    }
+  }
+  return node;
+}
@@ -0,0 +1,405 @@
+#include <TrieArena.h>
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+/* the start of an image written by writeImage, followed by the nodes, the
+ * labels, the targets and, if weights are on, the weights */
+typedef struct ImageHeader {
+  uint64_t num_nodes;
+  uint64_t num_edges;
+  uint64_t live_nodes;
+  uint32_t free_nodes;
+  uint32_t has_weights;
+  uint32_t free_blocks[9];
+  uint32_t reserved;
+} ImageHeader;
+
+static_assert(sizeof(ImageHeader) == 72, "ImageHeader must have a fixed layout");
+
+}  // namespace
+
+const TrieArena::NodeId TrieArena::kNoNode;
+const unsigned TrieArena::kNumBlockClasses;
+const uint8_t TrieArena::kNoBlock;
+const uint32_t TrieArena::kNoOffset;
+const uint32_t TrieArena::kLinearScanLimit;
+
+TrieArena::TrieArena() {
+  clear();
+}
+
+TrieArena::NodeId TrieArena::addChild(NodeId node, char label) {
+  uint32_t pos = lowerBound(nodes_[node], label);
+  {
+    const Node& n = nodes_[node];
+    if (pos < n.num_edges && labels_[n.edges + pos] == label)
+      return targets_[n.edges + pos];
+  }
+
+  NodeId new_child = allocNode();
+  try {
+    insertEdge(node, pos, label, new_child);
+  }
+  catch (...) {
+    releaseSubtree(new_child);
+    throw;
+  }
+  return new_child;
+}
+
+size_t TrieArena::removeChild(NodeId node, char label) {
+  uint32_t pos = lowerBound(nodes_[node], label);
+  Node& n = nodes_[node];
+  if (pos == n.num_edges || labels_[n.edges + pos] != label)
+    return 0;
+
+  NodeId old_child = targets_[n.edges + pos];
+  char* labels = labels_.data() + n.edges;
+  NodeId* targets = targets_.data() + n.edges;
+  memmove(labels + pos, labels + pos + 1, n.num_edges - pos - 1);
+  memmove(targets + pos, targets + pos + 1, (n.num_edges - pos - 1) * sizeof(NodeId));
+  --n.num_edges;
+
+  /* give back the block once it is empty, or shrink it once it is mostly unused */
+  if (n.num_edges == 0) {
+    freeBlock(n.edges, n.block_class);
+    n.edges = 0;
+    n.block_class = kNoBlock;
+  }
+  else if (n.block_class > 0 && n.num_edges <= (1u << n.block_class) / 4) {
+    resizeBlock(node, n.block_class - 1);
+  }
+  return releaseSubtree(old_child);
+}
+
+TrieArena::NodeId TrieArena::interpose(NodeId node, char label, char child_label) {
+  uint32_t edge = findEdge(nodes_[node], label);
+  if (edge == kNoOffset)
+    return kNoNode;
+  NodeId old_child = targets_[edge];
+  NodeId middle = allocNode();
+  try {
+    insertEdge(middle, 0, child_label, old_child);
+  }
+  catch (...) {
+    releaseSubtree(middle);
+    throw;
+  }
+  /* the edges of node did not move: only the blocks of middle were touched */
+  targets_[edge] = middle;
+  return middle;
+}
+
+TrieArena::NodeId TrieArena::contract(NodeId node, char label) {
+  uint32_t edge = findEdge(nodes_[node], label);
+  if (edge == kNoOffset)
+    return kNoNode;
+  NodeId middle = targets_[edge];
+  Node& m = nodes_[middle];
+  if (m.num_edges != 1)
+    return kNoNode;
+  NodeId grandchild = targets_[m.edges];
+  targets_[edge] = grandchild;
+  freeBlock(m.edges, m.block_class);
+  m.edges = free_nodes_;
+  m.num_edges = 0;
+  m.block_class = kNoBlock;
+  free_nodes_ = middle;
+  --live_nodes_;
+  LEXICON_COUNT(kNodesReleased, 1);
+  return grandchild;
+}
+
+void TrieArena::splice(NodeId node, TrieArena& source) {
+  if (source.nodes_.size() > kNoNode - nodes_.size())
+    throw length_error("TrieArena: too many nodes");
+  if (source.labels_.size() > kNoOffset - labels_.size())
+    throw length_error("TrieArena: too many edges");
+  NodeId node_base = static_cast<NodeId>(nodes_.size());
+  uint32_t edge_base = static_cast<uint32_t>(labels_.size());
+
+  if (source.hasWeights() && !hasWeights())
+    enableWeights();
+  if (hasWeights()) {
+    if (source.hasWeights())
+      weights_.insert(weights_.end(), source.weights_.begin(), source.weights_.end());
+    else
+      weights_.resize(weights_.size() + source.nodes_.size(), Weights());
+  }
+
+  nodes_.reserve(nodes_.size() + source.nodes_.size());
+  for (Node n : source.nodes_) {
+    if (n.block_class != kNoBlock)
+      n.edges += edge_base;
+    nodes_.push_back(n);
+  }
+  labels_.insert(labels_.end(), source.labels_.begin(), source.labels_.end());
+  targets_.reserve(targets_.size() + source.targets_.size());
+  for (NodeId target : source.targets_)
+    targets_.push_back(target + node_base);
+
+  /* the free lists of source are threaded through the arrays just copied;
+   * move their entries over to the free lists of this arena */
+  for (NodeId n = source.free_nodes_; n != kNoNode; n = source.nodes_[n].edges) {
+    nodes_[n + node_base].edges = free_nodes_;
+    free_nodes_ = n + node_base;
+  }
+  for (unsigned c = 0; c < kNumBlockClasses; ++c)
+    for (uint32_t b = source.free_blocks_[c]; b != kNoOffset; b = source.targets_[b])
+      freeBlock(b + edge_base, c);
+  live_nodes_ += source.live_nodes_;
+
+  /* hang the children of the copied root below node, then drop the root */
+  NodeId old_root = source.root() + node_base;
+  for (size_t i = 0; i < nodes_[old_root].num_edges; ++i) {
+    uint32_t edge = nodes_[old_root].edges + i;
+    insertEdge(node, lowerBound(nodes_[node], labels_[edge]), labels_[edge], targets_[edge]);
+  }
+  Node& root = nodes_[old_root];
+  if (root.block_class != kNoBlock)
+    freeBlock(root.edges, root.block_class);
+  root.edges = free_nodes_;
+  root.num_edges = 0;
+  root.block_class = kNoBlock;
+  free_nodes_ = old_root;
+  --live_nodes_;
+
+  source.clear();
+}
+
+void TrieArena::enableWeights() {
+  if (!hasWeights())
+    weights_.assign(nodes_.size(), Weights());
+}
+
+void TrieArena::clear() {
+  vector<Weights>().swap(weights_);
+  vector<Node>().swap(nodes_);
+  vector<char>().swap(labels_);
+  vector<NodeId>().swap(targets_);
+  vector<NodeId>().swap(release_stack_);
+  free_nodes_ = kNoNode;
+  fill(free_blocks_, free_blocks_ + kNumBlockClasses, kNoOffset);
+  live_nodes_ = 0;
+  allocNode();
+}
+
+void TrieArena::writeImage(const function<void (const char*, size_t)>& write) const {
+  static_assert(sizeof(Node) == 12 && sizeof(Weights) == 8,
+      "Node and Weights must have a fixed layout");
+  static_assert(sizeof(free_blocks_) == sizeof(ImageHeader().free_blocks),
+      "ImageHeader must hold every free list");
+  ImageHeader header;
+  memset(&header, 0, sizeof(header));
+  header.num_nodes = nodes_.size();
+  header.num_edges = labels_.size();
+  header.live_nodes = live_nodes_;
+  header.free_nodes = free_nodes_;
+  header.has_weights = hasWeights();
+  memcpy(header.free_blocks, free_blocks_, sizeof(free_blocks_));
+  write(reinterpret_cast<const char*>(&header), sizeof(header));
+  write(reinterpret_cast<const char*>(nodes_.data()), nodes_.size() * sizeof(Node));
+  write(labels_.data(), labels_.size());
+  write(reinterpret_cast<const char*>(targets_.data()), targets_.size() * sizeof(NodeId));
+  if (hasWeights())
+    write(reinterpret_cast<const char*>(weights_.data()), weights_.size() * sizeof(Weights));
+}
+
+bool TrieArena::readImage(size_t length, const function<bool (char*, size_t)>& read) {
+  clear();
+  ImageHeader header;
+  if (length < sizeof(header) || !read(reinterpret_cast<char*>(&header), sizeof(header)))
+    return false;
+  uint64_t nodes = header.num_nodes;
+  uint64_t edges = header.num_edges;
+  if (nodes == 0 || nodes >= kNoNode || edges >= kNoOffset || header.live_nodes > nodes ||
+      header.has_weights > 1 ||
+      length != sizeof(header) + nodes * (sizeof(Node) + header.has_weights * sizeof(Weights)) +
+        edges * (sizeof(char) + sizeof(NodeId)))
+    return false;
+
+  nodes_.resize(nodes);
+  labels_.resize(edges);
+  targets_.resize(edges);
+  if (header.has_weights)
+    weights_.resize(nodes);
+  bool valid = read(reinterpret_cast<char*>(nodes_.data()), nodes * sizeof(Node)) &&
+    read(labels_.data(), edges) &&
+    read(reinterpret_cast<char*>(targets_.data()), edges * sizeof(NodeId)) &&
+    (!header.has_weights ||
+     read(reinterpret_cast<char*>(weights_.data()), nodes * sizeof(Weights)));
+  free_nodes_ = header.free_nodes;
+  memcpy(free_blocks_, header.free_blocks, sizeof(free_blocks_));
+  live_nodes_ = header.live_nodes;
+
+  /* every block in use must lie in the pools and point at nodes */
+  valid = valid && (free_nodes_ == kNoNode || free_nodes_ < nodes);
+  for (unsigned c = 0; c < kNumBlockClasses; ++c)
+    valid = valid && (free_blocks_[c] == kNoOffset || free_blocks_[c] < edges);
+  for (size_t i = 0; i < nodes && valid; ++i) {
+    const Node& n = nodes_[i];
+    if (n.block_class == kNoBlock) {
+      valid = n.num_edges == 0;
+      continue;
+    }
+    valid = n.block_class < kNumBlockClasses && n.num_edges <= (1u << n.block_class) &&
+      n.edges + (uint64_t(1) << n.block_class) <= edges;
+    for (uint32_t e = 0; valid && e < n.num_edges; ++e)
+      valid = targets_[n.edges + e] < nodes;
+  }
+  if (!valid)
+    clear();
+  return valid;
+}
+
+size_t TrieArena::memoryUsage() const {
+  return nodes_.capacity() * sizeof(Node) + labels_.capacity() * sizeof(char) +
+    targets_.capacity() * sizeof(NodeId) + weights_.capacity() * sizeof(Weights);
+}
+
+TrieArena::Usage TrieArena::usage() const {
+  const size_t edge_size = sizeof(char) + sizeof(NodeId);
+  size_t released = 0;
+  for (NodeId n = free_nodes_; n != kNoNode; n = nodes_[n].edges)
+    ++released;
+  /* released nodes own no block, so every block in use belongs to the tree */
+  size_t edges = 0;
+  size_t block_slots = 0;
+  for (const Node& n : nodes_) {
+    edges += n.num_edges;
+    if (n.block_class != kNoBlock)
+      block_slots += size_t(1) << n.block_class;
+  }
+
+  Usage usage;
+  usage.nodes = (nodes_.size() - released) * sizeof(Node);
+  usage.free_nodes = released * sizeof(Node);
+  usage.edges = edges * edge_size;
+  usage.block_slack = (block_slots - edges) * edge_size;
+  usage.free_blocks = (labels_.size() - block_slots) * edge_size;
+  usage.weights = weights_.size() * sizeof(Weights);
+  usage.reserved = memoryUsage() - nodes_.size() * sizeof(Node) -
+    labels_.size() * edge_size - usage.weights;
+  return usage;
+}
+
+TrieArena::NodeId TrieArena::allocNode() {
+  LEXICON_COUNT(kNodeAllocations, 1);
+  NodeId node;
+  if (free_nodes_ != kNoNode) {
+    node = free_nodes_;
+    free_nodes_ = nodes_[node].edges;
+  }
+  else {
+    /* kNoNode itself is never handed out */
+    if (nodes_.size() >= kNoNode)
+      throw length_error("TrieArena: too many nodes");
+    node = static_cast<NodeId>(nodes_.size());
+    nodes_.push_back(Node());
+    if (hasWeights())
+      weights_.push_back(Weights());
+  }
+  Node& n = nodes_[node];
+  n.edges = 0;
+  n.num_edges = 0;
+  n.block_class = kNoBlock;
+  n.is_word = false;
+  n.words = 0;
+  if (hasWeights())
+    weights_[node] = Weights();
+  ++live_nodes_;
+  return node;
+}
+
+uint32_t TrieArena::allocBlock(unsigned block_class) {
+  LEXICON_COUNT(kBlockAllocations, 1);
+  uint32_t offset = free_blocks_[block_class];
+  if (offset != kNoOffset) {
+    free_blocks_[block_class] = targets_[offset];
+    return offset;
+  }
+  /* every edge of the block must have an offset below kNoOffset */
+  if ((1u << block_class) > kNoOffset - labels_.size())
+    throw length_error("TrieArena: too many edges");
+  offset = static_cast<uint32_t>(labels_.size());
+  labels_.resize(labels_.size() + (1u << block_class));
+  targets_.resize(targets_.size() + (1u << block_class));
+  return offset;
+}
+
+void TrieArena::freeBlock(uint32_t offset, unsigned block_class) {
+  targets_[offset] = free_blocks_[block_class];
+  free_blocks_[block_class] = offset;
+}
+
+void TrieArena::resizeBlock(NodeId node, unsigned block_class) {
+  uint32_t offset = allocBlock(block_class);
+  Node& n = nodes_[node];
+  copy(labels_.begin() + n.edges, labels_.begin() + n.edges + n.num_edges,
+      labels_.begin() + offset);
+  copy(targets_.begin() + n.edges, targets_.begin() + n.edges + n.num_edges,
+      targets_.begin() + offset);
+  if (n.block_class != kNoBlock)
+    freeBlock(n.edges, n.block_class);
+  n.edges = offset;
+  n.block_class = static_cast<uint8_t>(block_class);
+}
+
+void TrieArena::insertEdge(NodeId node, uint32_t pos, char label, NodeId child) {
+  if (nodes_[node].block_class == kNoBlock)
+    resizeBlock(node, 0);
+  else if (nodes_[node].num_edges == (1u << nodes_[node].block_class))
+    resizeBlock(node, nodes_[node].block_class + 1);
+
+  /* shift the tail of the block up by one to keep the labels sorted */
+  Node& n = nodes_[node];
+  char* labels = labels_.data() + n.edges;
+  NodeId* targets = targets_.data() + n.edges;
+  memmove(labels + pos + 1, labels + pos, n.num_edges - pos);
+  memmove(targets + pos + 1, targets + pos, (n.num_edges - pos) * sizeof(NodeId));
+  labels[pos] = label;
+  targets[pos] = child;
+  ++n.num_edges;
+}
+
+uint32_t TrieArena::lowerBound(const Node& node, char label) const {
+  const unsigned char* begin =
+    reinterpret_cast<const unsigned char*>(labels_.data() + node.edges);
+  return static_cast<uint32_t>(
+      std::lower_bound(begin, begin + node.num_edges,
+        static_cast<unsigned char>(label)) - begin);
+}
+
+uint32_t TrieArena::findEdge(const Node& node, char label) const {
+  uint32_t pos = lowerBound(node, label);
+  if (pos == node.num_edges || labels_[node.edges + pos] != label)
+    return kNoOffset;
+  return node.edges + pos;
+}
+
+size_t TrieArena::releaseSubtree(NodeId node) {
+  size_t words = 0;
+  release_stack_.push_back(node);
+  while (!release_stack_.empty()) {
+    NodeId curr = release_stack_.back();
+    release_stack_.pop_back();
+    Node& n = nodes_[curr];
+    if (n.is_word)
+      ++words;
+    if (n.block_class != kNoBlock) {
+      release_stack_.insert(release_stack_.end(), targets_.begin() + n.edges,
+          targets_.begin() + n.edges + n.num_edges);
+      freeBlock(n.edges, n.block_class);
+    }
+    n.edges = free_nodes_;
+    n.num_edges = 0;
+    n.block_class = kNoBlock;
+    free_nodes_ = curr;
+    --live_nodes_;
+    LEXICON_COUNT(kNodesReleased, 1);
+  }
+  return words;
+}
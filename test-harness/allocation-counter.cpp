@@ -0,0 +1,36 @@
+#include "allocation-counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+namespace {
+
+atomic<size_t> allocations(0);
+
+}  // namespace
+
+size_t allocationCount() {
+  return allocations.load(memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, memory_order_relaxed);
+  if (void* p = malloc(size ? size : 1))
+    return p;
+  throw bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const nothrow_t&) noexcept {
+  allocations.fetch_add(1, memory_order_relaxed);
+  return malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
@@ -0,0 +1,13 @@
+#ifndef ALLOCATION_COUNTER_H_
+#define ALLOCATION_COUNTER_H_
+
+#include <cstddef>
+
+/** \brief returns the number of heap allocations made by the process so far.
+ *  Linking allocation-counter.cpp into a program replaces the global
+ *  operator new and delete with versions that count.  They live in a
+ *  translation unit of their own so that no caller can inline them
+ */
+size_t allocationCount();
+
+#endif
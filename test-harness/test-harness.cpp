@@ -15,13 +15,56 @@
 #include <iomanip>
 #include <cstdarg>
 #include <set>
+#include <map>
+#include <cstring>
+#include <cstdint>
 #include <exception>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#include <iterator>
+#include <atomic>
+#include <thread>
 #include <Lexicon.h>
+#include <ConcurrentLexicon.h>
+#include <LexiconScanner.h>
+#include <RadixLexicon.h>
+#include <SuccinctLexicon.h>
+#include <JournaledLexicon.h>
+#include <EmbeddedLexicon.h>
+#include <embedded_words.h>
+#include <KeyNormalizer.h>
+#include <DenseLexicon.h>
+#include "allocation-counter.h"
+#include <csignal>
+#include <sys/resource.h>
 using namespace std;
 
 /* These flags control which tests will be run.   */
 #define EmptyLexiconTestEnabled 1
 #define BasicLexiconTestEnabled  1
+#define FrozenLexiconTestEnabled 1
+#define MappedLexiconTestEnabled 1
+#define BulkLoadTestEnabled      1
+#define BatchLookupTestEnabled   1
+#define ConcurrentLexiconTestEnabled 1
+#define CursorTestEnabled        1
+#define TopCompletionsTestEnabled 1
+#define FuzzyMatchTestEnabled    1
+#define PatternMatchTestEnabled  1
+#define ScannerTestEnabled       1
+#define StatsTestEnabled         1
+#define NoAllocationTestEnabled  1
+#define RadixLexiconTestEnabled  1
+#define RemovePrefixTestEnabled  1
+#define RankSelectTestEnabled    1
+#define WordIdTestEnabled        1
+#define ReadOnlyCopyTestEnabled  1
+#define SetAlgebraTestEnabled    1
+#define JournalTestEnabled       1
+#define EmbeddedLexiconTestEnabled 1
+#define KeyNormalizerTestEnabled 1
+#define DenseLexiconTestEnabled  1
 
 
 /* Utility function that pauses until the user hits ENTER. */
@@ -87,10 +130,36 @@ void EndTest() {
   PressEnterToContinue();
 }
 
-/* Checking operations an on empty Leixcon */
+/* Utility class for randomized tests.  A linear congruential generator gives
+ * the same numbers and words on every run, so a failure can be reproduced.
+ */
+class RandomWords {
+public:
+  explicit RandomWords(unsigned seed) : state_(seed) {}
+
+  /* returns a number below bound */
+  unsigned number(unsigned bound) {
+    state_ = state_ * 1103515245u + 12345u;
+    return (state_ >> 16) % bound;
+  }
+
+  /* returns a word of min_length to max_length letters of alphabet */
+  string word(const string& alphabet, size_t min_length, size_t max_length) {
+    string word(min_length + number(static_cast<unsigned>(max_length - min_length + 1)), '\0');
+    for (char& c : word)
+      c = alphabet[number(static_cast<unsigned>(alphabet.size()))];
+    return word;
+  }
+
+private:
+  unsigned state_;
+};
+
+/* Checking operations an on empty Leixcon.  Run for every representation */
+template <typename LexiconType>
 void EmptyLexiconTest() try {
 #if EmptyLexiconTestEnabled
-  Lexicon lex;
+  LexiconType lex;
   CheckCondition(true, "Lexicon construction completed");
 
   /* Check the basic properties of the Lexicon */
@@ -117,10 +186,12 @@ void EmptyLexiconTest() try {
   FailTest(e);
 }
 
-/* Checking operations on a Lexicon with a few words */
+/* Checking operations on a Lexicon with a few words.  Run for every
+ * representation */
+template <typename LexiconType>
 void BasicLexiconTest() try {
 #if BasicLexiconTestEnabled
-  Lexicon lex;
+  LexiconType lex;
 
   /* Add a few words to the Lexicon */
   string words[3] = {"first", "second", "third"};
@@ -178,7 +249,7 @@ void BasicLexiconTest() try {
 
   /* Make sure we can remove prefixes */
   lex.add("first");
-  CheckCondition(lex.removePrefix("fi"), "Prefix 'fi' removed");
+  CheckCondition(lex.removePrefix("fi") == 1, "Prefix 'fi' removed");
 
   /* Check properties after removePrefix() */
   CheckCondition(lex.size() == 2, "Lexicon has correct size");
@@ -202,6 +273,1504 @@ void BasicLexiconTest() try {
   FailTest(e);
 }
 
+/* Checking that a frozen lexicon answers queries like the Lexicon it came from */
+void FrozenLexiconTest() try {
+#if FrozenLexiconTestEnabled
+  Lexicon lex;
+  string words[8] = {"cat", "cats", "bat", "bats", "rat", "rats", "at", "catepillar"};
+  for (auto w: words)
+    lex.add(w);
+
+  FrozenLexicon frozen = lex.freeze();
+  CheckCondition(frozen.size() == lex.size(), "Frozen Lexicon has the same size");
+  CheckCondition(!frozen.isEmpty(),           "Frozen Lexicon is not empty");
+
+  for (auto w : words) {
+    CheckCondition(frozen.contains(w), "Frozen Lexicon contains the " + w + " word");
+    CheckCondition(frozen.containsPrefix(w.substr(0,2)), "Frozen Lexicon contains "
+        "a prefix of the " + w + " word");
+  }
+  CheckCondition(!frozen.contains("ca"),         "Word 'ca' not in frozen Lexicon");
+  CheckCondition(!frozen.contains("catss"),      "Word 'catss' not in frozen Lexicon");
+  CheckCondition(!frozen.containsPrefix("bt"),   "Prefix 'bt' not in frozen Lexicon");
+  CheckCondition(frozen.containsPrefix("catep"), "Frozen Lexicon contains prefix "
+      "catep");
+
+  set<string> frozen_set;
+  frozen.mapAll([&frozen_set](const string& w) { frozen_set.insert(w); });
+  CheckCondition(frozen_set == lex.toSTLSet(), "mapAll visits the same words");
+
+  /* "at" and "ats" suffixes are shared by cat, bat and rat */
+  CheckCondition(frozen.numStates() < 20, "Frozen Lexicon shares suffix states");
+
+  /* build from sorted input without a Lexicon */
+  istringstream sorted_input("at\nbat\nbats\ncat\ncatepillar\ncats\nrat\nrats\n");
+  FrozenLexicon from_sorted = FrozenLexicon::fromSorted(sorted_input);
+  CheckCondition(from_sorted.size() == frozen.size() &&
+      from_sorted.numStates() == frozen.numStates(), "Sorted input builds the same "
+      "automaton");
+
+  FrozenLexicon::Builder builder;
+  CheckCondition(builder.add("b") && !builder.add("a"), "Builder rejects unsorted "
+      "input");
+  CheckCondition(builder.finish().size() == 1, "Builder keeps words added in order");
+
+  CheckCondition(Lexicon().freeze().isEmpty(), "Freezing an empty Lexicon works");
+
+  EndTest();
+#else
+  TestDisabled("FrozenLexiconTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that a saved and mapped lexicon matches the text loader */
+void MappedLexiconTest() try {
+#if MappedLexiconTestEnabled
+  const string text_file = "test-harness-words.txt";
+  const string image_file = "test-harness-words.lex";
+
+  /* write a word list that exercises shared prefixes, suffixes and repeats */
+  {
+    ofstream out(text_file);
+    for (int i = 0; i < 500; ++i)
+      out << "word" << i * 7 % 311 << (i % 3 ? "s" : "") << "\n";
+    out << "a\nab\nabc\nzebra\n";
+  }
+  Lexicon lex(text_file);
+  CheckCondition(lex.size() > 0,        "Text loader read the word list");
+  CheckCondition(lex.save(image_file),  "Lexicon image saved");
+
+  FrozenLexicon mapped = Lexicon::mapFile(image_file);
+  CheckCondition(mapped.size() == lex.size(), "Mapped Lexicon has the same size");
+
+  set<string> mapped_set;
+  mapped.mapAll([&mapped_set](const string& w) { mapped_set.insert(w); });
+  CheckCondition(mapped_set == lex.toSTLSet(), "Mapped Lexicon has the same words");
+
+  bool same_answers = true;
+  for (auto w : {"word7", "word7s", "word", "wor", "ab", "abcd", "zebra", "zeb", "q", ""})
+    same_answers = same_answers && mapped.contains(w) == lex.contains(w) &&
+      mapped.containsPrefix(w) == lex.containsPrefix(w);
+  CheckCondition(same_answers, "Mapped Lexicon answers queries like the text loader");
+
+  /* saving over a mapped image must not disturb its readers */
+  CheckCondition(Lexicon().save(image_file) && Lexicon::mapFile(image_file).isEmpty(),
+      "Empty Lexicon round-trips");
+  CheckCondition(mapped.contains("zebra"), "Existing mapping survives a new save");
+
+  /* a flipped payload byte must be caught by the checksum */
+  CheckCondition(lex.save(image_file), "Lexicon image saved again");
+  {
+    fstream image(image_file, ios::in | ios::out | ios::binary);
+    image.seekg(-1, ios::end);
+    char last = static_cast<char>(image.get());
+    image.seekp(-1, ios::end);
+    image.put(static_cast<char>(last ^ 0x20));
+  }
+  bool rejected = false;
+  try {
+    Lexicon::mapFile(image_file);
+  } catch (const runtime_error&) {
+    rejected = true;
+  }
+  CheckCondition(rejected, "Corrupted Lexicon image is rejected");
+
+  rejected = false;
+  try {
+    Lexicon::mapFile(text_file);
+  } catch (const runtime_error&) {
+    rejected = true;
+  }
+  CheckCondition(rejected, "Text file is not accepted as a Lexicon image");
+
+  std::remove(text_file.c_str());
+  std::remove(image_file.c_str());
+
+  EndTest();
+#else
+  TestDisabled("MappedLexiconTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that the bulk loader builds the same Lexicon as addWordsFromFile */
+void BulkLoadTest() try {
+#if BulkLoadTestEnabled
+  /* unsorted words with repeats, an empty line and no final new line */
+  string text;
+  for (int i = 0; i < 3000; ++i) {
+    int n = i * 7919 % 2003;
+    text += string(1, char('a' + n % 26)) + to_string(n) + (n % 4 ? "ing" : "") + "\n";
+  }
+  text += "\n\xc3\xa9t\xc3\xa9\nzz";
+
+  istringstream reference_input(text);
+  Lexicon reference;
+  string line;
+  while (getline(reference_input, line))
+    reference.add(line);
+
+  istringstream sequential_input(text);
+  Lexicon sequential;
+  sequential.bulkLoad(sequential_input, 1);
+  CheckCondition(sequential.size() == reference.size() &&
+      sequential.toSTLSet() == reference.toSTLSet(), "Sequential bulk load matches "
+      "line by line adds");
+
+  istringstream parallel_input(text);
+  Lexicon parallel;
+  parallel.bulkLoad(parallel_input, 4);
+  CheckCondition(parallel.size() == reference.size() &&
+      parallel.toSTLSet() == reference.toSTLSet(), "Parallel bulk load matches "
+      "line by line adds");
+  CheckCondition(parallel.contains("") && parallel.contains("zz") &&
+      parallel.contains("\xc3\xa9t\xc3\xa9"), "Parallel bulk load keeps edge cases");
+  CheckCondition(parallel.remove("zz") && !parallel.contains("zz") &&
+      parallel.size() == reference.size() - 1,
+      "Spliced Lexicon can be modified");
+
+  /* sorted input, loaded on top of existing words */
+  set<string> sorted_words = reference.toSTLSet();
+  string sorted_text;
+  for (auto& w : sorted_words)
+    sorted_text += w + "\n";
+  istringstream sorted_input(sorted_text);
+  Lexicon merged;
+  merged.add("a0");
+  merged.add("extra");
+  merged.bulkLoad(sorted_input, 4);
+  CheckCondition(merged.size() == reference.size() + 1 && merged.contains("extra"),
+      "Bulk load adds to a non-empty Lexicon");
+
+  EndTest();
+#else
+  TestDisabled("BulkLoadTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that batched lookups agree with one-at-a-time lookups */
+void BatchLookupTest() try {
+#if BatchLookupTestEnabled
+  Lexicon lex;
+  for (int i = 0; i < 400; ++i)
+    lex.add("w" + to_string(i * 37 % 1000) + (i % 2 ? "x" : ""));
+
+  vector<string> keys = {"", "w", "w0", "w37", "w37x", "w74x", "w999", "q", "w3", "w37xx"};
+  for (int i = 0; i < 300; ++i)
+    keys.push_back("w" + to_string(i * 11 % 1200) + (i % 3 ? "x" : ""));
+
+  bool all_agree = true;
+  for (size_t batch_size : {size_t(0), size_t(1), size_t(5), keys.size()}) {
+    vector<string> batch(keys.begin(), keys.begin() + batch_size);
+    vector<bool> words = lex.containsBatch(batch);
+    vector<bool> prefixes = lex.containsPrefixBatch(batch);
+    all_agree = all_agree && words.size() == batch_size && prefixes.size() == batch_size;
+    for (size_t i = 0; i < batch_size; ++i)
+      all_agree = all_agree && words[i] == lex.contains(batch[i]) &&
+        prefixes[i] == lex.containsPrefix(batch[i]);
+  }
+  CheckCondition(all_agree, "Batched lookups match contains and containsPrefix");
+
+  Lexicon empty;
+  vector<bool> empty_results = empty.containsPrefixBatch(keys);
+  CheckCondition(find(empty_results.begin(), empty_results.end(), true) ==
+      empty_results.end(), "Batched lookups in empty Lexicon find nothing");
+
+  EndTest();
+#else
+  TestDisabled("BatchLookupTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that concurrent readers only ever observe whole batches */
+void ConcurrentLexiconTest() try {
+#if ConcurrentLexiconTestEnabled
+  Lexicon initial;
+  initial.add("base");
+  initial.add("basement");
+  ConcurrentLexicon lex(initial);
+
+  {
+    ConcurrentLexicon::Reader reader = lex.reader();
+    CheckCondition(reader.size() == 2 && reader.contains("base") &&
+        reader.containsPrefix("basem") && !reader.contains("basem"),
+        "Concurrent Lexicon starts with the words of a Lexicon");
+    lex.add("x");
+    lex.remove("base");
+    CheckCondition(reader.size() == 2 && reader.contains("x") && !reader.contains("base")
+        && reader.contains("basement"), "Single updates are visible to readers");
+    lex.removePrefix("");
+    CheckCondition(reader.size() == 0 && !reader.containsPrefix(""),
+        "Removing the empty prefix empties the Lexicon");
+  }
+
+  /* Every batch adds or removes the words "k<i>/a", "k<i>/b" and "k<i>/c"
+   * together and touches a shared prefix, so a reader that sees only some of
+   * them, or a size that is not a multiple of three, saw a torn update. */
+  const int kBatches = 3000;
+  const int kReaders = 4;
+  atomic<bool> writer_done(false);
+  atomic<long> torn(0);
+  atomic<long> snapshots(0);
+
+  vector<thread> readers;
+  for (int r = 0; r < kReaders; ++r) {
+    readers.push_back(thread([&lex, &writer_done, &torn, &snapshots, r] {
+      ConcurrentLexicon::Reader reader = lex.reader();
+      while (!writer_done.load()) {
+        ConcurrentLexicon::Snapshot snapshot = reader.snapshot();
+        size_t counted = 0;
+        snapshot.mapAll([&counted](const string&) { ++counted; });
+        if (counted != snapshot.size() || counted % 3 != 0)
+          ++torn;
+        for (int i = r; i < kBatches; i += 97) {
+          string key = "k" + to_string(i) + "/";
+          bool a = snapshot.contains(key + "a");
+          if (snapshot.contains(key + "b") != a || snapshot.contains(key + "c") != a ||
+              snapshot.containsPrefix(key) != a)
+            ++torn;
+        }
+        ++snapshots;
+      }
+    }));
+  }
+
+  for (int i = 0; i < kBatches; ++i) {
+    ConcurrentLexicon::Batch batch;
+    string key = "k" + to_string(i) + "/";
+    batch.add(key + "a");
+    batch.add(key + "b");
+    batch.add(key + "c");
+    if (i >= 10) {
+      string old_key = "k" + to_string(i - 10) + "/";
+      if (i % 2) {
+        batch.remove(old_key + "a");
+        batch.remove(old_key + "b");
+        batch.remove(old_key + "c");
+      }
+      else {
+        batch.removePrefix(old_key);
+      }
+    }
+    lex.apply(batch);
+  }
+  writer_done.store(true);
+  for (auto& t : readers)
+    t.join();
+
+  CheckCondition(snapshots.load() > 0, "Readers took snapshots during the updates");
+  CheckCondition(torn.load() == 0, "Readers never observed a torn update");
+
+  ConcurrentLexicon::Reader reader = lex.reader();
+  CheckCondition(reader.size() == 30 && reader.contains("k2999/c") &&
+      !reader.containsPrefix("k2989/"), "Concurrent Lexicon has the final contents");
+  lex.reclaim();
+  CheckCondition(lex.pendingReclamation() == 0, "Retired nodes are reclaimed once "
+      "readers are idle");
+
+  EndTest();
+#else
+  TestDisabled("ConcurrentLexiconTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Finds the words on a Boggle board by extending a Cursor one cell at a time */
+void BoggleWithCursor(const vector<string>& board, size_t row, size_t col,
+    Lexicon::Cursor& cursor, string& word, vector<string>& visited, set<string>& found) {
+  if (visited[row][col] || !cursor.advance(board[row][col]))
+    return;
+  visited[row][col] = 1;
+  word.push_back(board[row][col]);
+  if (cursor.isWord())
+    found.insert(word);
+  for (size_t r = row ? row - 1 : 0; r <= row + 1 && r < board.size(); ++r)
+    for (size_t c = col ? col - 1 : 0; c <= col + 1 && c < board[r].size(); ++c)
+      BoggleWithCursor(board, r, c, cursor, word, visited, found);
+  word.pop_back();
+  visited[row][col] = 0;
+  cursor.back();
+}
+
+/* Finds the words on a Boggle board by checking every path with containsPrefix */
+void BoggleWithPrefixes(const Lexicon& lex, const vector<string>& board, size_t row,
+    size_t col, string& word, vector<string>& visited, set<string>& found) {
+  if (visited[row][col])
+    return;
+  word.push_back(board[row][col]);
+  if (lex.containsPrefix(word)) {
+    visited[row][col] = 1;
+    if (lex.contains(word))
+      found.insert(word);
+    for (size_t r = row ? row - 1 : 0; r <= row + 1 && r < board.size(); ++r)
+      for (size_t c = col ? col - 1 : 0; c <= col + 1 && c < board[r].size(); ++c)
+        BoggleWithPrefixes(lex, board, r, c, word, visited, found);
+    visited[row][col] = 0;
+  }
+  word.pop_back();
+}
+
+/* Checking character-by-character traversal with a Cursor */
+void CursorTest() try {
+#if CursorTestEnabled
+  Lexicon lex;
+  for (const char* word : {"a", "ant", "ants", "and", "bat", "tab", "tan", "nab"})
+    lex.add(word);
+
+  Lexicon::Cursor cursor = lex.cursor();
+  CheckCondition(cursor.depth() == 0 && !cursor.isWord() && cursor.hasChildren(),
+      "Cursor starts at the empty prefix");
+  CheckCondition(string(cursor.children().begin(), cursor.children().end()) == "abnt",
+      "Cursor lists the first letters in order");
+  CheckCondition(!cursor.back(), "Cursor can't back up from the empty prefix");
+  CheckCondition(!cursor.advance('z') && cursor.depth() == 0,
+      "Cursor stays put on a missing letter");
+
+  CheckCondition(cursor.advance('a') && cursor.isWord(), "Cursor finds a one-letter word");
+  CheckCondition(cursor.advance('n') && !cursor.isWord() &&
+      string(cursor.children().begin(), cursor.children().end()) == "dt",
+      "Cursor reaches a prefix that is not a word");
+  Lexicon::Cursor copy = cursor;
+  CheckCondition(copy.advance('t') && copy.advance('s') && copy.isWord() &&
+      !copy.hasChildren() && copy.children().size() == 0, "Copied cursor reaches a leaf");
+  CheckCondition(cursor.depth() == 2 && copy.depth() == 4,
+      "Copied cursor moves independently");
+  CheckCondition(copy.back() && copy.isWord() && copy.back() && cursor.back() &&
+      cursor.isWord(), "Cursor backs up along its path");
+
+  vector<string> board = {"tanb", "asda", "bnta", "natb"};
+  for (int i = 0; i < 200; ++i) {
+    string word;
+    for (int j = 0, k = i; j < 3 + i % 4; ++j, k = k * 7 + 3)
+      word.push_back("abdnst"[k % 6]);
+    lex.add(word);
+  }
+  Lexicon::Cursor search = lex.cursor();
+  set<string> with_cursor, with_prefixes;
+  vector<string> visited(board.size(), string(board[0].size(), 0));
+  string word;
+  for (size_t r = 0; r < board.size(); ++r)
+    for (size_t c = 0; c < board[r].size(); ++c) {
+      BoggleWithCursor(board, r, c, search, word, visited, with_cursor);
+      BoggleWithPrefixes(lex, board, r, c, word, visited, with_prefixes);
+    }
+  CheckCondition(!with_cursor.empty() && with_cursor == with_prefixes,
+      "Cursor search finds the same Boggle words as containsPrefix");
+
+  EndTest();
+#else
+  TestDisabled("CursorTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking ranked completions against sorting all matching words */
+void TopCompletionsTest() try {
+#if TopCompletionsTestEnabled
+  Lexicon lex;
+  lex.add(string("car"), 5);
+  lex.add(string("card"), 9);
+  lex.add(string("care"), 9);
+  lex.add("cart");
+  lex.add(string("dog"), 7);
+  CheckCondition(lex.weight("card") == 9 && lex.weight("cart") == 0 &&
+      lex.weight("ca") == 0, "Weights are stored per word");
+  CheckCondition(lex.topCompletions("ca", 3) == vector<string>({"card", "care", "car"}),
+      "Completions come by weight, then in sorted order");
+  CheckCondition(lex.topCompletions("", 10).size() == 5 &&
+      lex.topCompletions("x", 10).empty() && lex.topCompletions("c", 0).empty(),
+      "Completions are limited by prefix and count");
+
+  lex.add(string("card"), 1);
+  lex.remove("care");
+  lex.removePrefix("do");
+  CheckCondition(lex.topCompletions("", 2) == vector<string>({"car", "card"}),
+      "Completions follow weight changes and removals");
+  lex.add("care");
+  CheckCondition(lex.weight("care") == 0, "A removed word loses its weight");
+
+  /* random weights, adds and removes compared with a sorted copy */
+  map<string, uint32_t> expected;
+  Lexicon random_lex;
+  RandomWords random(7);
+  for (int i = 0; i < 3000; ++i) {
+    string word = random.word("abcd", 1, 6);
+    if (random.number(5) == 0) {
+      random_lex.remove(word);
+      expected.erase(word);
+    }
+    else {
+      uint32_t weight = random.number(50);
+      random_lex.add(word, weight);
+      expected[word] = weight;
+    }
+  }
+  bool all_agree = true;
+  for (const char* prefix : {"", "a", "ab", "abc", "dd", "cab", "dddddd"}) {
+    vector<pair<uint32_t, string>> ranked;
+    for (const auto& entry : expected)
+      if (entry.first.compare(0, strlen(prefix), prefix) == 0)
+        ranked.push_back(make_pair(UINT32_MAX - entry.second, entry.first));
+    sort(ranked.begin(), ranked.end());
+    vector<string> top;
+    for (size_t i = 0; i < ranked.size() && i < 10; ++i)
+      top.push_back(ranked[i].second);
+    all_agree = all_agree && random_lex.topCompletions(prefix, 10) == top;
+  }
+  CheckCondition(all_agree, "Completions match ranking all matching words");
+
+  EndTest();
+#else
+  TestDisabled("TopCompletionsTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Computes the Levenshtein distance between two words the textbook way */
+size_t EditDistance(const string& from, const string& to) {
+  vector<vector<size_t>> table(from.size() + 1, vector<size_t>(to.size() + 1));
+  for (size_t i = 0; i <= from.size(); ++i)
+    for (size_t j = 0; j <= to.size(); ++j)
+      table[i][j] = i == 0 ? j : j == 0 ? i : min(min(table[i - 1][j], table[i][j - 1]) + 1,
+          table[i - 1][j - 1] + (from[i - 1] == to[j - 1] ? 0 : 1));
+  return table[from.size()][to.size()];
+}
+
+/* Checking fuzzy matches against the distance to every word */
+void FuzzyMatchTest() try {
+#if FuzzyMatchTestEnabled
+  Lexicon lex;
+  for (const char* word : {"", "cat", "cart", "cast", "coat", "act", "dog"})
+    lex.add(word);
+  vector<Lexicon::FuzzyMatch> matches = lex.fuzzyMatches("cat", 1);
+  string found;
+  for (const Lexicon::FuzzyMatch& match : matches)
+    found += match.word + ":" + to_string(match.distance) + " ";
+  CheckCondition(found == "cart:1 cast:1 cat:0 coat:1 ", "Fuzzy matches include "
+      "insertions and substitutions in sorted order");
+  CheckCondition(lex.fuzzyMatches("cat", 0).size() == 1 &&
+      lex.fuzzyMatches("", 0).size() == 1 && lex.fuzzyMatches("zzzzz", 2).empty(),
+      "Fuzzy matches respect the distance limit");
+
+  Lexicon random_lex;
+  RandomWords random(11);
+  for (int i = 0; i < 2000; ++i)
+    random_lex.add(random.word("abcde", 0, 7));
+  set<string> words = random_lex.toSTLSet();
+  bool all_agree = true;
+  for (int i = 0; i < 40; ++i) {
+    string query = random.word("abcdef", 0, 8);
+    for (size_t max_distance = 0; max_distance <= 3; ++max_distance) {
+      string expected, actual;
+      for (const string& word : words) {
+        size_t distance = EditDistance(query, word);
+        if (distance <= max_distance)
+          expected += word + ":" + to_string(distance) + " ";
+      }
+      for (const Lexicon::FuzzyMatch& match : random_lex.fuzzyMatches(query, max_distance))
+        actual += match.word + ":" + to_string(match.distance) + " ";
+      all_agree = all_agree && expected == actual;
+    }
+  }
+  CheckCondition(all_agree, "Fuzzy matches agree with computing every distance");
+
+  EndTest();
+#else
+  TestDisabled("FuzzyMatchTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Matches a word against a wildcard pattern by trying every split for '*' */
+bool GlobMatches(const char* pattern, const char* word) {
+  if (*pattern == '\0')
+    return *word == '\0';
+  if (*pattern == '*')
+    return GlobMatches(pattern + 1, word) || (*word && GlobMatches(pattern, word + 1));
+  return *word && (*pattern == '?' || *pattern == *word) && GlobMatches(pattern + 1, word + 1);
+}
+
+/* Checking wildcard queries against filtering every word */
+void PatternMatchTest() try {
+#if PatternMatchTestEnabled
+  Lexicon lex;
+  for (const char* word : {"", "cat", "cot", "cut", "coat", "act", "preparing",
+      "presenting", "pressing", "prefix"})
+    lex.add(word);
+  string found;
+  auto collect = [&found](const string& word) { found += word + " "; };
+  lex.matchPattern("c?t", collect);
+  CheckCondition(found == "cat cot cut ", "'?' matches exactly one letter");
+  found.clear();
+  lex.matchPattern("pre*ing", collect);
+  CheckCondition(found == "preparing presenting pressing ", "'*' matches a run of letters");
+  found.clear();
+  lex.matchPattern("*", collect, 3, 4);
+  CheckCondition(found == "act cat coat cot cut ", "Matches are limited by length");
+  found.clear();
+  lex.matchPattern("", collect);
+  lex.matchPattern("ca", collect);
+  lex.matchPattern("**t*", collect, 5);
+  CheckCondition(found == " presenting ", "Patterns without wildcards match whole words");
+
+  Lexicon random_lex;
+  RandomWords random(13);
+  for (int i = 0; i < 3000; ++i)
+    random_lex.add(random.word("abcd", 0, 8));
+  set<string> words = random_lex.toSTLSet();
+  bool all_agree = true;
+  for (int i = 0; i < 200; ++i) {
+    string pattern = random.word("abcd??**", 0, 6);
+    size_t min_length = random.number(4);
+    size_t max_length = min_length + random.number(8);
+    string expected, actual;
+    for (const string& word : words)
+      if (word.size() >= min_length && word.size() <= max_length &&
+          GlobMatches(pattern.c_str(), word.c_str()))
+        expected += word + " ";
+    random_lex.matchPattern(pattern, [&actual](const string& word) {
+      actual += word + " ";
+    }, min_length, max_length);
+    all_agree = all_agree && expected == actual;
+  }
+  CheckCondition(all_agree, "Pattern matches agree with filtering every word");
+
+  EndTest();
+#else
+  TestDisabled("PatternMatchTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that scanning finds exactly the substrings that are words */
+void ScannerTest() try {
+#if ScannerTestEnabled
+  Lexicon lex;
+  for (const char* word : {"he", "she", "his", "hers", "s"})
+    lex.add(word);
+  LexiconScanner scanner(lex);
+  string found;
+  auto collect = [&found](size_t pos, size_t length) {
+    found += to_string(pos) + ":" + to_string(length) + " ";
+  };
+  scanner.scan("ushers", 6, collect);
+  CheckCondition(found == "1:1 1:3 2:2 2:4 5:1 ", "Scanner reports overlapping words "
+      "by end, longest first");
+  found.clear();
+  scanner.scan("xyz", 3, collect);
+  scanner.scan("", 0, collect);
+  CheckCondition(found.empty(), "Scanner finds nothing in text without words");
+  found.clear();
+  LexiconScanner(Lexicon()).scan("anything", 8, collect);
+  CheckCondition(found.empty(), "Empty Lexicon finds nothing");
+
+  Lexicon random_lex;
+  RandomWords random(17);
+  for (int i = 0; i < 300; ++i)
+    random_lex.add(random.word("abc", 1, 5));
+  string text = random.word("abcd", 2000, 2000);
+
+  set<pair<size_t, size_t>> expected, whole, chunked;
+  for (size_t pos = 0; pos < text.size(); ++pos)
+    for (size_t length = 1; length <= 5 && pos + length <= text.size(); ++length)
+      if (random_lex.contains(text.substr(pos, length)))
+        expected.insert(make_pair(pos, length));
+  LexiconScanner random_scanner(random_lex);
+  random_scanner.scan(text.data(), text.size(), [&whole](size_t pos, size_t length) {
+    whole.insert(make_pair(pos, length));
+  });
+  CheckCondition(!expected.empty() && whole == expected,
+      "Scanner finds every occurrence of every word");
+
+  LexiconScanner::Stream stream(random_scanner);
+  for (size_t pos = 0; pos < text.size(); ) {
+    size_t length = min<size_t>(random.number(7), text.size() - pos);
+    stream.scan(text.data() + pos, length, [&chunked](size_t pos, size_t length) {
+      chunked.insert(make_pair(pos, length));
+    });
+    pos += length;
+  }
+  CheckCondition(chunked == expected && stream.position() == text.size(),
+      "Streaming finds occurrences across chunk boundaries");
+
+  EndTest();
+#else
+  TestDisabled("ScannerTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking the shape and memory figures reported by stats() */
+void StatsTest() try {
+#if StatsTestEnabled
+  Lexicon lex;
+  Lexicon::Stats empty = lex.stats();
+  CheckCondition(empty.words == 0 && empty.nodes == 1 && empty.edges == 0 &&
+      empty.longest_word.empty(), "Stats of an empty Lexicon show only the root");
+
+  for (const char* word : {"a", "an", "ant", "and", "bee", "beet", "be"})
+    lex.add(word);
+  Lexicon::Stats stats = lex.stats();
+  CheckCondition(stats.words == 7 && stats.nodes == 9 && stats.edges == 8,
+      "Stats count words, nodes and edges");
+  CheckCondition(stats.depth_histogram == vector<size_t>({1, 2, 2, 3, 1}),
+      "Stats count nodes per depth");
+  CheckCondition(stats.fanout_histogram == vector<size_t>({3, 4, 2}),
+      "Stats count nodes per number of children");
+  CheckCondition(stats.longest_word == "beet", "Stats find the longest word");
+  CheckCondition(stats.bytes.total() > 0 && stats.bytes.nodes > 0 && stats.bytes.edges > 0,
+      "Stats break down the memory used");
+
+  LexiconCounters::reset();
+  lex.contains("ant");
+  lex.containsPrefix("be");
+  lex.remove("beet");
+  lex.removePrefix("a");
+  if (LexiconCounters::kEnabled)
+    CheckCondition(LexiconCounters::get(LexiconCounters::kLookups) == 2 &&
+        LexiconCounters::get(LexiconCounters::kNodeVisits) >= 5 &&
+        LexiconCounters::get(LexiconCounters::kRemovals) == 2 &&
+        LexiconCounters::get(LexiconCounters::kNodesReleased) == 5,
+        "Counters count lookups, visits and removals");
+  else
+    CheckCondition(LexiconCounters::get(LexiconCounters::kLookups) == 0 &&
+        LexiconCounters::get(LexiconCounters::kNodeVisits) == 0,
+        "Counters stay at zero when not compiled in");
+  stats = lex.stats();
+  CheckCondition(stats.nodes == 4 && stats.bytes.free_nodes > 0,
+      "Stats show released nodes as free");
+
+  EndTest();
+#else
+  TestDisabled("StatsTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that queries on slices of a buffer do not allocate */
+void NoAllocationTest() try {
+#if NoAllocationTestEnabled
+  Lexicon lex;
+  for (const char* word : {"get", "getter", "post", "put", "patch", "delete", "head"})
+    lex.add(word);
+  const char buffer[] = "GET get /index HTTP/1.1 getter patch pat delete";
+
+  size_t before = allocationCount();
+  size_t hits = 0;
+  for (int i = 0; i < 100; ++i) {
+    hits += lex.contains(buffer + 4, 3);
+    hits += lex.contains(buffer + 24, 6);
+    hits += !lex.contains(buffer, 3);
+    hits += lex.containsPrefix(buffer + 37, 3);
+    hits += !lex.containsPrefix(buffer + 8, 6);
+    hits += lex.containsPrefix(buffer, 0);
+  }
+  /* read the count before the rationale string is built */
+  bool allocated = allocationCount() != before;
+  CheckCondition(hits == 600 && !allocated,
+      "Lookups on buffer slices do not allocate");
+
+  lex.add(buffer + 31, 5);
+  lex.remove(buffer + 31, 5);
+  before = allocationCount();
+  bool removed = lex.remove(buffer + 24, 6) && lex.removePrefix(buffer + 41, 3) &&
+    !lex.remove(buffer + 37, 3) && lex.size() == 4;
+  allocated = allocationCount() != before;
+  CheckCondition(removed && !allocated,
+      "Removals of buffer slices do not allocate");
+
+  lex.add(buffer + 31, 5);
+  CheckCondition(lex.contains(string("patch")) && lex.contains("patch", 5),
+      "Buffer slices and strings name the same words");
+
+  EndTest();
+#else
+  TestDisabled("NoAllocationTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that the radix tree splits and merges edges and stays compressed */
+void RadixLexiconTest() try {
+#if RadixLexiconTestEnabled
+  RadixLexicon lex;
+  lex.add("abcdef");
+  CheckCondition(lex.nodeCount() == 2, "A single word is a single edge");
+  lex.add("abcxyz");
+  CheckCondition(lex.nodeCount() == 4, "A word branching off splits the edge");
+  lex.add("ab");
+  CheckCondition(lex.nodeCount() == 5 && lex.contains("ab") && !lex.contains("abc"),
+      "A word ending inside an edge splits it");
+  CheckCondition(lex.containsPrefix("abcx") && lex.containsPrefix("abcde") &&
+      !lex.containsPrefix("abce") && !lex.containsPrefix("abcdefg"),
+      "Prefixes ending inside an edge are found");
+  CheckCondition(lex.remove("abcxyz") && lex.remove("ab") && lex.nodeCount() == 2,
+      "Removing the branches merges the edges again");
+  CheckCondition(lex.contains("abcdef") && !lex.containsPrefix("abcx"),
+      "The merged edge holds the remaining word");
+
+  /* long keys with long shared runs cost nodes per word, not per letter */
+  lex.clear();
+  vector<string> paths;
+  for (int service = 0; service < 4; ++service)
+    for (int shard = 0; shard < 50; ++shard)
+      paths.push_back("/var/lib/lexicon/service-" + to_string(service) +
+          "/cache/objects/shard-" + to_string(shard) + "/index-" +
+          string(100 + shard, static_cast<char>('a' + shard % 26)));
+  for (const string& path : paths)
+    lex.add(path);
+  bool all_found = true;
+  for (const string& path : paths)
+    all_found = all_found && lex.contains(path) && !lex.contains(path.substr(0, path.size() - 1)) &&
+      lex.containsPrefix(path.substr(0, path.size() / 2));
+  CheckCondition(all_found && lex.size() == paths.size(), "All long keys are found");
+  CheckCondition(lex.nodeCount() < 2 * lex.size() + 1,
+      "Long keys need fewer than two nodes per word");
+  CheckCondition(lex.removePrefix("/var/lib/lexicon/service-1/") == 50 && lex.size() == 150 &&
+      !lex.containsPrefix("/var/lib/lexicon/service-1"), "Long prefix removed");
+
+  /* random edits on a small alphabet split and merge edges all the time */
+  set<string> expected;
+  lex.clear();
+  RandomWords random(12345);
+  bool consistent = true;
+  for (int step = 0; step < 20000; ++step) {
+    string word = random.word("abc", 0, 7);
+    unsigned operation = random.number(10);
+    if (operation < 6) {
+      lex.add(word);
+      expected.insert(word);
+    }
+    else if (operation < 9) {
+      consistent = consistent && lex.remove(word) == (expected.erase(word) == 1);
+    }
+    else {
+      size_t before = expected.size();
+      for (auto it = expected.lower_bound(word);
+           it != expected.end() && it->compare(0, word.size(), word) == 0; )
+        it = expected.erase(it);
+      consistent = consistent && lex.removePrefix(word) == before - expected.size();
+    }
+    consistent = consistent && lex.size() == expected.size() &&
+      lex.nodeCount() <= 2 * lex.size() + 1;
+  }
+  CheckCondition(consistent, "Random edits agree with std::set");
+  CheckCondition(lex.toSTLSet() == expected, "Contents agree with std::set after random edits");
+
+  EndTest();
+#else
+  TestDisabled("RadixLexiconTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that removePrefix counts what it removes and prunes dead branches */
+void RemovePrefixTest() try {
+#if RemovePrefixTestEnabled
+  Lexicon lex, expected;
+  for (int i = 0; i < 1000; ++i) {
+    lex.add("tenant-1/objects/" + to_string(i));
+    lex.add("tenant-2/objects/" + to_string(i));
+    expected.add("tenant-2/objects/" + to_string(i));
+  }
+  lex.add("tenant-1");
+  expected.add("tenant-1");
+  CheckCondition(lex.removePrefix("tenant-1/") == 1000 && lex.size() == 1001,
+      "removePrefix returns the number of words removed");
+  CheckCondition(lex.stats().nodes == expected.stats().nodes && lex.contains("tenant-1"),
+      "removePrefix leaves only the nodes of the remaining words");
+  CheckCondition(lex.removePrefix("tenant-3") == 0 && lex.removePrefix("tenant-1") == 1,
+      "removePrefix counts misses and single words");
+  CheckCondition(lex.removePrefix("") == 1000 && lex.isEmpty(),
+      "The empty prefix removes everything");
+
+  /* a path far deeper than any call stack could follow */
+  string deep(1000000, 'a');
+  lex.add(deep);
+  lex.add("a");
+  lex.add(deep + "b");
+  CheckCondition(lex.remove(deep + "b") && lex.removePrefix(deep.substr(0, 500000)) == 1,
+      "Deep words are removed");
+  CheckCondition(lex.size() == 1 && lex.stats().nodes == 2 && lex.contains("a"),
+      "The dead branch below a deep prefix is released in one cut");
+
+  EndTest();
+#else
+  TestDisabled("RemovePrefixTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking prefix counts, rank, select and ranges against a sorted vector */
+void RankSelectTest() try {
+#if RankSelectTestEnabled
+  Lexicon lex;
+  set<string> words;
+  RandomWords random(777);
+  for (int i = 0; i < 3000; ++i) {
+    string word = random.word("abcd\xe0\xe1", 0, 6);
+    lex.add(word);
+    words.insert(word);
+  }
+  /* some removals, so the counts have been decremented as well */
+  for (int i = 0; i < 300; ++i) {
+    string word = string(1 + random.number(3), static_cast<char>('a' + random.number(4)));
+    lex.remove(word);
+    words.erase(word);
+  }
+  lex.removePrefix("ab");
+  for (auto it = words.lower_bound("ab"); it != words.end() && it->compare(0, 2, "ab") == 0; )
+    it = words.erase(it);
+  vector<string> sorted(words.begin(), words.end());
+
+  bool ranks_match = lex.size() == sorted.size();
+  for (size_t i = 0; i < sorted.size(); ++i)
+    ranks_match = ranks_match && lex.rank(sorted[i]) == i && lex.select(i) == sorted[i];
+  CheckCondition(ranks_match, "rank and select agree with sorted order");
+
+  bool counts_match = true;
+  bool gaps_match = true;
+  for (int i = 0; i < 500; ++i) {
+    string probe = random.word("abcde\xe0\xe1", 0, 4);
+    size_t with_prefix = 0;
+    for (const string& word : sorted)
+      with_prefix += word.compare(0, probe.size(), probe) == 0;
+    counts_match = counts_match && lex.countWithPrefix(probe) == with_prefix;
+    size_t before = lower_bound(sorted.begin(), sorted.end(), probe) - sorted.begin();
+    gaps_match = gaps_match && lex.rank(probe) == before;
+  }
+  CheckCondition(counts_match, "countWithPrefix agrees with a scan");
+  CheckCondition(gaps_match, "rank of words not in the lexicon counts the words before them");
+
+  bool ranges_match = true;
+  for (int i = 0; i < 200; ++i) {
+    string lo = i % 10 == 0 ? string() : lex.select(random.number(static_cast<unsigned>(sorted.size())));
+    string hi = lo + static_cast<char>('a' + random.number(6));
+    if (i % 3 == 0)
+      hi = lex.select(random.number(static_cast<unsigned>(sorted.size())));
+    vector<string> expected(lower_bound(sorted.begin(), sorted.end(), lo),
+        lower_bound(sorted.begin(), sorted.end(), max(lo, hi)));
+    ranges_match = ranges_match && lex.wordsBetween(lo, hi) == expected;
+  }
+  CheckCondition(ranges_match, "wordsBetween agrees with the sorted range");
+
+  bool threw = false;
+  try {
+    lex.select(lex.size());
+  } catch (const out_of_range&) {
+    threw = true;
+  }
+  CheckCondition(threw, "select past the end throws");
+
+  EndTest();
+#else
+  TestDisabled("RankSelectTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that word ids are dense, ordered and round trip */
+void WordIdTest() try {
+#if WordIdTestEnabled
+  Lexicon lex;
+  string words[8] = {"cat", "cats", "bat", "bats", "rat", "rats", "at", "catepillar"};
+  for (auto w: words)
+    lex.add(w);
+
+  vector<string> sorted(words, words + 8);
+  sort(sorted.begin(), sorted.end());
+  bool dense = true;
+  for (size_t i = 0; i < sorted.size(); ++i)
+    dense = dense && lex.idOf(sorted[i]) == i && lex.wordOf(static_cast<Lexicon::WordId>(i)) == sorted[i];
+  CheckCondition(dense, "Ids are the positions of the words in sorted order");
+  CheckCondition(lex.idOf("ca") == Lexicon::kNoWord && lex.idOf("dog") == Lexicon::kNoWord &&
+      lex.idOf("") == Lexicon::kNoWord, "Words not in the Lexicon have no id");
+
+  vector<string> tokens = {"rat", "rat", "at", "dog", "catepillar", "cat", "cat", "bats"};
+  vector<Lexicon::WordId> ids = lex.encode(tokens);
+  bool encoded = ids.size() == tokens.size();
+  for (size_t i = 0; i < tokens.size(); ++i)
+    encoded = encoded && ids[i] == lex.idOf(tokens[i]);
+  CheckCondition(encoded, "encode agrees with idOf");
+  ids.erase(ids.begin() + 3);
+  tokens.erase(tokens.begin() + 3);
+  CheckCondition(lex.decode(ids) == tokens, "decode inverts encode");
+
+  bool threw = false;
+  try {
+    lex.wordOf(static_cast<Lexicon::WordId>(lex.size()));
+  } catch (const out_of_range&) {
+    threw = true;
+  }
+  CheckCondition(threw, "wordOf an id past the end throws");
+
+  /* ids follow the contents: a new word shifts the ids after it */
+  lex.add("bass");
+  CheckCondition(lex.idOf("bass") == 1 && lex.idOf("bat") == 2 && lex.idOf("at") == 0,
+      "Ids shift when a word is added");
+
+  EndTest();
+#else
+  TestDisabled("WordIdTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that a read-only copy answers queries like the Lexicon it came
+ * from.  Run for every read-only representation */
+template <typename CopyType>
+void ReadOnlyCopyTest() try {
+#if ReadOnlyCopyTestEnabled
+  Lexicon lex;
+  string words[8] = {"cat", "cats", "bat", "bats", "rat", "rats", "at", "catepillar"};
+  for (auto w: words)
+    lex.add(w);
+
+  CopyType copy(lex);
+  CheckCondition(copy.size() == lex.size(), "Read-only copy has the same size");
+  for (auto w : words) {
+    CheckCondition(copy.contains(w), "Read-only copy contains the " + w + " word");
+    CheckCondition(copy.containsPrefix(w.substr(0,2)), "Read-only copy contains "
+        "a prefix of the " + w + " word");
+  }
+  CheckCondition(!copy.contains("ca") && !copy.contains("catss") &&
+      !copy.contains("") && !copy.contains("Cat"),
+      "Words not in the Lexicon are not in the copy");
+  CheckCondition(!copy.containsPrefix("bt") && copy.containsPrefix("catep") &&
+      copy.containsPrefix("") && !copy.containsPrefix("z"),
+      "Read-only copy answers prefix queries");
+
+  /* a wide root, every byte value below it, and enough nodes to need more
+   * than one select sample */
+  for (int i = 0; i < 256; ++i) {
+    for (int j = 0; j < 8; ++j)
+      lex.add(string(1, static_cast<char>(i)) + string(j, 'x') + static_cast<char>('a' + j));
+    for (int j = 0; j < 4; ++j)
+      lex.add(string(1, static_cast<char>(i)) + static_cast<char>(255 - i) +
+          string(j, static_cast<char>(i * 7)));
+  }
+  lex.add("");
+  CopyType wide(lex);
+  vector<string> expected, visited;
+  lex.mapAll([&expected](const string& w) { expected.push_back(w); });
+  wide.mapAll([&visited](const string& w) { visited.push_back(w); });
+  CheckCondition(visited == expected, "mapAll visits the same words in the same order");
+  bool found = true;
+  for (auto& w : expected)
+    found = found && wide.contains(w.data(), w.size()) &&
+      wide.contains(w + "z") == lex.contains(w + "z") &&
+      wide.containsPrefix(w.substr(0, w.size() / 2));
+  CheckCondition(found && wide.contains(""), "Read-only copy contains every word");
+  CheckCondition(wide.nodeCount() == lex.stats().nodes,
+      "Read-only copy has a node per node of the tree");
+
+  CopyType empty((Lexicon()));
+  vector<string> none;
+  empty.mapAll([&none](const string& w) { none.push_back(w); });
+  CheckCondition(empty.isEmpty() && !empty.containsPrefix("") && !empty.contains("") &&
+      none.empty(), "Copying an empty Lexicon works");
+
+  EndTest();
+#else
+  TestDisabled("ReadOnlyCopyTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking unite, intersect and subtract against std::set */
+void SetAlgebraTest() try {
+#if SetAlgebraTestEnabled
+  /* two overlapping random word lists over a small alphabet, so that the
+   * trees share many nodes and branches */
+  set<string> left, right;
+  RandomWords random(7);
+  for (size_t i = 0; i < 3000; ++i) {
+    string word = random.word("abcd", 1, 7);
+    (i % 3 == 0 ? right : left).insert(word);
+    if (i % 5 == 0)
+      (i % 3 == 0 ? left : right).insert(word);
+  }
+  left.insert("");
+  Lexicon lhs, rhs;
+  for (auto& w : left)
+    lhs.add(w);
+  for (auto& w : right)
+    rhs.add(w, static_cast<uint32_t>(w.size()));
+
+  set<string> expected[3];
+  set_union(left.begin(), left.end(), right.begin(), right.end(),
+      inserter(expected[0], expected[0].end()));
+  set_intersection(left.begin(), left.end(), right.begin(), right.end(),
+      inserter(expected[1], expected[1].end()));
+  set_difference(left.begin(), left.end(), right.begin(), right.end(),
+      inserter(expected[2], expected[2].end()));
+  const char* names[3] = {"unite", "intersect", "subtract"};
+
+  for (unsigned threads = 1; threads <= 4; threads += 3) {
+    Lexicon results[3] = {Lexicon::unite(lhs, rhs, threads),
+        Lexicon::intersect(lhs, rhs, threads), Lexicon::subtract(lhs, rhs, threads)};
+    for (size_t op = 0; op < 3; ++op) {
+      Lexicon rebuilt;
+      for (auto& w : expected[op])
+        rebuilt.add(w);
+      CheckCondition(results[op].toSTLSet() == expected[op] &&
+          results[op].size() == expected[op].size(), string(names[op]) + " on " +
+          to_string(threads) + " threads agrees with std::set");
+      CheckCondition(results[op].stats().nodes == rebuilt.stats().nodes,
+          string(names[op]) + " leaves no empty branches");
+      bool counted = true;
+      for (auto& w : expected[op])
+        counted = counted && results[op].countWithPrefix(w) == rebuilt.countWithPrefix(w);
+      CheckCondition(counted, string(names[op]) + " keeps the word counts right");
+    }
+    CheckCondition(lhs.toSTLSet() == left && rhs.toSTLSet() == right,
+        "The static forms leave their arguments alone");
+  }
+
+  /* in place, with weights following their words */
+  Lexicon in_place(lhs);
+  in_place.unite(rhs, 2);
+  bool weighted = true;
+  for (auto& w : right)
+    weighted = weighted && in_place.weight(w) == (left.count(w) ? 0 : w.size());
+  CheckCondition(in_place.toSTLSet() == expected[0] && weighted,
+      "unite in place brings the words of the other side with their weights");
+  vector<string> top = in_place.topCompletions("", 1);
+  CheckCondition(!top.empty() && in_place.weight(top[0]) == 7,
+      "The weight bounds cover the words brought in");
+  in_place.intersect(rhs);
+  in_place.subtract(lhs);
+  set<string> only_right;
+  set_difference(right.begin(), right.end(), left.begin(), left.end(),
+      inserter(only_right, only_right.end()));
+  CheckCondition(in_place.toSTLSet() == only_right, "Operations chain in place");
+
+  Lexicon self(lhs);
+  self.unite(self);
+  self.intersect(self);
+  CheckCondition(self.toSTLSet() == left, "unite and intersect with itself change nothing");
+  self.subtract(self);
+  CheckCondition(self.isEmpty(), "subtract from itself empties the lexicon");
+  CheckCondition(Lexicon::intersect(lhs, Lexicon()).isEmpty() &&
+      Lexicon::unite(Lexicon(), rhs).toSTLSet() == right, "Empty lexicons combine");
+
+  EndTest();
+#else
+  TestDisabled("SetAlgebraTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that a journaled lexicon comes back after a restart or a crash */
+void JournalTest() try {
+#if JournalTestEnabled
+  const string path = "test-harness-journal";
+  const string journal = path + ".journal.0";
+  auto cleanup = [&path] {
+    remove((path + ".snapshot").c_str());
+    for (int g = 0; g < 16; ++g)
+      remove((path + ".journal." + to_string(g)).c_str());
+  };
+  auto wordsOf = [](const Lexicon& lex) {
+    set<string> words;
+    lex.mapAll([&words](const string& w) { words.insert(w); });
+    return words;
+  };
+  cleanup();
+
+  /* the words and the journal size after each mutation */
+  vector<set<string>> states;
+  vector<size_t> sizes;
+  {
+    JournaledLexicon lex(path, 0);
+    CheckCondition(lex.lexicon().isEmpty() && lex.recovery().replayed_records == 0,
+        "A new journaled Lexicon is empty");
+    auto record = [&] {
+      lex.flush();
+      states.push_back(wordsOf(lex.lexicon()));
+      sizes.push_back(lex.journalBytes());
+    };
+    record();
+    for (auto w : {"cat", "cats", "dog", "doge", "catepillar"}) {
+      lex.add(w);
+      record();
+    }
+    lex.add("bird", 9);
+    record();
+    lex.remove("cats");
+    record();
+    lex.removePrefix("do");
+    record();
+    size_t unchanged = lex.journalBytes();
+    lex.add("bird", 9);
+    lex.add("cat");
+    CheckCondition(!lex.remove("cats") && lex.removePrefix("zz") == 0 &&
+        lex.journalBytes() == unchanged, "Mutations that change nothing are not journaled");
+    lex.clear();
+    record();
+    lex.add("after");
+    record();
+  }
+  CheckCondition(sizes.back() == sizes[sizes.size() - 2] + 11,
+      "A record costs 6 bytes plus the word");
+
+  {
+    JournaledLexicon lex(path, 0);
+    CheckCondition(wordsOf(lex.lexicon()) == states.back() &&
+        lex.recovery().replayed_records == states.size() - 1 &&
+        lex.recovery().discarded_bytes == 0, "Reopening replays the journal");
+  }
+
+  /* cut the journal at every byte: replay keeps the whole records before the cut */
+  vector<char> full;
+  {
+    ifstream in(journal, ios::binary);
+    full.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  }
+  bool consistent = true;
+  for (size_t cut = 0; cut < full.size(); ++cut) {
+    {
+      ofstream out(journal, ios::binary | ios::trunc);
+      out.write(full.data(), cut);
+    }
+    size_t k = 0;
+    while (k + 1 < sizes.size() && sizes[k + 1] <= cut)
+      ++k;
+    JournaledLexicon lex(path, 0);
+    consistent = consistent && wordsOf(lex.lexicon()) == states[k] &&
+      lex.recovery().discarded_bytes == (cut < sizes[0] ? cut : cut - sizes[k]);
+  }
+  CheckCondition(consistent, "A journal cut mid-record replays to the last whole record");
+
+  {
+    /* half of the record adding "bird" */
+    ofstream out(journal, ios::binary | ios::trunc);
+    out.write(full.data(), (sizes[5] + sizes[6]) / 2);
+  }
+  {
+    JournaledLexicon lex(path, 0);
+    lex.add("more");
+  }
+  {
+    JournaledLexicon lex(path, 0);
+    set<string> expected = states[5];
+    expected.insert("more");
+    CheckCondition(wordsOf(lex.lexicon()) == expected,
+        "Records appended after a torn one survive the next restart");
+  }
+
+  {
+    /* a flipped bit in the "dog" record stops the replay before it */
+    ofstream out(journal, ios::binary | ios::trunc);
+    full[sizes[3] - 1] ^= 0x20;
+    out.write(full.data(), full.size());
+  }
+  {
+    JournaledLexicon lex(path, 0);
+    CheckCondition(wordsOf(lex.lexicon()) == states[2] &&
+        lex.recovery().discarded_bytes == full.size() - sizes[2],
+        "A corrupt record is caught by its checksum");
+  }
+
+  /* a journal that cannot grow takes only part of the buffer; the next flush
+   * writes the rest after it rather than repeating it */
+  cleanup();
+  {
+    JournaledLexicon lex(path, 0);
+    lex.add("first");
+    lex.flush();
+    rlimit old_limit, limit;
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    limit = old_limit;
+    limit.rlim_cur = lex.journalBytes() + 5;
+    void (*old_handler)(int) = signal(SIGXFSZ, SIG_IGN);
+    setrlimit(RLIMIT_FSIZE, &limit);
+    lex.add("second");
+    lex.add("third");
+    bool threw = false;
+    try {
+      lex.flush();
+    } catch (const runtime_error&) {
+      threw = true;
+    }
+    size_t cut = lex.journalBytes();
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, old_handler);
+    lex.sync();
+    CheckCondition(threw && cut == lex.journalBytes(), "A short write is reported");
+  }
+  {
+    JournaledLexicon lex(path, 0);
+    CheckCondition(wordsOf(lex.lexicon()) == set<string>({"first", "second", "third"}) &&
+        lex.recovery().discarded_bytes == 0,
+        "Records cut by a short write are completed by the next flush");
+  }
+
+  /* compaction writes a snapshot and drops the journal it covers */
+  cleanup();
+  set<string> expected;
+  {
+    JournaledLexicon lex(path, 0);
+    for (int i = 0; i < 1000; ++i)
+      lex.add("word" + to_string(i), static_cast<uint32_t>(i));
+    lex.compact();
+    lex.waitForCompaction();
+    lex.remove("word7");
+    lex.add("extra");
+    expected = wordsOf(lex.lexicon());
+    CheckCondition(!ifstream(journal) && ifstream(path + ".journal.1") &&
+        ifstream(path + ".snapshot"), "Compaction replaces the journal with a snapshot");
+  }
+  {
+    JournaledLexicon lex(path, 0);
+    CheckCondition(wordsOf(lex.lexicon()) == expected &&
+        lex.recovery().snapshot_words == 1000 && lex.recovery().replayed_records == 2 &&
+        lex.lexicon().weight("word999") == 999,
+        "Restart replays only the records since the snapshot");
+  }
+  {
+    /* a flipped bit in the image of the tree fails its checksum */
+    vector<char> snapshot;
+    {
+      ifstream in(path + ".snapshot", ios::binary);
+      snapshot.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+    snapshot[snapshot.size() / 2] ^= 0x20;
+    {
+      ofstream out(path + ".snapshot", ios::binary | ios::trunc);
+      out.write(snapshot.data(), snapshot.size());
+    }
+    bool threw = false;
+    try {
+      JournaledLexicon lex(path, 0);
+    } catch (const runtime_error&) {
+      threw = true;
+    }
+    CheckCondition(threw, "A corrupt snapshot is rejected");
+  }
+
+  /* compaction starts by itself once the journal is big enough */
+  cleanup();
+  {
+    JournaledLexicon lex(path, 4096);
+    for (int i = 0; i < 3000; ++i)
+      lex.add("auto" + to_string(i));
+    lex.waitForCompaction();
+    expected = wordsOf(lex.lexicon());
+    CheckCondition(ifstream(path + ".snapshot") && !ifstream(journal),
+        "Compaction starts on its own");
+  }
+  {
+    JournaledLexicon lex(path, 0);
+    CheckCondition(wordsOf(lex.lexicon()) == expected,
+        "Words survive automatic compactions");
+
+    /* the snapshot is rebuilt from the files, so a damaged one fails it */
+    {
+      ofstream out(path + ".snapshot", ios::binary | ios::trunc);
+      out << "damaged";
+    }
+    lex.compact();
+    bool surfaced = false;
+    for (int i = 0; i < 100000 && !surfaced; ++i) {
+      try {
+        lex.compact();
+      } catch (const runtime_error&) {
+        surfaced = true;
+      }
+      this_thread::yield();
+    }
+    CheckCondition(surfaced, "A failed compaction is reported by the next one");
+  }
+  cleanup();
+
+  EndTest();
+#else
+  TestDisabled("JournalTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking that a lexicon compiled into the program matches the file it came from */
+void EmbeddedLexiconTest() try {
+#if EmbeddedLexiconTestEnabled
+  Lexicon lex(LEXICON_EMBEDDED_WORDS);
+  CheckCondition(!lex.isEmpty() && embedded_words.size() == lex.size(),
+      "Embedded Lexicon has the size of the one read from its file");
+  vector<string> expected, visited;
+  lex.mapAll([&expected](const string& w) { expected.push_back(w); });
+  embedded_words.mapAll([&visited](const string& w) { visited.push_back(w); });
+  CheckCondition(visited == expected, "Embedded Lexicon holds the words of its file");
+
+  /* every word, its prefixes and some near misses answer as in the Lexicon */
+  bool same = true;
+  for (auto& w : expected) {
+    vector<string> probes = {w, w + "s", w + "\xff", "x" + w, w.substr(1)};
+    for (size_t i = 0; i < w.size(); ++i)
+      probes.push_back(w.substr(0, i));
+    for (auto& probe : probes) {
+      same = same && embedded_words.contains(probe) == lex.contains(probe) &&
+        embedded_words.containsPrefix(probe) == lex.containsPrefix(probe) &&
+        embedded_words.contains(probe.data(), probe.size()) == lex.contains(probe);
+    }
+  }
+  CheckCondition(same, "Embedded Lexicon answers queries like the Lexicon");
+  FrozenLexicon frozen = embedded_words.frozen();
+  CheckCondition(frozen.size() == lex.size() && frozen.contains(expected.back()),
+      "Embedded Lexicon can be used as a FrozenLexicon");
+
+  static constexpr EmbeddedLexicon kNoWords(nullptr, nullptr, nullptr, 0, 0,
+      0xffffffffu, 0);
+  CheckCondition(kNoWords.isEmpty() && !kNoWords.contains("") &&
+      !kNoWords.containsPrefix(""), "An empty embedded lexicon works");
+
+  ostringstream header, source;
+  EmbeddedLexicon::generate(FrozenLexicon(), "no_words", header, source);
+  CheckCondition(header.str().find("extern const EmbeddedLexicon no_words;") != string::npos &&
+      source.str().find("0u, 0u, 4294967295u, 0u);") != string::npos,
+      "Source is generated for an empty lexicon");
+  bool rejected = false;
+  try {
+    EmbeddedLexicon::generate(FrozenLexicon(), "no-words", header, source);
+  } catch (const invalid_argument&) {
+    rejected = true;
+  }
+  CheckCondition(rejected, "Names that are not identifiers are rejected");
+
+  EndTest();
+#else
+  TestDisabled("EmbeddedLexiconTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking case folding of ASCII and UTF-8 keys */
+void KeyNormalizerTest() try {
+#if KeyNormalizerTestEnabled
+  KeyNormalizer identity;
+  KeyNormalizer ascii = KeyNormalizer::asciiCaseFold();
+  KeyNormalizer utf8 = KeyNormalizer::utf8CaseFold();
+  CheckCondition(identity.isIdentity() && !ascii.isIdentity() && !utf8.isIdentity(),
+      "Only the default normalizer is the identity");
+  CheckCondition(identity.normalize("ÄBc") == "ÄBc", "The identity keeps keys as they are");
+  CheckCondition(ascii.normalize("Hello, World!") == "hello, world!",
+      "ASCII folding lowers ASCII letters");
+  CheckCondition(ascii.normalize("ÄÖÜ Straße") == "ÄÖÜ straße",
+      "ASCII folding leaves UTF-8 alone");
+  CheckCondition(utf8.normalize("ÄÖÜ STRASSE") == "äöü strasse" &&
+      utf8.normalize("ΟΔΥΣΣΕΥΣ") == "οδυσσευσ" && utf8.normalize("МОСКВА Ёж") == "москва ёж" &&
+      utf8.normalize("ŁÓDŹ ÿŸ") == "łódź ÿÿ", "UTF-8 folding lowers Latin, Greek and Cyrillic");
+  CheckCondition(utf8.normalize("ſ") == "s" && utf8.normalize("ς") == "σ" &&
+      utf8.normalize("İ€中😀") == "İ€中😀", "UTF-8 folding changes lengths and keeps the rest");
+
+  /* broken sequences pass through byte by byte */
+  string broken = "A\xc3" "B\xe2\x82" "\xff\xc0\xaf\xed\xa0\x80Z\xc3";
+  CheckCondition(utf8.normalize(broken) == "a\xc3" "b\xe2\x82" "\xff\xc0\xaf\xed\xa0\x80z\xc3",
+      "Invalid UTF-8 is passed through");
+
+  size_t bytes = 0;
+  bool finished = utf8.forEachByte("ÀBC", 4, [&bytes](char) { return ++bytes < 2; });
+  CheckCondition(!finished && bytes == 2, "forEachByte stops when asked to");
+
+  KeyNormalizer custom = KeyNormalizer::utf8([](uint32_t c) -> uint32_t {
+    return c == 0xe9 ? 'e' : c == 0xe8 ? 0x110000 : KeyNormalizer::foldCase(c);
+  });
+  CheckCondition(custom.normalize("CAFé è") == "cafe è",
+      "A folding of your own is applied, invalid results are ignored");
+  bool rejected = false;
+  try {
+    KeyNormalizer::utf8([](uint32_t c) -> uint32_t { return c == 'a' ? 0xe4 : c; });
+  } catch (const invalid_argument&) {
+    rejected = true;
+  }
+  CheckCondition(rejected, "Foldings that take ASCII outside ASCII are rejected");
+
+  Lexicon lex;
+  string words[4] = {"Apple", "APPLE", "éclair", "Über"};
+  for (auto w : words)
+    lex.add(utf8.normalize(w));
+  CheckCondition(lex.size() == 3 && lex.contains("ÉCLAIR", 7, utf8) &&
+      lex.contains("über", 5, utf8) && !lex.contains("Ube", 3, utf8) &&
+      lex.containsPrefix("APP", 3, utf8) && !lex.containsPrefix("APX", 3, utf8) &&
+      lex.containsPrefix("", 0, utf8), "Lexicon looks up normalized keys");
+
+  EndTest();
+#else
+  TestDisabled("KeyNormalizerTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
+/* Checking the alphabet of a dense lexicon and the folding of normalized
+ * copies.  The queries themselves are covered by ReadOnlyCopyTest */
+void DenseLexiconTest() try {
+#if DenseLexiconTestEnabled
+  Lexicon lex;
+  string words[8] = {"cat", "cats", "bat", "bats", "rat", "rats", "at", "catepillar"};
+  for (auto w: words)
+    lex.add(w);
+  DenseLexicon dense(lex);
+  CheckCondition(dense.alphabetSize() == 10, "Dense Lexicon has the letters of the Lexicon");
+
+  /* every byte value, so the alphabet needs four words of bitmap */
+  for (int i = 0; i < 256; ++i)
+    lex.add(string(1, static_cast<char>(i)) + static_cast<char>(255 - i));
+  DenseLexicon wide(lex);
+  CheckCondition(wide.alphabetSize() == 256 && wide.contains("\xfe\x01", 2) &&
+      !wide.contains("\x01\x01", 2), "Dense Lexicon handles every byte value");
+  CheckCondition(DenseLexicon((Lexicon())).alphabetSize() == 0,
+      "An empty Dense Lexicon has no letters");
+
+  /* normalized copies merge case variants and fold queries */
+  Lexicon mixed;
+  string variants[7] = {"Apple", "apple", "APPLE", "Ärger", "ärger", "ΣΟΦΙΑ", "Zebra"};
+  for (auto w : variants)
+    mixed.add(w);
+  DenseLexicon folded(mixed, KeyNormalizer::utf8CaseFold());
+  vector<string> normal;
+  folded.mapAll([&normal](const string& w) { normal.push_back(w); });
+  CheckCondition(folded.size() == 4 && normal == vector<string>({"apple", "zebra",
+      "ärger", "σοφια"}), "Dense Lexicon holds the normal forms of the words");
+  CheckCondition(folded.contains("aPpLe") && folded.contains("ÄRGER") &&
+      folded.contains("σοφια") && folded.containsPrefix("SOF") == false &&
+      folded.containsPrefix("ΣΟ") && !folded.contains("apples"),
+      "Dense Lexicon folds queries");
+  DenseLexicon ascii(mixed, KeyNormalizer::asciiCaseFold());
+  CheckCondition(ascii.size() == 5 && ascii.contains("ZEBRA") && ascii.contains("ÄRGER") &&
+      !ascii.contains("σοφια"), "ASCII folding leaves other letters apart");
+
+  EndTest();
+#else
+  TestDisabled("DenseLexiconTest");
+#endif
+} catch (const exception& e) {
+  FailTest(e);
+}
+
 // TODO: Many more unit test cases required
 //void HardLexiconTest() try {
 //#if BasicLexiconTestEnabled
@@ -231,10 +1800,57 @@ void BasicLexiconTest() try {
  * if they are disabled by the configuration settings at the top of the program.
  */
 int main() {
-  EmptyLexiconTest();
-  BasicLexiconTest();
+  EmptyLexiconTest<Lexicon>();
+  BasicLexiconTest<Lexicon>();
+  EmptyLexiconTest<RadixLexicon>();
+  BasicLexiconTest<RadixLexicon>();
+  FrozenLexiconTest();
+  MappedLexiconTest();
+  BulkLoadTest();
+  BatchLookupTest();
+  ConcurrentLexiconTest();
+  CursorTest();
+  TopCompletionsTest();
+  FuzzyMatchTest();
+  PatternMatchTest();
+  ScannerTest();
+  StatsTest();
+  NoAllocationTest();
+  RadixLexiconTest();
+  RemovePrefixTest();
+  RankSelectTest();
+  WordIdTest();
+  ReadOnlyCopyTest<SuccinctLexicon>();
+  ReadOnlyCopyTest<DenseLexicon>();
+  SetAlgebraTest();
+  JournalTest();
+  EmbeddedLexiconTest();
+  KeyNormalizerTest();
+  DenseLexiconTest();
 #if (EmptyLexiconTestEnabled && \
-     BasicLexiconTestEnabled)
+     BasicLexiconTestEnabled && \
+     FrozenLexiconTestEnabled && \
+     MappedLexiconTestEnabled && \
+     BulkLoadTestEnabled && \
+     BatchLookupTestEnabled && \
+     ConcurrentLexiconTestEnabled && \
+     CursorTestEnabled && \
+     TopCompletionsTestEnabled && \
+     FuzzyMatchTestEnabled && \
+     PatternMatchTestEnabled && \
+     ScannerTestEnabled && \
+     StatsTestEnabled && \
+     NoAllocationTestEnabled && \
+     RadixLexiconTestEnabled && \
+     RemovePrefixTestEnabled && \
+     RankSelectTestEnabled && \
+     WordIdTestEnabled && \
+     ReadOnlyCopyTestEnabled && \
+     SetAlgebraTestEnabled && \
+     JournalTestEnabled && \
+     EmbeddedLexiconTestEnabled && \
+     KeyNormalizerTestEnabled && \
+     DenseLexiconTestEnabled)
   cout << "All tests completed!  If they passed, you should be good to go!" << endl << endl;
 #else
   cout << "Not all tests were run.  Enable the rest of the tests, then run again." << endl << endl;
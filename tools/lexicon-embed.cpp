@@ -0,0 +1,56 @@
+/*
+ * File: lexicon-embed.cpp
+ * -----------------------
+ * Build-time generator behind the lexicon_embed() CMake function.  Reads a
+ * word file the way Lexicon(filename) does and writes NAME.h and NAME.cpp to
+ * the output directory, which define the words as a constant EmbeddedLexicon
+ * called NAME.
+ *
+ * Usage: lexicon-embed WORDS-FILE NAME OUTPUT-DIRECTORY
+ */
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <EmbeddedLexicon.h>
+#include <Lexicon.h>
+using namespace std;
+
+namespace {
+
+/* write contents to path */
+void writeFile(const string& path, const string& contents) {
+  ofstream out(path, ios::binary | ios::trunc);
+  out << contents;
+  out.close();
+  if (!out)
+    throw runtime_error("cannot write " + path);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) try {
+  if (argc != 4) {
+    cerr << "usage: " << argv[0] << " WORDS-FILE NAME OUTPUT-DIRECTORY" << endl;
+    return 2;
+  }
+  const string words_file = argv[1];
+  const string name = argv[2];
+  const string directory = argv[3];
+
+  /* Lexicon(filename) reads a missing file as an empty list; a build must not */
+  if (!ifstream(words_file))
+    throw runtime_error("cannot read " + words_file);
+  Lexicon lex(words_file);
+
+  ostringstream header, source;
+  EmbeddedLexicon::generate(lex.freeze(), name, header, source);
+  writeFile(directory + "/" + name + ".h", header.str());
+  writeFile(directory + "/" + name + ".cpp", source.str());
+  return 0;
+} catch (const exception& e) {
+  cerr << "lexicon-embed: " << e.what() << endl;
+  return 1;
+}